@@ -0,0 +1,186 @@
+#include "../src/display.h"
+#include "../src/display_consts.h"
+#include "../src/display_list.h"
+#include "../src/emulator.h"
+#include "../src/pixel_convert.h"
+#include "../src/time.h"
+#include "../src/transport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Records a frame's worth of draws like a panel's queue does: rects of all
+/// sizes each with its colour format, some drawn again straight after, some
+/// carrying on below the last, and address changes that change nothing in
+/// between. Each list is played as recorded and optimized, in 12 and 16 bit
+/// and while scrolled, and the command and pixel bytes each sent and how
+/// long playing took are printed as csv. Both are also played into an
+/// emulated panel, and the bench exits with 1 if the optimized list left
+/// its memory any different.
+
+#define DRAWS 64
+#define ITERATIONS 200
+// the mirror's landscape orientation, where the panel scrolls along x
+#define ADDRESS_OPTIONS \
+  (ADDRESS_FLIP_HORIZONTAL | ADDRESS_HORIZONTAL_ORIENTATION | ADDRESS_COLOUR_LITTLE_ENDIAN)
+#define MAX_DRAW_WIDTH 120
+#define MAX_DRAW_HEIGHT 40
+#define MEMORY_SIZE (EMULATOR_COLUMNS * EMULATOR_ROWS * 3)
+
+typedef struct list_case {
+  const char *name;
+  enum display_colour_format format;
+  // even, so 12 bit pairs stay whole
+  int scroll;
+} list_case;
+
+static const list_case cases[] = {
+  {"16_bit", COLOUR_FORMAT_16_BIT, 0},
+  {"12_bit", COLOUR_FORMAT_12_BIT, 0},
+  {"16_bit_scrolled", COLOUR_FORMAT_16_BIT, 100},
+  {"12_bit_scrolled", COLOUR_FORMAT_12_BIT, 100},
+};
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+// what playing a list sent, each time
+typedef struct played_t {
+  uint64_t command_bytes;
+  uint64_t data_bytes;
+  double ms;
+} played_t;
+
+static uint8_t noise[MAX_DRAW_WIDTH * MAX_DRAW_HEIGHT * 3];
+static uint8_t recorded_memory[MEMORY_SIZE];
+
+static void record(display_list *list, enum display_colour_format format);
+static void add_draw(display_list *list, enum display_colour_format format,
+                     int x, int y, int w, int h);
+static played_t play(display_transport *transport, const display_list *list,
+                     int iterations);
+
+int main() {
+  for (unsigned int i = 0; i < sizeof(noise); i++)
+    noise[i] = rand();
+  // timed without the emulator, which would be most of the time
+  memory_transport_options options = memory_transport_default_options();
+  options.max_log_bytes = 0;
+  options.max_events = 0;
+  display_transport *timed = memory_transport_create(options);
+  st7789_emulator *emulator = emulator_create();
+  if (timed == NULL || emulator == NULL)
+    return -1;
+  options.sink = emulator_transport_sink;
+  options.sink_ctx = emulator;
+  display_transport *checked = memory_transport_create(options);
+  if (checked == NULL)
+    return -1;
+  display_set_transport(checked);
+  if (display_open() == -1)
+    return -1;
+
+  printf("list,recorded_command_bytes,optimized_command_bytes,recorded_data_bytes,"
+         "optimized_data_bytes,recorded_ms,optimized_ms\n");
+  int failed = 0;
+  for (unsigned int c = 0; c < CASE_COUNT; c++) {
+    const list_case *lc = &cases[c];
+    display_set_transport(checked);
+    display_combined_setup(lc->format, ADDRESS_OPTIONS);
+    if (lc->scroll != 0)
+      display_scroll(lc->scroll);
+    display_list recorded, optimized;
+    display_list_init(&recorded);
+    display_list_init(&optimized);
+    record(&recorded, lc->format);
+    record(&optimized, lc->format);
+    display_list_optimize(&optimized);
+
+    memset(emulator->memory, 0, MEMORY_SIZE);
+    play(checked, &recorded, 1);
+    memcpy(recorded_memory, emulator->memory, MEMORY_SIZE);
+    memset(emulator->memory, 0, MEMORY_SIZE);
+    play(checked, &optimized, 1);
+    if (memcmp(recorded_memory, emulator->memory, MEMORY_SIZE) != 0) {
+      fprintf(stderr, "%s: the optimized list drew different pixels\n", lc->name);
+      failed = 1;
+    }
+
+    display_set_transport(timed);
+    played_t as_recorded = play(timed, &recorded, ITERATIONS);
+    played_t as_optimized = play(timed, &optimized, ITERATIONS);
+    printf("%s,%llu,%llu,%llu,%llu,%.3f,%.3f\n", lc->name,
+           (unsigned long long)as_recorded.command_bytes,
+           (unsigned long long)as_optimized.command_bytes,
+           (unsigned long long)as_recorded.data_bytes,
+           (unsigned long long)as_optimized.data_bytes, as_recorded.ms, as_optimized.ms);
+    display_list_free(&recorded);
+    display_list_free(&optimized);
+  }
+  if (emulator->error_count != 0) {
+    emulator_print_summary(emulator, DISPLAY_SPI_FREQUENCY);
+    failed = 1;
+  }
+
+  display_set_transport(checked);
+  display_close();
+  memory_transport_destroy(timed);
+  memory_transport_destroy(checked);
+  emulator_destroy(emulator);
+  return failed;
+}
+
+// DRAWS draws, starting from the same seed for each case's pair of lists
+static void record(display_list *list, enum display_colour_format format) {
+  srand(1);
+  int x = 0, y = 0, w = 0, h = 0;
+  for (int i = 0; i < DRAWS; i++) {
+    if (rand() % 4 == 0)
+      display_list_address_options(list, ADDRESS_OPTIONS);
+    int kind = rand() % 3;
+    if (kind == 1 && w > 0 && y + h < DISPLAY_VERTICAL) {
+      // carries on below the last
+      y += h;
+      h = 1 + rand() % MAX_DRAW_HEIGHT;
+      h = y + h > DISPLAY_VERTICAL ? DISPLAY_VERTICAL - y : h;
+      add_draw(list, format, x, y, w, h);
+      continue;
+    }
+    w = 2 + rand() % (MAX_DRAW_WIDTH / 2) * 2;
+    h = 1 + rand() % MAX_DRAW_HEIGHT;
+    x = rand() % ((DISPLAY_HORIZONTAL - w) / 2) * 2;
+    y = rand() % (DISPLAY_VERTICAL - h);
+    // covered by the same area drawn again, ie resent after a tear
+    if (kind == 2)
+      add_draw(list, format, x, y, w, h);
+    add_draw(list, format, x, y, w, h);
+  }
+}
+
+// draws can't cross where the scrolled memory wraps, so they stop there
+static void add_draw(display_list *list, enum display_colour_format format,
+                     int x, int y, int w, int h) {
+  display_list_colour_format(list, format);
+  int split = display_scroll_split();
+  if (x < split && x + w > split)
+    w = split - x;
+  unsigned int size = pixel_panel_row_bytes(format, w) * h;
+  display_list_draw(list, x, y, w, h, &noise[rand() % (sizeof(noise) - size + 1)], size, 0);
+}
+
+// play the list iterations times on the selected transport, which is transport
+static played_t play(display_transport *transport, const display_list *list,
+                     int iterations) {
+  memory_transport_clear(transport);
+  time_point start = get_time();
+  for (int i = 0; i < iterations; i++) {
+    display_lock();
+    display_list_play(list);
+    display_unlock();
+  }
+  played_t played;
+  played.ms = real_time_s(start, get_time()) / iterations * 1e3;
+  memory_transport_log *log = memory_transport_get_log(transport);
+  played.command_bytes = log->command_bytes / iterations;
+  played.data_bytes = log->data_bytes / iterations;
+  return played;
+}
@@ -0,0 +1,739 @@
+#include "../src/display.h"
+#include "../src/damage.h"
+#include "../src/display_client.h"
+#include "../src/display_consts.h"
+#include "../src/emulator.h"
+#include "../src/mirror.h"
+#include "../src/stats.h"
+#include "../src/time.h"
+#include "../src/transport.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+/// Replays synthetic workloads through the whole mirror, sending to a
+/// memory transport throttled to the panel's spi clock in place of the
+/// panel. Framebuffer scenarios draw into a file mirrored in place of
+/// /dev/fb0, X scenarios draw into an Xvfb server when Xvfb is installed,
+/// client scenarios draw through display_client.h. -w runs them over a wall
+/// of panels, each with a transport of its own, and -j sets the threads
+/// sharing the mirror's pixel work.
+/// Prints a csv line per scenario and source:
+///   frames_per_s      - frames that changed the display
+///   bytes_per_frame   - commands, parameters and pixels sent per frame
+///   cpu_ms_per_frame  - cpu used by the mirror, not the drawing, per frame
+///   latency_*_ms      - from the screen being read to its changes being sent
+/// The memory transport also feeds an emulated panel. Once a scenario stops
+/// it has to show the last frame drawn exactly, back in 16 bit, or the
+/// bench exits with 1 after the rest have run. Scenarios the panel's
+/// scrolling can follow fail the same way if they send too much per frame,
+/// on one panel as walls don't scroll.
+
+
+// time for the mirror to start and settle before measuring
+#define WARMUP_NS 500000000ull
+// time for the mirror to send the last step and go back to 16 bit colour
+// before checking what the panel shows
+#define SETTLE_NS 1000000000ull
+#define DEFAULT_SECONDS 2
+
+#define LINE_HEIGHT 12
+#define CURSOR_WIDTH 8
+#define WINDOW_WIDTH 120
+#define WINDOW_HEIGHT 90
+#define WINDOW_SPEED 3
+// columns the side scroller moves each step, even to keep 12 bit pairs whole
+#define SIDE_SCROLL_STEP 8
+
+#define MAX_RECTS 2
+
+// the X pointer is drawn over the picture, so this square round it
+// isn't checked
+#define POINTER_SKIP 64
+
+// how often a client checks whether the mirror is listening yet
+#define CONNECT_RETRY_US 10000
+#define CONNECT_TRIES 100
+
+// what a scenario draws into, rects collects the areas changed by a step
+typedef struct canvas {
+  uint16_t *pixels;
+  damage_rect rects[MAX_RECTS];
+  int rect_count;
+} canvas;
+
+typedef struct scenario {
+  const char *name;
+  // time between steps
+  uint64_t period_ns;
+  void (*start)(canvas *c);
+  void (*step)(canvas *c, uint64_t step);
+  // sending more a frame means the panel's scrolling wasn't used, 0 for no limit
+  unsigned int max_bytes_per_frame;
+} scenario;
+
+// where drawn frames go for the mirror to pick up
+typedef struct source {
+  const char *name;
+  mirror_options options;
+  uint16_t *pixels;
+  // sends the changed rects, NULL when drawing into pixels is enough
+  void (*present)(struct source *s, canvas *c);
+  // called once the mirror is starting and once it has stopped,
+  // NULL for nothing to do
+  void (*attach)(struct source *s, canvas *c);
+  void (*finish)(struct source *s);
+  Display *display;
+  XImage *image;
+  GC gc;
+  display_client client;
+} source;
+
+static void desktop_start(canvas *c);
+static void no_step(canvas *c, uint64_t step);
+static void cursor_start(canvas *c);
+static void cursor_step(canvas *c, uint64_t step);
+static void terminal_start(canvas *c);
+static void terminal_step(canvas *c, uint64_t step);
+static void video_step(canvas *c, uint64_t step);
+static void window_step(canvas *c, uint64_t step);
+static void side_scroll_start(canvas *c);
+static void side_scroll_step(canvas *c, uint64_t step);
+
+static const scenario scenarios[] = {
+  {"static_desktop", 16666667, desktop_start, no_step, 0},
+  {"blinking_cursor", 500000000, cursor_start, cursor_step, 0},
+  {"scrolling_terminal", 33333333, terminal_start, terminal_step, 0},
+  {"full_screen_video", 33333333, desktop_start, video_step, 0},
+  {"moving_window", 16666667, desktop_start, window_step, 0},
+  // in landscape the panel scrolls along x, so only the columns scrolled
+  // in should be sent. an eighth of a frame leaves room for the odd resend
+  {"side_scroller", 33333333, side_scroll_start, side_scroll_step, DISPLAY_PIXEL_COUNT * 2 / 8},
+};
+#define SCENARIO_COUNT (sizeof(scenarios) / sizeof(scenarios[0]))
+
+// the panels of the wall, left to right then top to bottom
+static int columns = 1;
+static int rows = 1;
+static int threads = 0;
+// the whole wall's picture
+static int width = DISPLAY_HORIZONTAL;
+static int height = DISPLAY_VERTICAL;
+
+static uint16_t *background;
+
+static atomic_int mirror_finished;
+
+static st7789_emulator *emulators[DISPLAY_MAX_PANELS];
+static display_transport *transports[DISPLAY_MAX_PANELS];
+// cpu the emulator used, which isn't the mirror's
+static atomic_uint_fast64_t emulated_ns;
+
+static mirror_options bench_options(void);
+static void *run_mirror(void *options);
+static int run(const scenario *sc, source *s, uint64_t duration_ns);
+static int problem_count(void);
+static void emulate(void *ctx, const uint8_t *buff, unsigned int size,
+                    enum transport_level level);
+static int check_shown(const scenario *sc, source *s, canvas *c);
+static int open_framebuffer_file(source *s, char *path);
+static pid_t start_xvfb(char *name, size_t size);
+static int open_x(source *s, const char *name, const char *framebuffer_path);
+static void present_x(source *s, canvas *c);
+static int open_client(source *s, const char *socket_path);
+static void attach_client(source *s, canvas *c);
+static void present_client(source *s, canvas *c);
+static void finish_client(source *s);
+static uint64_t cpu_ns(clockid_t clock);
+
+int main(int argc, char **argv) {
+  int seconds = DEFAULT_SECONDS;
+  const char *only = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "d:s:w:j:")) != -1) {
+    switch (opt) {
+    case 'd':
+      seconds = atoi(optarg);
+      break;
+    case 's':
+      only = optarg;
+      break;
+    case 'w':
+      if (sscanf(optarg, "%dx%d", &columns, &rows) != 2 || columns < 1 || rows < 1
+          || columns * rows > DISPLAY_MAX_PANELS) {
+        fprintf(stderr, "wall must be columnsxrows of at most %d panels\n",
+                DISPLAY_MAX_PANELS);
+        return -1;
+      }
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      if (threads < 1) {
+        fprintf(stderr, "threads must be a number above 0\n");
+        return -1;
+      }
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-d seconds] [-s framebuffer|x|client] [-w columnsxrows]"
+              " [-j threads]\n", argv[0]);
+      return -1;
+    }
+  }
+  if (seconds <= 0) {
+    fprintf(stderr, "seconds must be a number above 0\n");
+    return -1;
+  }
+  width = columns * DISPLAY_HORIZONTAL;
+  height = rows * DISPLAY_VERTICAL;
+  background = malloc(width * height * 2);
+  if (background == NULL)
+    return -1;
+
+  // started before SIGINT is blocked, as the mask survives exec
+  char x_name[32];
+  pid_t xvfb = -1;
+  if (only == NULL || strcmp(only, "x") == 0) {
+    xvfb = start_xvfb(x_name, sizeof(x_name));
+    if (xvfb == -1)
+      fprintf(stderr, "Xvfb is unavailable, skipping the X scenarios\n");
+  }
+  XInitThreads();
+  // the mirror is stopped by raising SIGINT, which its sigwait takes
+  // as long as no thread leaves it unblocked
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGINT);
+  sigprocmask(SIG_BLOCK, &sigset, NULL);
+
+  memory_transport_options transport_options = memory_transport_default_options();
+  transport_options.throttle = 1;
+  // only the counters are needed
+  transport_options.max_log_bytes = 0;
+  transport_options.max_events = 0;
+  transport_options.sink = emulate;
+  display_set_panel_count(columns * rows);
+  for (int i = 0; i < columns * rows; i++) {
+    emulators[i] = emulator_create();
+    if (emulators[i] == NULL)
+      return -1;
+    transport_options.sink_ctx = emulators[i];
+    transports[i] = memory_transport_create(transport_options);
+    if (transports[i] == NULL)
+      return -1;
+    display_set_panel_transport(i, transports[i]);
+  }
+  if (display_open() == -1)
+    return -1;
+
+  source framebuffer, x;
+  char framebuffer_path[] = "/tmp/mirror_bench_fb_XXXXXX";
+  if (open_framebuffer_file(&framebuffer, framebuffer_path) == -1)
+    return -1;
+  int have_x = xvfb != -1 && open_x(&x, x_name, framebuffer_path) == 0;
+  source client;
+  char socket_path[64];
+  snprintf(socket_path, sizeof(socket_path), "/tmp/mirror_bench_%d.sock", (int)getpid());
+  int have_client = (only == NULL || strcmp(only, "client") == 0)
+                    && open_client(&client, socket_path) == 0;
+
+  printf("scenario,source,frames_per_s,bytes_per_frame,cpu_ms_per_frame,"
+         "latency_p50_ms,latency_p99_ms,latency_max_ms,dropped_per_s\n");
+  uint64_t duration_ns = (uint64_t)seconds * 1000000000;
+  int failed = 0;
+  for (unsigned int i = 0; i < SCENARIO_COUNT; i++) {
+    if (only == NULL || strcmp(only, "framebuffer") == 0)
+      failed |= run(&scenarios[i], &framebuffer, duration_ns);
+    if (have_x)
+      failed |= run(&scenarios[i], &x, duration_ns);
+    if (have_client)
+      failed |= run(&scenarios[i], &client, duration_ns);
+  }
+
+  if (have_x) {
+    x.image->data = NULL;
+    XDestroyImage(x.image);
+    XFreeGC(x.display, x.gc);
+    XCloseDisplay(x.display);
+    free(x.pixels);
+  }
+  if (have_client)
+    free(client.pixels);
+  if (xvfb != -1) {
+    kill(xvfb, SIGTERM);
+    waitpid(xvfb, NULL, 0);
+  }
+  munmap(framebuffer.pixels, width * height * 2);
+  unlink(framebuffer_path);
+  display_close();
+  for (int i = 0; i < columns * rows; i++) {
+    memory_transport_destroy(transports[i]);
+    emulator_destroy(emulators[i]);
+  }
+  free(background);
+  return failed;
+}
+
+
+/// ---- Scenarios ----
+
+
+static void mark(canvas *c, int x, int y, int w, int h) {
+  if (c->rect_count < MAX_RECTS)
+    c->rects[c->rect_count++] = (damage_rect){x, y, w, h};
+}
+
+static void fill(canvas *c, int x, int y, int w, int h, uint16_t colour) {
+  for (int row = y; row < y + h; row++)
+    for (int col = x; col < x + w; col++)
+      c->pixels[row * width + col] = colour;
+  mark(c, x, y, w, h);
+}
+
+static void restore(canvas *c, int x, int y, int w, int h) {
+  for (int row = y; row < y + h; row++)
+    memcpy(&c->pixels[row * width + x], &background[row * width + x], w * 2);
+}
+
+static void draw_window(uint16_t *pixels, int x, int y) {
+  canvas c = {pixels, {{0}}, 0};
+  fill(&c, x, y, WINDOW_WIDTH, WINDOW_HEIGHT, 0xFFFF);
+  fill(&c, x, y, WINDOW_WIDTH, 10, 0x3A7F);
+}
+
+// a gradient with a couple of windows on it
+static void desktop_start(canvas *c) {
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      background[y * width + x] = ((y * 31 / height) << 11) | ((x * 63 / width) << 5) | 12;
+  draw_window(background, 20, 30);
+  draw_window(background, 170, 110);
+  memcpy(c->pixels, background, width * height * 2);
+  mark(c, 0, 0, width, height);
+}
+
+static void no_step(canvas *c, uint64_t step) {}
+
+static void cursor_start(canvas *c) {
+  desktop_start(c);
+  fill(c, 20, 40, WINDOW_WIDTH, WINDOW_HEIGHT - 10, 0);
+}
+
+static void cursor_step(canvas *c, uint64_t step) {
+  fill(c, 30, 50, CURSOR_WIDTH, LINE_HEIGHT, step % 2 ? 0xFFFF : 0);
+}
+
+static void terminal_start(canvas *c) {
+  fill(c, 0, 0, width, height, 0);
+}
+
+// scroll up a line and write a new one of block "characters"
+static void terminal_step(canvas *c, uint64_t step) {
+  int moved = height - LINE_HEIGHT;
+  memmove(c->pixels, &c->pixels[LINE_HEIGHT * width], moved * width * 2);
+  memset(&c->pixels[moved * width], 0, LINE_HEIGHT * width * 2);
+  int length = (step * 7919) % (width / CURSOR_WIDTH);
+  for (int i = 0; i < length; i++)
+    if ((step + i) % 5 != 0)
+      fill(c, i * CURSOR_WIDTH + 1, moved + 2, CURSOR_WIDTH - 2, LINE_HEIGHT - 4, 0x07E0);
+  c->rect_count = 0;
+  mark(c, 0, 0, width, height);
+}
+
+// every pixel changes, in a pattern drifting across the screen
+static void video_step(canvas *c, uint64_t step) {
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++) {
+      unsigned int v = (x + step * 3) ^ (y + step * 2);
+      c->pixels[y * width + x] = ((v & 31) << 11) | (((v >> 1) & 63) << 5) | ((v >> 3) & 31);
+    }
+  mark(c, 0, 0, width, height);
+}
+
+// a window bouncing between the sides of the screen
+static void window_step(canvas *c, uint64_t step) {
+  int range = width - WINDOW_WIDTH;
+  int previous = step == 0 ? 0 : (step - 1) * WINDOW_SPEED % (2 * range);
+  int position = step * WINDOW_SPEED % (2 * range);
+  previous = previous > range ? 2 * range - previous : previous;
+  position = position > range ? 2 * range - position : position;
+  int y = (height - WINDOW_HEIGHT) / 2;
+  restore(c, previous, y, WINDOW_WIDTH, WINDOW_HEIGHT);
+  mark(c, previous, y, WINDOW_WIDTH, WINDOW_HEIGHT);
+  draw_window(c->pixels, position, y);
+  mark(c, position, y, WINDOW_WIDTH, WINDOW_HEIGHT);
+}
+
+// a picture with no two columns alike, column counting along it from the start
+static uint16_t strip_colour(uint64_t column, int y) {
+  uint32_t v = (uint32_t)(column * 2654435761u) ^ (uint32_t)(y * 40503);
+  v ^= v >> 15;
+  return (uint16_t)(v * 2246822519u >> 16);
+}
+
+static void side_scroll_start(canvas *c) {
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      c->pixels[y * width + x] = strip_colour(x, y);
+  mark(c, 0, 0, width, height);
+}
+
+// move the picture left, bringing in the next columns at the right
+static void side_scroll_step(canvas *c, uint64_t step) {
+  int kept = width - SIDE_SCROLL_STEP;
+  uint64_t first = (step + 1) * SIDE_SCROLL_STEP + kept;
+  for (int y = 0; y < height; y++) {
+    uint16_t *row = &c->pixels[y * width];
+    memmove(row, &row[SIDE_SCROLL_STEP], kept * 2);
+    for (int x = 0; x < SIDE_SCROLL_STEP; x++)
+      row[kept + x] = strip_colour(first + x, y);
+  }
+  mark(c, 0, 0, width, height);
+}
+
+
+/// ---- Helper Definitions ----
+
+
+// the defaults, over the wall and threads asked for
+static mirror_options bench_options(void) {
+  mirror_options options = mirror_default_options();
+  options.panel_columns = columns;
+  options.panel_rows = rows;
+  if (threads != 0)
+    options.threads = threads;
+  return options;
+}
+
+static void *run_mirror(void *options) {
+  mirror_display(*(mirror_options *)options);
+  atomic_store(&mirror_finished, 1);
+  return NULL;
+}
+
+// step the scenario until until_ns, returns the next step number
+static uint64_t animate(const scenario *sc, source *s, canvas *c, uint64_t step,
+                        uint64_t start_ns, uint64_t until_ns) {
+  for (uint64_t next = start_ns + step * sc->period_ns; next < until_ns;
+       next = start_ns + ++step * sc->period_ns) {
+    time_sleep_until_ns(next);
+    c->rect_count = 0;
+    sc->step(c, step);
+    if (s->present != NULL && c->rect_count > 0)
+      s->present(s, c);
+  }
+  time_sleep_until_ns(until_ns);
+  return step;
+}
+
+// returns 1 if the panel didn't end up showing the scenario
+static int run(const scenario *sc, source *s, uint64_t duration_ns) {
+  canvas c = {s->pixels, {{0}}, 0};
+  sc->start(&c);
+  if (s->present != NULL)
+    s->present(s, &c);
+
+  atomic_store(&mirror_finished, 0);
+  pthread_t mirror_thread;
+  int failed = pthread_create(&mirror_thread, NULL, run_mirror, &s->options);
+  if (failed) {
+    fprintf(stderr, "failed to start the mirror %s\n", strerror(failed));
+    exit(-1);
+  }
+  if (s->attach != NULL)
+    s->attach(s, &c);
+  uint64_t start = time_monotonic_ns();
+  uint64_t step = animate(sc, s, &c, 0, start, start + WARMUP_NS);
+  if (atomic_load(&mirror_finished)) {
+    fprintf(stderr, "mirror stopped while starting %s on %s\n", sc->name, s->name);
+    exit(-1);
+  }
+
+  stats_reset();
+  uint64_t measure_start = time_monotonic_ns();
+  uint64_t cpu_start = cpu_ns(CLOCK_PROCESS_CPUTIME_ID);
+  uint64_t animate_start = cpu_ns(CLOCK_THREAD_CPUTIME_ID);
+  uint64_t emulated_start = atomic_load(&emulated_ns);
+  animate(sc, s, &c, step, start, measure_start + duration_ns);
+  double seconds = (time_monotonic_ns() - measure_start) * 1e-9;
+  uint64_t animate_cpu = cpu_ns(CLOCK_THREAD_CPUTIME_ID) - animate_start;
+  uint64_t cpu = cpu_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu_start - animate_cpu
+                 - (atomic_load(&emulated_ns) - emulated_start);
+  uint64_t frames = stats_counter_value(STATS_FRAMES_SENT);
+  uint64_t bytes = stats_counter_value(STATS_BYTES_SENT);
+  uint64_t dropped = stats_counter_value(STATS_FRAMES_DROPPED);
+  stats_summary latency = stats_stage_summary(STATS_FRAME_LATENCY);
+
+  time_sleep_until_ns(time_monotonic_ns() + SETTLE_NS);
+  int problems = problem_count();
+  kill(getpid(), SIGINT);
+  pthread_join(mirror_thread, NULL);
+  int wrong = check_shown(sc, s, &c);
+  if (s->finish != NULL)
+    s->finish(s);
+
+  // per frame figures are 0 when nothing was sent
+  double per_frame = frames == 0 ? 0 : 1.0 / frames;
+  printf("%s,%s,%.2f,%.0f,%.3f,%.3f,%.3f,%.3f,%.2f\n", sc->name, s->name,
+         frames / seconds, bytes * per_frame, cpu * 1e-6 * per_frame,
+         latency.p50_ns * 1e-6, latency.p99_ns * 1e-6, latency.max_ns * 1e-6,
+         dropped / seconds);
+  fflush(stdout);
+  if (sc->max_bytes_per_frame != 0 && columns * rows == 1
+      && bytes * per_frame > sc->max_bytes_per_frame) {
+    fprintf(stderr, "%s on %s: sent %.0f bytes a frame, the panel's scrolling wasn't used\n",
+            sc->name, s->name, bytes * per_frame);
+    wrong = 1;
+  }
+  if (problem_count() != problems) {
+    fprintf(stderr, "%s on %s: %d problems in the command stream\n", sc->name, s->name,
+            problem_count() - problems);
+    for (int i = 0; i < columns * rows; i++)
+      emulator_print_summary(emulators[i], DISPLAY_SPI_FREQUENCY);
+    wrong = 1;
+  }
+  return wrong;
+}
+
+// over every panel
+static int problem_count(void) {
+  int count = 0;
+  for (int i = 0; i < columns * rows; i++)
+    count += emulators[i]->error_count;
+  return count;
+}
+
+static void emulate(void *ctx, const uint8_t *buff, unsigned int size,
+                    enum transport_level level) {
+  uint64_t start = cpu_ns(CLOCK_THREAD_CPUTIME_ID);
+  emulator_feed(ctx, buff, size, level);
+  atomic_fetch_add(&emulated_ns, cpu_ns(CLOCK_THREAD_CPUTIME_ID) - start);
+}
+
+// whether the panels showed the canvas when the mirror stopped, returns 1
+// and says where if they didn't
+static int check_shown(const scenario *sc, source *s, canvas *c) {
+  int pointer_x = -width, pointer_y = -height;
+  if (s->options.source == MIRROR_SOURCE_X) {
+    Window root, child;
+    int window_x, window_y;
+    unsigned int mask;
+    XQueryPointer(s->display, DefaultRootWindow(s->display), &root, &child, &pointer_x,
+                  &pointer_y, &window_x, &window_y, &mask);
+  }
+  long wrong = 0;
+  int first_x = 0, first_y = 0;
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++) {
+      if (abs(x - pointer_x) < POINTER_SKIP && abs(y - pointer_y) < POINTER_SKIP)
+        continue;
+      // the mirror addresses each panel sideways with rows flipped,
+      // so x runs up the panel's portrait rows
+      int panel = y / DISPLAY_VERTICAL * columns + x / DISPLAY_HORIZONTAL;
+      uint8_t rgb[3];
+      emulator_shown_pixel(emulators[panel], y % DISPLAY_VERTICAL,
+                           EMULATOR_ROWS - 1 - x % DISPLAY_HORIZONTAL, rgb);
+      uint16_t shown = (rgb[0] >> 3) << 11 | (rgb[1] >> 2) << 5 | rgb[2] >> 3;
+      if (shown != c->pixels[y * width + x] && wrong++ == 0) {
+        first_x = x;
+        first_y = y;
+      }
+    }
+  if (wrong == 0)
+    return 0;
+  fprintf(stderr, "%s on %s: the panel shows %ld pixels wrong, from %d, %d\n", sc->name,
+          s->name, wrong, first_x, first_y);
+  return 1;
+}
+
+// path is a mkstemp template, replaced with the file's name
+static int open_framebuffer_file(source *s, char *path) {
+  int fd = mkstemp(path);
+  if (fd == -1) {
+    fprintf(stderr, "failed to create framebuffer file %s\n", strerror(errno));
+    return -1;
+  }
+  size_t size = width * height * 2;
+  if (ftruncate(fd, size) == -1) {
+    fprintf(stderr, "failed to size framebuffer file %s\n", strerror(errno));
+    close(fd);
+    unlink(path);
+    return -1;
+  }
+  s->pixels = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (s->pixels == MAP_FAILED) {
+    fprintf(stderr, "failed to map framebuffer file %s\n", strerror(errno));
+    unlink(path);
+    return -1;
+  }
+  s->name = "framebuffer";
+  s->present = NULL;
+  s->attach = NULL;
+  s->finish = NULL;
+  s->options = bench_options();
+  s->options.framebuffer_path = path;
+  s->options.source = MIRROR_SOURCE_FRAMEBUFFER;
+  return 0;
+}
+
+// start Xvfb on a free display, named in name.
+// returns its pid, or -1 if it couldn't be started
+static pid_t start_xvfb(char *name, size_t size) {
+  int fds[2];
+  if (pipe(fds) == -1)
+    return -1;
+  pid_t pid = fork();
+  if (pid == -1) {
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    char fd[16], screen[32];
+    snprintf(fd, sizeof(fd), "%d", fds[1]);
+    snprintf(screen, sizeof(screen), "%dx%dx16", width, height);
+    // keep its messages out of the results
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    execlp("Xvfb", "Xvfb", "-displayfd", fd, "-screen", "0", screen,
+           "-nolisten", "tcp", (char *)NULL);
+    _exit(127);
+  }
+  close(fds[1]);
+  // Xvfb writes the display number once it is ready
+  char number[16];
+  size_t got = 0;
+  ssize_t rd;
+  while (got < sizeof(number) - 1
+         && (rd = read(fds[0], &number[got], sizeof(number) - 1 - got)) > 0) {
+    got += rd;
+    if (number[got - 1] == '\n')
+      break;
+  }
+  close(fds[0]);
+  if (got == 0 || number[got - 1] != '\n') {
+    waitpid(pid, NULL, 0);
+    return -1;
+  }
+  number[got - 1] = '\0';
+  snprintf(name, size, ":%s", number);
+  return pid;
+}
+
+static int open_x(source *s, const char *name, const char *framebuffer_path) {
+  s->display = XOpenDisplay(name);
+  if (s->display == NULL) {
+    fprintf(stderr, "failed to open Xvfb display %s\n", name);
+    return -1;
+  }
+  s->pixels = calloc(width * height, 2);
+  if (s->pixels == NULL) {
+    XCloseDisplay(s->display);
+    return -1;
+  }
+  Visual *visual = DefaultVisual(s->display, DefaultScreen(s->display));
+  s->image = XCreateImage(s->display, visual, 16, ZPixmap, 0, (char *)s->pixels,
+                          width, height, 16, width * 2);
+  if (s->image == NULL) {
+    free(s->pixels);
+    XCloseDisplay(s->display);
+    return -1;
+  }
+  s->gc = XCreateGC(s->display, DefaultRootWindow(s->display), 0, NULL);
+  s->name = "x";
+  s->present = present_x;
+  s->attach = NULL;
+  s->finish = NULL;
+  s->options = bench_options();
+  // only opened as the mirror always needs a framebuffer
+  s->options.framebuffer_path = framebuffer_path;
+  s->options.x_display = name;
+  s->options.source = MIRROR_SOURCE_X;
+  return 0;
+}
+
+static void present_x(source *s, canvas *c) {
+  for (int i = 0; i < c->rect_count; i++) {
+    damage_rect r = c->rects[i];
+    XPutImage(s->display, DefaultRootWindow(s->display), s->gc, s->image,
+              r.x, r.y, r.x, r.y, r.w, r.h);
+  }
+  XFlush(s->display);
+}
+
+static int open_client(source *s, const char *socket_path) {
+  s->pixels = calloc(width * height, 2);
+  if (s->pixels == NULL)
+    return -1;
+  s->client.fd = -1;
+  s->name = "client";
+  s->present = present_client;
+  s->attach = attach_client;
+  s->finish = finish_client;
+  s->options = bench_options();
+  s->options.client_socket = socket_path;
+  s->options.source = MIRROR_SOURCE_CLIENTS;
+  return 0;
+}
+
+// each run starts a new mirror, connected to once it is listening
+static void attach_client(source *s, canvas *c) {
+  display_client *client = &s->client;
+  for (int tries = 0; access(s->options.client_socket, F_OK) == -1
+         || display_client_connect(client, s->options.client_socket, 0, 0, 0, 0, 0) == -1;
+       tries++) {
+    if (tries == CONNECT_TRIES) {
+      fprintf(stderr, "mirror isn't serving clients at %s\n", s->options.client_socket);
+      exit(-1);
+    }
+    usleep(CONNECT_RETRY_US);
+  }
+  memcpy(client->pixels, s->pixels, client->size);
+  display_client_damage(client, 0, 0, width, height);
+  display_client_wait(client);
+}
+
+static void present_client(source *s, canvas *c) {
+  display_client *client = &s->client;
+  // drawn before the mirror is started, attach sends it all
+  if (client->fd == -1)
+    return;
+  for (int i = 0; i < c->rect_count; i++) {
+    damage_rect r = c->rects[i];
+    for (int y = r.y; y < r.y + r.h; y++)
+      memcpy(&client->pixels[y * client->stride + r.x * 2], &s->pixels[y * width + r.x],
+             r.w * 2);
+    display_client_damage(client, r.x, r.y, r.w, r.h);
+  }
+  display_client_wait(client);
+}
+
+static void finish_client(source *s) {
+  if (s->client.fd == -1)
+    return;
+  display_client_close(&s->client);
+  s->client.fd = -1;
+}
+
+static uint64_t cpu_ns(clockid_t clock) {
+  struct timespec t;
+  clock_gettime(clock, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
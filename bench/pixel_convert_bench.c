@@ -0,0 +1,67 @@
+#include "../src/pixel_convert.h"
+#include "../src/pixel_kernel.h"
+#include "../src/display.h"
+#include "../src/time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/// Reports how long each conversion kernel the cpu supports takes
+/// to convert a whole display sized frame, in milliseconds.
+/// Pairs of formats a kernel leaves to plain C are shown as -, as they
+/// time the same as the scalar row.
+
+#define ITERATIONS 500
+
+static uint8_t source[DISPLAY_PIXEL_COUNT * 4];
+static uint8_t converted[DISPLAY_PIXEL_COUNT * 3];
+
+struct target {
+  const char *name;
+  enum display_colour_format format;
+  int little_endian;
+};
+
+const struct target targets[] = {
+  {"12_bit", COLOUR_FORMAT_12_BIT, 0},
+  {"16_bit_le", COLOUR_FORMAT_16_BIT, 1},
+  {"16_bit_be", COLOUR_FORMAT_16_BIT, 0},
+  {"18_bit", COLOUR_FORMAT_18_BIT, 0},
+};
+#define TARGET_COUNT (sizeof(targets) / sizeof(targets[0]))
+
+double run(enum pixel_format format, const struct target *target) {
+  int src_stride = DISPLAY_HORIZONTAL * pixel_format_bytes(format);
+  int dst_stride = pixel_panel_row_bytes(target->format, DISPLAY_HORIZONTAL);
+  time_point start = get_time();
+  for (int i = 0; i < ITERATIONS; i++)
+    pixel_convert(converted, dst_stride, target->format, target->little_endian,
+                  source, src_stride, format, DISPLAY_HORIZONTAL, DISPLAY_VERTICAL);
+  return real_time_s(start, get_time()) / ITERATIONS * 1e3;
+}
+
+int main() {
+  for (unsigned int i = 0; i < sizeof(source); i++)
+    source[i] = rand();
+  printf("kernel,source");
+  for (unsigned int t = 0; t < TARGET_COUNT; t++)
+    printf(",%s_ms", targets[t].name);
+  printf("\n");
+  for (int k = 0; k < PIXEL_KERNEL_COUNT; k++) {
+    if (!pixel_kernel_supported(k))
+      continue;
+    pixel_kernel_select(k);
+    for (int f = 0; f < PIXEL_FORMAT_COUNT; f++) {
+      printf("%s,%s", pixel_kernel_name(k), pixel_format_name(f));
+      for (unsigned int t = 0; t < TARGET_COUNT; t++) {
+        if (k != PIXEL_KERNEL_SCALAR
+            && !pixel_convert_vectorised(targets[t].format, targets[t].little_endian, f))
+          printf(",-");
+        else
+          printf(",%.3f", run(f, &targets[t]));
+      }
+      printf("\n");
+    }
+  }
+  return 0;
+}
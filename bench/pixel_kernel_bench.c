@@ -0,0 +1,81 @@
+#include "../src/pixel_kernel.h"
+#include "../src/display.h"
+#include "../src/time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Reports the throughput of each diff kernel the cpu supports
+/// for frames the size of the display, in GB/s of source frame compared.
+
+#define COLOUR_BYTES 2
+#define TILE_SIZE 16
+#define FRAME_BYTES (DISPLAY_PIXEL_COUNT * COLOUR_BYTES)
+#define ITERATIONS 2000
+
+enum workload {
+  UNCHANGED,
+  SPARSE,
+  ALL_CHANGED,
+  WORKLOAD_COUNT,
+};
+
+const char *workload_names[] = {"unchanged", "sparse", "all_changed"};
+
+static uint8_t frames[2][FRAME_BYTES];
+static uint8_t last_sent[FRAME_BYTES];
+static uint8_t tiles[(DISPLAY_HORIZONTAL / TILE_SIZE + 1) * (DISPLAY_VERTICAL / TILE_SIZE + 1)];
+
+void fill_frames(enum workload workload) {
+  for (int i = 0; i < FRAME_BYTES; i++)
+    frames[0][i] = rand();
+  memcpy(frames[1], frames[0], FRAME_BYTES);
+  if (workload == ALL_CHANGED)
+    for (int i = 0; i < FRAME_BYTES; i++)
+      frames[1][i] = ~frames[0][i];
+  if (workload == SPARSE)
+    // a clock sized change in one corner
+    for (int y = 0; y < 16; y++)
+      for (int x = 0; x < 64 * COLOUR_BYTES; x++)
+        frames[1][y * DISPLAY_HORIZONTAL * COLOUR_BYTES + x] ^= 0xFF;
+  memcpy(last_sent, frames[0], FRAME_BYTES);
+}
+
+double run(enum workload workload) {
+  fill_frames(workload);
+  time_point start = get_time();
+  for (int i = 0; i < ITERATIONS; i++)
+    pixel_diff_copy(last_sent, frames[i % 2 == 0 ? 1 : 0],
+                    DISPLAY_HORIZONTAL, DISPLAY_VERTICAL, COLOUR_BYTES,
+                    DISPLAY_HORIZONTAL * COLOUR_BYTES, TILE_SIZE, tiles, NULL);
+  double elapsed = real_time_s(start, get_time());
+  return (double)FRAME_BYTES * ITERATIONS / elapsed / 1e9;
+}
+
+double run_memcpy() {
+  fill_frames(ALL_CHANGED);
+  time_point start = get_time();
+  for (int i = 0; i < ITERATIONS; i++)
+    memcpy(last_sent, frames[i % 2], FRAME_BYTES);
+  double elapsed = real_time_s(start, get_time());
+  return (double)FRAME_BYTES * ITERATIONS / elapsed / 1e9;
+}
+
+int main() {
+  printf("kernel");
+  for (int w = 0; w < WORKLOAD_COUNT; w++)
+    printf(",%s_gb_s", workload_names[w]);
+  printf("\n");
+  printf("memcpy_only,%.2f,%.2f,%.2f\n", run_memcpy(), run_memcpy(), run_memcpy());
+  for (int k = 0; k < PIXEL_KERNEL_COUNT; k++) {
+    if (!pixel_kernel_supported(k))
+      continue;
+    pixel_kernel_select(k);
+    printf("%s", pixel_kernel_name(k));
+    for (int w = 0; w < WORKLOAD_COUNT; w++)
+      printf(",%.2f", run(w));
+    printf("\n");
+  }
+  return 0;
+}
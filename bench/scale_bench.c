@@ -0,0 +1,70 @@
+#include "../src/scale.h"
+#include "../src/pixel_kernel.h"
+#include "../src/display.h"
+#include "../src/time.h"
+#include "../src/work_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/// Reports how long scaling a whole xrgb8888 source down to the display
+/// takes for each kernel the cpu supports, filter and thread count,
+/// in milliseconds.
+
+#define ITERATIONS 50
+
+struct source_size {
+  int width;
+  int height;
+};
+
+// 2:1, a common monitor and the largest common one
+const struct source_size sizes[] = {
+  {DISPLAY_HORIZONTAL * 2, DISPLAY_VERTICAL * 2},
+  {1920, 1080},
+  {3840, 2160},
+};
+#define SIZE_COUNT (sizeof(sizes) / sizeof(sizes[0]))
+
+static uint8_t converted[DISPLAY_PIXEL_COUNT * 2];
+
+double run(scaler *scaler, const uint8_t *source) {
+  time_point start = get_time();
+  for (int i = 0; i < ITERATIONS; i++)
+    scaler_scale(scaler, converted, DISPLAY_HORIZONTAL * 2, source,
+                 scaler->src_width * 4, scaler->picture);
+  return real_time_s(start, get_time()) / ITERATIONS * 1e3;
+}
+
+int main() {
+  printf("kernel,source,filter,threads,ms\n");
+  for (unsigned int s = 0; s < SIZE_COUNT; s++) {
+    int width = sizes[s].width, height = sizes[s].height;
+    uint8_t *source = malloc((size_t)width * height * 4);
+    if (source == NULL)
+      return -1;
+    for (long i = 0; i < (long)width * height * 4; i++)
+      source[i] = rand();
+    for (int k = 0; k < PIXEL_KERNEL_COUNT; k++) {
+      if (!pixel_kernel_supported(k))
+        continue;
+      pixel_kernel_select(k);
+      for (int f = SCALE_FILTER_BOX; f <= SCALE_FILTER_BILINEAR; f++)
+        for (int threads = 1; threads <= 4; threads *= 2) {
+          work_pool pool;
+          scaler scaler;
+          if (work_pool_init(&pool, threads) == -1)
+            return -1;
+          if (scaler_init(&scaler, width, height, PIXEL_FORMAT_XRGB8888,
+                          DISPLAY_HORIZONTAL, DISPLAY_VERTICAL, f, &pool) == -1)
+            return -1;
+          printf("%s,%dx%d,%s,%d,%.3f\n", pixel_kernel_name(k), width, height,
+                 scale_filter_name(f), threads, run(&scaler, source));
+          scaler_free(&scaler);
+          work_pool_free(&pool);
+        }
+    }
+    free(source);
+  }
+  return 0;
+}
@@ -0,0 +1,338 @@
+#define _GNU_SOURCE
+#include "client_capture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "display_client.h"
+
+#define PIXEL_BYTES 2
+
+static void accept_clients(client_capture *capture);
+static void read_client(client_capture *capture, client_t *client, damage_rect *rects,
+                        int *count, int max_rects);
+static int welcome_client(client_capture *capture, client_t *client,
+                          const client_message *hello);
+static int send_buffer(int fd, const client_message *welcome, int buffer_fd);
+static void drop_client(client_capture *capture, client_t *client, damage_rect *rects,
+                        int *count, int max_rects);
+static void restack(client_capture *capture);
+static void compose(client_capture *capture, damage_rect r);
+static void add_changed(damage_rect *rects, int *count, int max_rects, damage_rect r);
+static damage_rect intersect(damage_rect a, damage_rect b);
+
+
+/// ---- Api Implementation ----
+
+
+int client_capture_open(client_capture *capture, const char *socket_path,
+                        int width, int height) {
+  memset(&capture->address, 0, sizeof(capture->address));
+  capture->address.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(capture->address.sun_path)) {
+    fprintf(stderr, "client socket path %s is too long\n", socket_path);
+    return -1;
+  }
+  strcpy(capture->address.sun_path, socket_path);
+  capture->width = width;
+  capture->height = height;
+  capture->stack_count = 0;
+  capture->connections = 0;
+  for (int i = 0; i < CLIENT_MAX_CLIENTS; i++)
+    capture->clients[i].fd = -1;
+  capture->picture = calloc((size_t)width * height, PIXEL_BYTES);
+  if (capture->picture == NULL) {
+    fprintf(stderr, "Failed to allocate %d x %d client picture\n", width, height);
+    return -1;
+  }
+  capture->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (capture->listen_fd == -1) {
+    fprintf(stderr, "Failed to create client socket, %s\n", strerror(errno));
+    free(capture->picture);
+    return -1;
+  }
+  // left behind by a display that didn't exit cleanly
+  unlink(socket_path);
+  if (bind(capture->listen_fd, (struct sockaddr *)&capture->address,
+           sizeof(capture->address)) == -1
+      || listen(capture->listen_fd, CLIENT_MAX_CLIENTS) == -1) {
+    fprintf(stderr, "Failed to listen for clients at %s, %s\n", socket_path,
+            strerror(errno));
+    close(capture->listen_fd);
+    free(capture->picture);
+    return -1;
+  }
+  return 0;
+}
+
+void client_capture_close(client_capture *capture) {
+  for (int i = 0; i < CLIENT_MAX_CLIENTS; i++) {
+    client_t *client = &capture->clients[i];
+    if (client->fd == -1)
+      continue;
+    if (client->area.w > 0)
+      munmap((void *)client->pixels, client->size);
+    close(client->fd);
+  }
+  close(capture->listen_fd);
+  unlink(capture->address.sun_path);
+  free(capture->picture);
+}
+
+int client_capture_update(client_capture *capture, int timeout_ms,
+                          damage_rect *rects, int max_rects) {
+  struct pollfd fds[CLIENT_MAX_CLIENTS + 1];
+  client_t *polled[CLIENT_MAX_CLIENTS + 1];
+  int fd_count = 0;
+  fds[fd_count++] = (struct pollfd){capture->listen_fd, POLLIN, 0};
+  for (int i = 0; i < CLIENT_MAX_CLIENTS; i++) {
+    if (capture->clients[i].fd == -1)
+      continue;
+    polled[fd_count] = &capture->clients[i];
+    fds[fd_count++] = (struct pollfd){capture->clients[i].fd, POLLIN, 0};
+  }
+  if (poll(fds, fd_count, timeout_ms) <= 0)
+    return 0;
+  int count = 0;
+  // apps already connected first, as accepting can reuse their slots
+  for (int i = 1; i < fd_count; i++)
+    if (fds[i].revents != 0)
+      read_client(capture, polled[i], rects, &count, max_rects);
+  if (fds[0].revents & POLLIN)
+    accept_clients(capture);
+  if (count > max_rects) {
+    rects[0] = (damage_rect){0, 0, capture->width, capture->height};
+    return 1;
+  }
+  return count;
+}
+
+
+/// ---- Helper Definitions ----
+
+
+static void accept_clients(client_capture *capture) {
+  int fd;
+  while ((fd = accept4(capture->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+    client_t *client = NULL;
+    for (int i = 0; i < CLIENT_MAX_CLIENTS && client == NULL; i++)
+      if (capture->clients[i].fd == -1)
+        client = &capture->clients[i];
+    if (client == NULL) {
+      client_message refused = {CLIENT_REFUSED, DISPLAY_CLIENT_VERSION};
+      send(fd, &refused, sizeof(refused), MSG_DONTWAIT | MSG_NOSIGNAL);
+      close(fd);
+      continue;
+    }
+    client->fd = fd;
+    client->area = (damage_rect){0, 0, 0, 0};
+    client->order = capture->connections++;
+  }
+}
+
+// handle every message the app has sent
+static void read_client(client_capture *capture, client_t *client, damage_rect *rects,
+                        int *count, int max_rects) {
+  while (1) {
+    client_message message;
+    ssize_t got = recv(client->fd, &message, sizeof(message), MSG_DONTWAIT);
+    if (got == -1 && errno == EINTR)
+      continue;
+    if (got == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    // 0 once the app has closed the connection
+    if (got != sizeof(message)) {
+      drop_client(capture, client, rects, count, max_rects);
+      return;
+    }
+    if (message.kind == CLIENT_HELLO && client->area.w == 0) {
+      if (welcome_client(capture, client, &message) == -1) {
+        drop_client(capture, client, rects, count, max_rects);
+        return;
+      }
+      add_changed(rects, count, max_rects, client->area);
+      continue;
+    }
+    if (message.kind != CLIENT_DAMAGE || client->area.w == 0) {
+      fprintf(stderr, "client sent an unexpected message, disconnecting it\n");
+      drop_client(capture, client, rects, count, max_rects);
+      return;
+    }
+    // clipped to the buffer, in the picture's coordinates
+    damage_rect area = client->area;
+    // 64 bit so apps can't overflow the sums where long is 32
+    int64_t x0 = message.x < 0 ? 0 : message.x;
+    int64_t y0 = message.y < 0 ? 0 : message.y;
+    int64_t x1 = (int64_t)message.x + message.w;
+    int64_t y1 = (int64_t)message.y + message.h;
+    if (x1 > area.w)
+      x1 = area.w;
+    if (y1 > area.h)
+      y1 = area.h;
+    if (x1 > x0 && y1 > y0) {
+      damage_rect r = {area.x + x0, area.y + y0, x1 - x0, y1 - y0};
+      compose(capture, r);
+      add_changed(rects, count, max_rects, r);
+    }
+    // an app that doesn't read its answers stops being served
+    client_message done = {CLIENT_DONE, DISPLAY_CLIENT_VERSION};
+    if (send(client->fd, &done, sizeof(done), MSG_DONTWAIT | MSG_NOSIGNAL) != sizeof(done)) {
+      drop_client(capture, client, rects, count, max_rects);
+      return;
+    }
+  }
+}
+
+// give the app its buffer, returns -1 if it can't be served
+static int welcome_client(client_capture *capture, client_t *client,
+                          const client_message *hello) {
+  int whole = hello->w == 0 || hello->h == 0;
+  int w = whole ? capture->width : hello->w;
+  int h = whole ? capture->height : hello->h;
+  // compared by subtracting, as adding could overflow
+  if (hello->version != DISPLAY_CLIENT_VERSION || hello->x < 0 || hello->y < 0
+      || w < 0 || h < 0 || w > capture->width || hello->x > capture->width - w
+      || h > capture->height || hello->y > capture->height - h) {
+    client_message refused = {CLIENT_REFUSED, DISPLAY_CLIENT_VERSION};
+    send(client->fd, &refused, sizeof(refused), MSG_DONTWAIT | MSG_NOSIGNAL);
+    return -1;
+  }
+  damage_rect area = {hello->x, hello->y, w, h};
+  size_t size = (size_t)area.w * area.h * PIXEL_BYTES;
+  int fd = memfd_create("display client", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd == -1) {
+    fprintf(stderr, "Failed to create client buffer, %s\n", strerror(errno));
+    return -1;
+  }
+  if (ftruncate(fd, size) == -1
+      || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) {
+    fprintf(stderr, "Failed to size client buffer, %s\n", strerror(errno));
+    close(fd);
+    return -1;
+  }
+  const uint8_t *pixels = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (pixels == MAP_FAILED) {
+    fprintf(stderr, "Failed to map client buffer, %s\n", strerror(errno));
+    close(fd);
+    return -1;
+  }
+  client_message welcome = {CLIENT_WELCOME, DISPLAY_CLIENT_VERSION, 0, 0, area.w, area.h,
+                            0, area.w * PIXEL_BYTES};
+  int failed = send_buffer(client->fd, &welcome, fd);
+  close(fd);
+  if (failed) {
+    munmap((void *)pixels, size);
+    return -1;
+  }
+  client->area = area;
+  client->z = hello->z;
+  client->pixels = pixels;
+  client->size = size;
+  restack(capture);
+  // the new buffer is black
+  compose(capture, area);
+  return 0;
+}
+
+static int send_buffer(int fd, const client_message *welcome, int buffer_fd) {
+  union {
+    struct cmsghdr header;
+    char space[CMSG_SPACE(sizeof(int))];
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct iovec data = {(void *)welcome, sizeof(*welcome)};
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  message.msg_control = control.space;
+  message.msg_controllen = sizeof(control.space);
+  struct cmsghdr *attached = CMSG_FIRSTHDR(&message);
+  attached->cmsg_level = SOL_SOCKET;
+  attached->cmsg_type = SCM_RIGHTS;
+  attached->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(attached), &buffer_fd, sizeof(int));
+  if (sendmsg(fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL) != sizeof(*welcome)) {
+    fprintf(stderr, "Failed to send client its buffer, %s\n", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+// disconnect the app, uncovering whatever is under its area
+static void drop_client(client_capture *capture, client_t *client, damage_rect *rects,
+                        int *count, int max_rects) {
+  close(client->fd);
+  client->fd = -1;
+  if (client->area.w == 0)
+    return;
+  munmap((void *)client->pixels, client->size);
+  damage_rect area = client->area;
+  client->area = (damage_rect){0, 0, 0, 0};
+  restack(capture);
+  compose(capture, area);
+  add_changed(rects, count, max_rects, area);
+}
+
+// order the apps being drawn by z, then age
+static void restack(client_capture *capture) {
+  capture->stack_count = 0;
+  for (int i = 0; i < CLIENT_MAX_CLIENTS; i++) {
+    client_t *client = &capture->clients[i];
+    if (client->fd == -1 || client->area.w == 0)
+      continue;
+    int j = capture->stack_count++;
+    for (; j > 0; j--) {
+      client_t *below = &capture->clients[capture->stack[j - 1]];
+      if (below->z < client->z || (below->z == client->z && below->order < client->order))
+        break;
+      capture->stack[j] = capture->stack[j - 1];
+    }
+    capture->stack[j] = i;
+  }
+}
+
+// redraw r of the picture from every app over it, lowest first
+static void compose(client_capture *capture, damage_rect r) {
+  int row_bytes = capture->width * PIXEL_BYTES;
+  for (int y = r.y; y < r.y + r.h; y++)
+    memset(&capture->picture[y * row_bytes + r.x * PIXEL_BYTES], 0, r.w * PIXEL_BYTES);
+  for (int i = 0; i < capture->stack_count; i++) {
+    client_t *client = &capture->clients[capture->stack[i]];
+    damage_rect part = intersect(client->area, r);
+    if (part.w == 0 || part.h == 0)
+      continue;
+    int stride = client->area.w * PIXEL_BYTES;
+    for (int y = part.y; y < part.y + part.h; y++)
+      memcpy(&capture->picture[y * row_bytes + part.x * PIXEL_BYTES],
+             &client->pixels[(y - client->area.y) * stride
+                             + (part.x - client->area.x) * PIXEL_BYTES],
+             part.w * PIXEL_BYTES);
+  }
+}
+
+// count goes past max_rects once there are too many to list
+static void add_changed(damage_rect *rects, int *count, int max_rects, damage_rect r) {
+  if (*count < max_rects)
+    rects[*count] = r;
+  if (*count <= max_rects)
+    (*count)++;
+}
+
+static damage_rect intersect(damage_rect a, damage_rect b) {
+  int x0 = a.x > b.x ? a.x : b.x;
+  int y0 = a.y > b.y ? a.y : b.y;
+  int x1 = a.x + a.w < b.x + b.w ? a.x + a.w : b.x + b.w;
+  int y1 = a.y + a.h < b.y + b.h ? a.y + a.h : b.y + b.h;
+  if (x1 <= x0 || y1 <= y0)
+    return (damage_rect){0, 0, 0, 0};
+  return (damage_rect){x0, y0, x1 - x0, y1 - y0};
+}
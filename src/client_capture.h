@@ -0,0 +1,61 @@
+#ifndef DISPLAY_CLIENT_CAPTURE_H
+#define DISPLAY_CLIENT_CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/un.h>
+
+#include "damage.h"
+
+/// Composes a picture from local apps drawing into shared memory, see
+/// display_client.h for their side. Apps connect to a unix socket and are
+/// each given a memfd buffer the size of the area they asked for. Rects
+/// they report drawn are recomposed from every app over them, in z order,
+/// and only those rects are reported changed. Buffers are sealed so an app
+/// can't shrink them from under the display.
+
+#define CLIENT_MAX_CLIENTS 8
+
+typedef struct client_t {
+  // -1 when unused
+  int fd;
+  // 0 x 0 until it has said hello
+  damage_rect area;
+  int z;
+  // connections made before it, to put newer apps over older ones
+  unsigned int order;
+  // the app's buffer, area sized
+  const uint8_t *pixels;
+  size_t size;
+} client_t;
+
+typedef struct client_capture {
+  int listen_fd;
+  struct sockaddr_un address;
+  int width;
+  int height;
+  // the composed picture, packed little endian RGB565
+  uint8_t *picture;
+  client_t clients[CLIENT_MAX_CLIENTS];
+  // clients that have said hello, lowest first
+  int stack[CLIENT_MAX_CLIENTS];
+  int stack_count;
+  unsigned int connections;
+} client_capture;
+
+// listen on socket_path for apps drawing a width x height picture,
+// replacing any socket left there. returns -1 on error
+int client_capture_open(client_capture *capture, const char *socket_path,
+                        int width, int height);
+
+// disconnects every app and removes the socket
+void client_capture_close(client_capture *capture);
+
+// wait up to timeout_ms for apps to draw, connect or go away, and compose
+// what they changed into capture->picture. returns the number of rects
+// written to rects, collapsing them into the whole picture if there are
+// more than max_rects. 0 if nothing changed
+int client_capture_update(client_capture *capture, int timeout_ms,
+                          damage_rect *rects, int max_rects);
+
+#endif
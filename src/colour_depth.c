@@ -0,0 +1,48 @@
+#include "colour_depth.h"
+
+
+/// ---- Api Implementation ----
+
+
+colour_depth_policy colour_depth_default_policy() {
+  colour_depth_policy policy;
+  policy.motion_percent = 40;
+  policy.motion_frames = 3;
+  policy.motion_gap_ms = 100;
+  policy.settle_ms = 500;
+  return policy;
+}
+
+void colour_depth_init(colour_depth *depth, colour_depth_policy policy) {
+  depth->policy = policy;
+  depth->format = COLOUR_FORMAT_16_BIT;
+  depth->heavy_frames = 0;
+  depth->last_heavy_ns = 0;
+}
+
+int colour_depth_update(colour_depth *depth, uint64_t now_ns, long changed_pixels,
+                        long total_pixels) {
+  if (changed_pixels * 100 >= total_pixels * depth->policy.motion_percent) {
+    // ie a window switched now and then, rather than video or scrolling
+    if (depth->heavy_frames > 0
+        && now_ns - depth->last_heavy_ns > (uint64_t)depth->policy.motion_gap_ms * 1000000)
+      depth->heavy_frames = 0;
+    depth->heavy_frames++;
+    depth->last_heavy_ns = now_ns;
+    if (depth->format != COLOUR_FORMAT_12_BIT
+        && depth->heavy_frames >= depth->policy.motion_frames) {
+      depth->format = COLOUR_FORMAT_12_BIT;
+      return 1;
+    }
+    return 0;
+  }
+  if (changed_pixels > 0)
+    depth->heavy_frames = 0;
+  if (depth->format == COLOUR_FORMAT_12_BIT
+      && now_ns - depth->last_heavy_ns >= (uint64_t)depth->policy.settle_ms * 1000000) {
+    depth->format = COLOUR_FORMAT_16_BIT;
+    depth->heavy_frames = 0;
+    return 1;
+  }
+  return 0;
+}
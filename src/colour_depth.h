@@ -0,0 +1,44 @@
+#ifndef DISPLAY_COLOUR_DEPTH_H
+#define DISPLAY_COLOUR_DEPTH_H
+
+#include <stdint.h>
+
+#include "display.h"
+
+/// Picks the colour depth to send frames in.
+/// 12 bit moves a quarter fewer bytes than 16 bit, so during heavy motion
+/// (video, scrolling) the frame rate goes up at the cost of colour, which
+/// is hard to see while everything moves. Once the motion has stopped for
+/// a while it goes back to 16 bit.
+
+typedef struct colour_depth_policy {
+  // percent of the screen a frame must change to count as heavy motion
+  int motion_percent;
+  // heavy frames in a row before switching to 12 bit
+  int motion_frames;
+  // heavy frames further apart than this aren't in a row
+  unsigned int motion_gap_ms;
+  // time without heavy frames before switching back to 16 bit
+  unsigned int settle_ms;
+} colour_depth_policy;
+
+typedef struct colour_depth {
+  colour_depth_policy policy;
+  enum display_colour_format format;
+  int heavy_frames;
+  uint64_t last_heavy_ns;
+} colour_depth;
+
+// 40% of the screen for 3 frames at most 100ms apart, back after 500ms
+colour_depth_policy colour_depth_default_policy();
+
+// starts in 16 bit
+void colour_depth_init(colour_depth *depth, colour_depth_policy policy);
+
+// report a frame that changed changed_pixels of total_pixels, or 0 when
+// there was no frame so the switch back isn't held up by a still screen.
+// returns 1 if depth->format changed
+int colour_depth_update(colour_depth *depth, uint64_t now_ns, long changed_pixels,
+                        long total_pixels);
+
+#endif
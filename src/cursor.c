@@ -0,0 +1,167 @@
+#include "cursor.h"
+
+#include <string.h>
+
+// '#' outline, '.' fill
+static const char *arrow[] = {
+  "#           ",
+  "##          ",
+  "#.#         ",
+  "#..#        ",
+  "#...#       ",
+  "#....#      ",
+  "#.....#     ",
+  "#......#    ",
+  "#.......#   ",
+  "#........#  ",
+  "#.........# ",
+  "#......#####",
+  "#...#..#    ",
+  "#..##..#    ",
+  "#.#  #..#   ",
+  "##   #..#   ",
+  "#     #..#  ",
+  "      #..#  ",
+  "       ##   ",
+};
+#define ARROW_WIDTH 12
+#define ARROW_HEIGHT (int)(sizeof(arrow) / sizeof(arrow[0]))
+
+static int looks_different(const cursor_state *a, const cursor_state *b);
+static uint8_t blend_channel(uint8_t under, uint8_t over, uint8_t alpha);
+
+
+/// ---- Api Implementation ----
+
+
+void cursor_overlay_init(cursor_overlay *overlay) {
+  pthread_mutex_init(&overlay->mutex, NULL);
+  memset(&overlay->state, 0, sizeof(overlay->state));
+  cursor_arrow_image(&overlay->state.image);
+  // readers start from serial 0, so take the arrow on their first read
+  overlay->state.serial = 1;
+}
+
+void cursor_overlay_free(cursor_overlay *overlay) {
+  pthread_mutex_destroy(&overlay->mutex);
+}
+
+void cursor_overlay_move(cursor_overlay *overlay, int x, int y, int visible) {
+  pthread_mutex_lock(&overlay->mutex);
+  overlay->state.x = x;
+  overlay->state.y = y;
+  overlay->state.visible = visible;
+  pthread_mutex_unlock(&overlay->mutex);
+}
+
+void cursor_overlay_set_image(cursor_overlay *overlay, const cursor_image *image) {
+  pthread_mutex_lock(&overlay->mutex);
+  overlay->state.image = *image;
+  overlay->state.serial++;
+  pthread_mutex_unlock(&overlay->mutex);
+}
+
+int cursor_overlay_read(cursor_overlay *overlay, cursor_state *state) {
+  pthread_mutex_lock(&overlay->mutex);
+  int changed = looks_different(state, &overlay->state);
+  if (overlay->state.serial != state->serial) {
+    state->image = overlay->state.image;
+    state->serial = overlay->state.serial;
+  }
+  state->x = overlay->state.x;
+  state->y = overlay->state.y;
+  state->visible = overlay->state.visible;
+  pthread_mutex_unlock(&overlay->mutex);
+  return changed;
+}
+
+void cursor_arrow_image(cursor_image *image) {
+  memset(image, 0, sizeof(*image));
+  image->width = ARROW_WIDTH;
+  image->height = ARROW_HEIGHT;
+  for (int y = 0; y < ARROW_HEIGHT; y++)
+    for (int x = 0; x < ARROW_WIDTH; x++) {
+      uint32_t *pixel = &image->pixels[y * CURSOR_MAX_SIZE + x];
+      if (arrow[y][x] == '#')
+        *pixel = 0xFF000000;
+      else if (arrow[y][x] == '.')
+        *pixel = 0xFFFFFFFF;
+    }
+}
+
+damage_rect cursor_rect(const cursor_state *state, int width, int height) {
+  if (!state->visible)
+    return (damage_rect){0, 0, 0, 0};
+  int x0 = state->x - state->image.hot_x;
+  int y0 = state->y - state->image.hot_y;
+  int x1 = x0 + state->image.width;
+  int y1 = y0 + state->image.height;
+  if (x0 < 0)
+    x0 = 0;
+  if (y0 < 0)
+    y0 = 0;
+  if (x1 > width)
+    x1 = width;
+  if (y1 > height)
+    y1 = height;
+  if (x1 <= x0 || y1 <= y0)
+    return (damage_rect){0, 0, 0, 0};
+  return (damage_rect){x0, y0, x1 - x0, y1 - y0};
+}
+
+int cursor_overlaps(const cursor_state *state, damage_rect area) {
+  damage_rect r = cursor_rect(state, area.x + area.w, area.y + area.h);
+  return r.w > 0 && r.x + r.w > area.x && r.y + r.h > area.y;
+}
+
+void cursor_blend(const cursor_state *state, uint8_t *pixels, int stride, damage_rect area) {
+  if (!cursor_overlaps(state, area))
+    return;
+  const cursor_image *image = &state->image;
+  int left = state->x - image->hot_x;
+  int top = state->y - image->hot_y;
+  int x0 = left > area.x ? left : area.x;
+  int y0 = top > area.y ? top : area.y;
+  int x1 = left + image->width < area.x + area.w ? left + image->width : area.x + area.w;
+  int y1 = top + image->height < area.y + area.h ? top + image->height : area.y + area.h;
+  for (int y = y0; y < y1; y++) {
+    const uint32_t *over = &image->pixels[(y - top) * CURSOR_MAX_SIZE + x0 - left];
+    uint8_t *under = &pixels[(y - area.y) * stride + (x0 - area.x) * 2];
+    for (int x = x0; x < x1; x++, over++, under += 2) {
+      uint8_t alpha = *over >> 24;
+      if (alpha == 0)
+        continue;
+      uint16_t pixel = under[0] | under[1] << 8;
+      // widen to 8 bits a channel, repeating the top bits into the bottom
+      uint8_t r = (pixel >> 11) << 3 | (pixel >> 13);
+      uint8_t g = ((pixel >> 5) & 0x3F) << 2 | ((pixel >> 9) & 0x3);
+      uint8_t b = (pixel & 0x1F) << 3 | ((pixel >> 2) & 0x7);
+      r = blend_channel(r, *over >> 16, alpha);
+      g = blend_channel(g, *over >> 8, alpha);
+      b = blend_channel(b, *over, alpha);
+      pixel = (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+      under[0] = pixel;
+      under[1] = pixel >> 8;
+    }
+  }
+}
+
+
+/// ---- Helper Definitions ----
+
+
+// whether b draws differently to a
+static int looks_different(const cursor_state *a, const cursor_state *b) {
+  if (a->visible != b->visible)
+    return 1;
+  if (!b->visible)
+    return 0;
+  return a->x != b->x || a->y != b->y || a->serial != b->serial;
+}
+
+// over is already multiplied by alpha
+static uint8_t blend_channel(uint8_t under, uint8_t over, uint8_t alpha) {
+  int blended = over + (under * (255 - alpha) + 127) / 255;
+  // only a malformed image, with colour above its alpha, goes over
+  return blended > 255 ? 255 : blended;
+}
@@ -0,0 +1,77 @@
+#ifndef DISPLAY_CURSOR_H
+#define DISPLAY_CURSOR_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "damage.h"
+
+/// The mouse cursor, kept out of captured frames and drawn over them as
+/// they are sent. Moving it then only resends the area it left and the
+/// area it moved to, with what was under it taken from the last sent
+/// frame, however slowly the rest of the screen is being captured.
+/// The capture thread writes the pointer into a cursor_overlay, the
+/// transmit thread copies it out under the lock.
+
+// larger cursor images are cut down to this many pixels square
+#define CURSOR_MAX_SIZE 64
+
+typedef struct cursor_image {
+  int width;
+  int height;
+  // the pixel that sits on the pointer position
+  int hot_x;
+  int hot_y;
+  // argb with the colour premultiplied by alpha, as X gives them,
+  // rows CURSOR_MAX_SIZE apart
+  uint32_t pixels[CURSOR_MAX_SIZE * CURSOR_MAX_SIZE];
+} cursor_image;
+
+typedef struct cursor_state {
+  // pointer position on screen
+  int x;
+  int y;
+  int visible;
+  cursor_image image;
+  // changes each time the image does
+  unsigned int serial;
+} cursor_state;
+
+typedef struct cursor_overlay {
+  pthread_mutex_t mutex;
+  cursor_state state;
+} cursor_overlay;
+
+// starts hidden, with a plain arrow image
+void cursor_overlay_init(cursor_overlay *overlay);
+
+void cursor_overlay_free(cursor_overlay *overlay);
+
+/// --- capture thread ---
+
+void cursor_overlay_move(cursor_overlay *overlay, int x, int y, int visible);
+
+void cursor_overlay_set_image(cursor_overlay *overlay, const cursor_image *image);
+
+/// --- transmit thread ---
+
+// copy the overlay into state, the image only if it changed since state
+// was last read. returns 1 if the cursor looks any different on screen
+int cursor_overlay_read(cursor_overlay *overlay, cursor_state *state);
+
+/// --- drawing ---
+
+// black outlined white arrow, for when the real image can't be read
+void cursor_arrow_image(cursor_image *image);
+
+// area the cursor covers on a width x height screen, empty when hidden
+damage_rect cursor_rect(const cursor_state *state, int width, int height);
+
+// whether the cursor covers any of area
+int cursor_overlaps(const cursor_state *state, damage_rect area);
+
+// blend the cursor over the part of it inside area. pixels holds area
+// in little endian rgb565, rows stride bytes apart
+void cursor_blend(const cursor_state *state, uint8_t *pixels, int stride, damage_rect area);
+
+#endif
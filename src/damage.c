@@ -0,0 +1,328 @@
+#include "damage.h"
+
+#include "pixel_kernel.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// beyond this many candidate rects, merge each tile row before pairing rects
+#define MAX_PAIRED_RECTS 64
+// fewest tile rows compared in a band
+#define BAND_TILE_ROWS 2
+
+// a whole frame being compared in bands
+struct diff_job {
+  damage_tracker *tracker;
+  const uint8_t *frame;
+  int stride;
+  int bands;
+  atomic_int changed;
+};
+
+static void diff_band(void *job_ptr, int band, int worker);
+static int build_rects(damage_tracker *tracker);
+static int find_tile_runs(damage_tracker *tracker, damage_rect *runs);
+static int collapse_rows(damage_rect *rects, int count);
+static int merge_rects(damage_rect *rects, int count, long tile_cost,
+                       long overhead, int max_rects);
+static long rect_area(damage_rect r);
+static damage_rect bounding_rect(damage_rect a, damage_rect b);
+
+
+/// ---- Api Implementation ----
+
+
+int damage_init(damage_tracker *tracker, int width, int height, int pixel_bytes) {
+  tracker->width = width;
+  tracker->height = height;
+  tracker->pixel_bytes = pixel_bytes;
+  tracker->tile_columns = (width + DAMAGE_TILE_SIZE - 1) / DAMAGE_TILE_SIZE;
+  tracker->tile_rows = (height + DAMAGE_TILE_SIZE - 1) / DAMAGE_TILE_SIZE;
+  tracker->rect_overhead = DAMAGE_RECT_OVERHEAD_BYTES;
+  tracker->pool = NULL;
+  tracker->rect_count = 0;
+  tracker->invalid = 1;
+  // choose the diff kernel up front rather than racing on first use
+  pixel_kernel_selected();
+  int tile_count = tracker->tile_columns * tracker->tile_rows;
+  tracker->frame = calloc((size_t)width * height, pixel_bytes);
+  tracker->tiles = calloc(tile_count, 1);
+  tracker->candidates = malloc(tile_count * sizeof(damage_rect));
+  if (tracker->frame == NULL || tracker->tiles == NULL
+      || tracker->candidates == NULL) {
+    fprintf(stderr, "Failed to allocate damage tracker for %d x %d frame\n",
+            width, height);
+    damage_free(tracker);
+    return -1;
+  }
+  return 0;
+}
+
+void damage_free(damage_tracker *tracker) {
+  free(tracker->frame);
+  free(tracker->tiles);
+  free(tracker->candidates);
+  tracker->frame = NULL;
+  tracker->tiles = NULL;
+  tracker->candidates = NULL;
+}
+
+void damage_invalidate(damage_tracker *tracker) {
+  tracker->invalid = 1;
+}
+
+void damage_redraw_all(damage_tracker *tracker) {
+  tracker->rects[0] = (damage_rect){0, 0, tracker->width, tracker->height};
+  tracker->rect_count = 1;
+}
+
+void damage_scroll(damage_tracker *tracker, int lines, int along_x) {
+  int row_bytes = tracker->width * tracker->pixel_bytes;
+  size_t frame_bytes = (size_t)row_bytes * tracker->height;
+  uint8_t *scrolled = malloc(frame_bytes);
+  if (scrolled == NULL) {
+    // without the moved copy the display contents are unknown
+    tracker->invalid = 1;
+    return;
+  }
+  int length = along_x ? tracker->width : tracker->height;
+  lines = (lines % length + length) % length;
+  if (along_x) {
+    int moved = lines * tracker->pixel_bytes;
+    for (int y = 0; y < tracker->height; y++) {
+      uint8_t *from = &tracker->frame[(size_t)y * row_bytes];
+      uint8_t *to = &scrolled[(size_t)y * row_bytes];
+      memcpy(to, &from[moved], row_bytes - moved);
+      memcpy(&to[row_bytes - moved], from, moved);
+    }
+  } else {
+    size_t moved = (size_t)lines * row_bytes;
+    memcpy(scrolled, &tracker->frame[moved], frame_bytes - moved);
+    memcpy(&scrolled[frame_bytes - moved], tracker->frame, moved);
+  }
+  free(tracker->frame);
+  tracker->frame = scrolled;
+}
+
+int damage_update(damage_tracker *tracker, const uint8_t *frame, int stride) {
+  int row_bytes = tracker->width * tracker->pixel_bytes;
+  if (tracker->invalid) {
+    for (int y = 0; y < tracker->height; y++)
+      memcpy(&tracker->frame[(size_t)y * row_bytes], &frame[(size_t)y * stride],
+             row_bytes);
+    memset(tracker->tiles, 1, tracker->tile_columns * tracker->tile_rows);
+    tracker->invalid = 0;
+    tracker->rects[0] = (damage_rect){0, 0, tracker->width, tracker->height};
+    tracker->rect_count = 1;
+    return 1;
+  }
+  tracker->rect_count = 0;
+  struct diff_job job = {tracker, frame, stride, 0, 0};
+  job.bands = work_pool_bands(tracker->pool, tracker->tile_rows, BAND_TILE_ROWS);
+  work_pool_run(tracker->pool, diff_band, &job, job.bands);
+  if (atomic_load(&job.changed) == 0)
+    return 0;
+  return build_rects(tracker);
+}
+
+int damage_update_region(damage_tracker *tracker, const uint8_t *frame, int stride,
+                         const damage_rect *hints, int hint_count) {
+  tracker->rect_count = 0;
+  if (tracker->invalid)
+    return 0;
+  memset(tracker->tiles, 0, tracker->tile_columns * tracker->tile_rows);
+  int row_bytes = tracker->width * tracker->pixel_bytes;
+  int segment_bytes = DAMAGE_TILE_SIZE * tracker->pixel_bytes;
+  int changed = 0;
+  for (int i = 0; i < hint_count; i++) {
+    damage_rect r = hints[i];
+    if (r.x >= tracker->width || r.y >= tracker->height || r.w == 0 || r.h == 0)
+      continue;
+    // the frame is stale outside the hint, so only its columns are read.
+    // the part of a tile it starts in is compared alone, so the rest of
+    // the segments line up with the tile grid
+    int tx0 = r.x / DAMAGE_TILE_SIZE;
+    int x1 = r.x + r.w > tracker->width ? tracker->width : r.x + r.w;
+    int y1 = r.y + r.h > tracker->height ? tracker->height : r.y + r.h;
+    int head = (tx0 + 1) * DAMAGE_TILE_SIZE - r.x;
+    if (head > x1 - r.x)
+      head = x1 - r.x;
+    int head_bytes = head * tracker->pixel_bytes;
+    int rest_bytes = (x1 - r.x - head) * tracker->pixel_bytes;
+    for (int y = r.y; y < y1; y++) {
+      size_t offset = (size_t)y * row_bytes + r.x * tracker->pixel_bytes;
+      const uint8_t *src = &frame[(size_t)y * stride + r.x * tracker->pixel_bytes];
+      uint8_t *tiles = &tracker->tiles[(y / DAMAGE_TILE_SIZE) * tracker->tile_columns + tx0];
+      changed += pixel_diff_copy_row(&tracker->frame[offset], src, head_bytes, head_bytes,
+                                     tiles);
+      if (rest_bytes > 0)
+        changed += pixel_diff_copy_row(&tracker->frame[offset + head_bytes], src + head_bytes,
+                                       rest_bytes, segment_bytes, tiles + 1);
+    }
+  }
+  if (changed == 0)
+    return 0;
+  return build_rects(tracker);
+}
+
+
+/// ---- Helper Definitions ----
+
+
+// compare one band of tile rows
+static void diff_band(void *job_ptr, int band, int worker) {
+  struct diff_job *job = job_ptr;
+  damage_tracker *tracker = job->tracker;
+  int ty0 = tracker->tile_rows * band / job->bands;
+  int ty1 = tracker->tile_rows * (band + 1) / job->bands;
+  int y0 = ty0 * DAMAGE_TILE_SIZE;
+  int y1 = ty1 * DAMAGE_TILE_SIZE < tracker->height ? ty1 * DAMAGE_TILE_SIZE
+                                                     : tracker->height;
+  int row_bytes = tracker->width * tracker->pixel_bytes;
+  int changed = pixel_diff_copy(&tracker->frame[(size_t)y0 * row_bytes],
+                                &job->frame[(size_t)y0 * job->stride], tracker->width,
+                                y1 - y0, tracker->pixel_bytes, job->stride,
+                                DAMAGE_TILE_SIZE,
+                                &tracker->tiles[ty0 * tracker->tile_columns], NULL);
+  atomic_fetch_add(&job->changed, changed);
+}
+
+// turn the changed tiles into at most DAMAGE_MAX_RECTS rects
+static int build_rects(damage_tracker *tracker) {
+  // work in tile units until the final rects are clipped to the frame
+  long tile_cost = (long)DAMAGE_TILE_SIZE * DAMAGE_TILE_SIZE * tracker->pixel_bytes;
+  damage_rect *rects = tracker->candidates;
+  int count = find_tile_runs(tracker, rects);
+  if (count > MAX_PAIRED_RECTS)
+    count = collapse_rows(rects, count);
+  count = merge_rects(rects, count, tile_cost, tracker->rect_overhead,
+                      DAMAGE_MAX_RECTS);
+
+  // if the rects cost more than a full redraw, just redraw everything
+  long cost = 0;
+  for (int i = 0; i < count; i++)
+    cost += rect_area(rects[i]) * tile_cost + tracker->rect_overhead;
+  long full_cost = (long)tracker->tile_columns * tracker->tile_rows * tile_cost
+    + tracker->rect_overhead;
+  if (cost >= full_cost) {
+    rects[0] = (damage_rect){0, 0, tracker->tile_columns, tracker->tile_rows};
+    count = 1;
+  }
+
+  for (int i = 0; i < count; i++) {
+    damage_rect r = rects[i];
+    int x = r.x * DAMAGE_TILE_SIZE;
+    int y = r.y * DAMAGE_TILE_SIZE;
+    int w = r.w * DAMAGE_TILE_SIZE;
+    int h = r.h * DAMAGE_TILE_SIZE;
+    if (x + w > tracker->width)
+      w = tracker->width - x;
+    if (y + h > tracker->height)
+      h = tracker->height - y;
+    tracker->rects[i] = (damage_rect){x, y, w, h};
+  }
+  tracker->rect_count = count;
+  return count;
+}
+
+
+// find horizontal runs of changed tiles in each tile row, bridging gaps
+// that are cheaper to send than a new rect. Runs spanning the same columns
+// as a run directly above are merged into it.
+static int find_tile_runs(damage_tracker *tracker, damage_rect *runs) {
+  long gap_cost = (long)DAMAGE_TILE_SIZE * DAMAGE_TILE_SIZE * tracker->pixel_bytes;
+  int count = 0;
+  for (int ty = 0; ty < tracker->tile_rows; ty++) {
+    uint8_t *tiles = &tracker->tiles[ty * tracker->tile_columns];
+    int tx = 0;
+    while (tx < tracker->tile_columns) {
+      if (!tiles[tx]) {
+        tx++;
+        continue;
+      }
+      int start = tx;
+      int end = tx + 1;
+      for (int next = end; next < tracker->tile_columns; next++) {
+        if (!tiles[next])
+          continue;
+        if ((next - end) * gap_cost >= tracker->rect_overhead)
+          break;
+        end = next + 1;
+      }
+      tx = end;
+
+      int merged = 0;
+      for (int i = 0; i < count; i++) {
+        if (runs[i].x == start && runs[i].w == end - start
+            && runs[i].y + runs[i].h == ty) {
+          runs[i].h++;
+          merged = 1;
+          break;
+        }
+      }
+      if (!merged)
+        runs[count++] = (damage_rect){start, ty, end - start, 1};
+    }
+  }
+  return count;
+}
+
+// replace the rects in each tile row with their bounding rect
+static int collapse_rows(damage_rect *rects, int count) {
+  int collapsed = 0;
+  for (int i = 0; i < count; i++) {
+    int merged = 0;
+    for (int j = 0; j < collapsed; j++) {
+      if (rects[j].y == rects[i].y && rects[j].h == rects[i].h) {
+        rects[j] = bounding_rect(rects[j], rects[i]);
+        merged = 1;
+        break;
+      }
+    }
+    if (!merged)
+      rects[collapsed++] = rects[i];
+  }
+  return collapsed;
+}
+
+// greedily merge the pair of rects whose bounding rect adds the fewest
+// extra bytes, while that is cheaper than the overhead of a separate rect
+// or there are more than max_rects
+static int merge_rects(damage_rect *rects, int count, long tile_cost,
+                       long overhead, int max_rects) {
+  while (count > 1) {
+    int best_a = -1, best_b = -1;
+    long best_cost = 0;
+    for (int a = 0; a < count; a++) {
+      for (int b = a + 1; b < count; b++) {
+        long extra = rect_area(bounding_rect(rects[a], rects[b]))
+          - rect_area(rects[a]) - rect_area(rects[b]);
+        long cost = extra * tile_cost;
+        if (best_a == -1 || cost < best_cost) {
+          best_a = a;
+          best_b = b;
+          best_cost = cost;
+        }
+      }
+    }
+    if (best_cost >= overhead && count <= max_rects)
+      break;
+    rects[best_a] = bounding_rect(rects[best_a], rects[best_b]);
+    rects[best_b] = rects[--count];
+  }
+  return count;
+}
+
+static long rect_area(damage_rect r) {
+  return (long)r.w * r.h;
+}
+
+static damage_rect bounding_rect(damage_rect a, damage_rect b) {
+  int x0 = a.x < b.x ? a.x : b.x;
+  int y0 = a.y < b.y ? a.y : b.y;
+  int x1 = a.x + a.w > b.x + b.w ? a.x + a.w : b.x + b.w;
+  int y1 = a.y + a.h > b.y + b.h ? a.y + a.h : b.y + b.h;
+  return (damage_rect){x0, y0, x1 - x0, y1 - y0};
+}
@@ -0,0 +1,82 @@
+#ifndef DISPLAY_DAMAGE_H
+#define DISPLAY_DAMAGE_H
+
+#include <stdint.h>
+
+#include "work_pool.h"
+
+/// Tracks which parts of a frame changed since it was last sent to the display.
+/// Frames are compared tile by tile and changed tiles are merged into
+/// a few rectangles, trading extra pixels sent against per rectangle overhead.
+
+// tiles are square, in pixels
+#define DAMAGE_TILE_SIZE 16
+// most rectangles a single update will produce
+#define DAMAGE_MAX_RECTS 16
+// time taken setting the draw area and write commands for a rectangle,
+// measured in bytes of pixel data that could be sent in the same time.
+// each rect costs ~6 spi transfers and D/C pin toggles at ~20us each,
+// 75MHz spi moves ~190 bytes in 20us
+#define DAMAGE_RECT_OVERHEAD_BYTES 1152
+
+typedef struct damage_rect {
+  uint16_t x;
+  uint16_t y;
+  uint16_t w;
+  uint16_t h;
+} damage_rect;
+
+typedef struct damage_tracker {
+  int width;
+  int height;
+  int pixel_bytes;
+  int tile_columns;
+  int tile_rows;
+  // cost of sending an extra rect, defaults to DAMAGE_RECT_OVERHEAD_BYTES
+  int rect_overhead;
+  // the frame as it was last sent, rects should be drawn from here
+  uint8_t *frame;
+  // one byte per tile, nonzero when the tile changed in the last update
+  uint8_t *tiles;
+  // when set the next update redraws the whole frame
+  int invalid;
+  damage_rect rects[DAMAGE_MAX_RECTS];
+  int rect_count;
+  // working space for merging, one rect per tile
+  damage_rect *candidates;
+  // whole frames are compared in bands of tile rows on its threads,
+  // NULL (the default) to compare on the caller alone
+  work_pool *pool;
+} damage_tracker;
+
+// allocate a tracker for frames of the given size, returns -1 on error
+int damage_init(damage_tracker *tracker, int width, int height, int pixel_bytes);
+
+void damage_free(damage_tracker *tracker);
+
+// next update will report the whole frame as changed
+// use when the display contents are unknown (ie after a reset or source change)
+void damage_invalidate(damage_tracker *tracker);
+
+// report the whole frame as needing a redraw from the copy already held,
+// ie after the display has been changed in a way that needs it resent
+void damage_redraw_all(damage_tracker *tracker);
+
+// the display's picture moved lines pixels towards 0 along x or y, with
+// the lines moved off one end coming back in at the other. Moves the held
+// frame the same way so the next update only finds what still differs
+void damage_scroll(damage_tracker *tracker, int lines, int along_x);
+
+// compare frame, with rows stride bytes apart, against the last one and
+// copy over the changed parts.
+// returns the number of rects in tracker->rects that need redrawing
+int damage_update(damage_tracker *tracker, const uint8_t *frame, int stride);
+
+// like damage_update, but only areas inside the hint rects are compared,
+// the rest of frame is assumed unchanged and never read.
+// an invalid tracker needs a whole frame, so it reads nothing, reports no
+// rects and stays invalid until damage_update is given one
+int damage_update_region(damage_tracker *tracker, const uint8_t *frame, int stride,
+                         const damage_rect *hints, int hint_count);
+
+#endif
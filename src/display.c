@@ -9,27 +9,28 @@
 
 #include <pthread.h>
 
-#include <wiringPi.h>
-#include <wiringPiSPI.h>
-
 #include "display_consts.h"
-#include "pi_wiring_consts.h"
+#include "stats.h"
+#include "transport.h"
 #include "time.h"
 
-#define BRIGHTNESS_CLOCK_DIVISOR 100
-
 void msleep(unsigned int ms) { usleep(ms * 1000); }
 
-void raw_send_buffer(uint8_t *buff, unsigned int size);
-
-void send_byte(uint8_t b) { raw_send_buffer(&b, 1); }
+void send_byte(uint8_t b);
 
 void send_4_bytes(uint16_t d1, uint16_t d2);
 
 void send_command(enum display_command_byte cmd);
 
+void send_scroll_start(uint16_t offset);
+
+uint16_t scrolled_position(uint16_t start, uint16_t size);
+
 void send_buffer(uint8_t *buff, unsigned int size);
 
+// send anything the transport has queued
+void flush_spi();
+
 
 typedef struct display_state_t {
   // sleep state
@@ -43,14 +44,24 @@ typedef struct display_state_t {
   enum display_option partial_mode;
   // is idle mode enabled
   enum display_option idle_mode;
+  // last sent to MEMORY_ACCESS_CONTROL, -1 when unknown
+  int address_flags;
   // true when x is column address
   enum display_option horizontal;
   enum display_option little_endian;
+  // memory rows are addressed bottom to top
+  enum display_option rows_flipped;
+  // how far the picture is scrolled towards 0 along the scroll axis
+  uint16_t scroll_offset;
+  // whether the scroll area has been set since reset
+  int scroll_defined;
 
   int previous_brightness;
 
   enum display_colour_format colour_format;
   int bits_per_pixel;
+  // whether the draw area below has been sent since reset
+  int draw_area_set;
   // current draw area
   uint16_t column_start;
   uint16_t column_width;
@@ -58,42 +69,83 @@ typedef struct display_state_t {
   uint16_t row_width;
 } display_state_t;
 
-static display_state_t display_state;
+typedef struct display_panel_t {
+  display_state_t state;
+  // NULL until given or opened
+  display_transport *transport;
+  pthread_mutex_t mutex;
+} display_panel_t;
+
+static display_panel_t panels[DISPLAY_MAX_PANELS];
+static int panel_count = 1;
+// the panel this thread's calls go to
+static _Thread_local display_panel_t *panel = &panels[0];
 
 void reset_display_state();
+int open_transport(display_panel_t *p);
 
 
 /// ---- Api Implementation ----
 
 
-int display_open() {
-  int result = wiringPiSetupGpio();
-  if (result) {
-    fprintf(stderr, "Failed to init pi gpio pins: %s\n", strerror(errno));
-    return -1;
-  }
+void display_set_transport(display_transport *t) {
+  display_set_panel_transport(0, t);
+}
 
-  pinMode(DATA_COMMAND_PIN, OUTPUT);
-  pinMode(RESET_PIN, OUTPUT);
+void display_set_panel_transport(int index, display_transport *t) {
+  panels[index].transport = t;
+}
 
-  int spi_handle = wiringPiSPIxSetupMode(
-      SPI_CHIP_ENABLE, SPI_CHANNEL, DISPLAY_SPI_FREQUENCY, DISPLAY_SPI_MODE);
-  if (spi_handle < 0) {
-    fprintf(stderr, "Failed to init spi: %s\n", strerror(errno));
-    return -1;
+display_transport *display_get_transport() {
+  return panel->transport;
+}
+
+void display_set_panel_count(int count) {
+  panel_count = count;
+}
+
+int display_panel_count() {
+  return panel_count;
+}
+
+void display_select_panel(int index) {
+  panel = &panels[index];
+}
+
+int display_selected_panel() {
+  return panel - panels;
+}
+
+int display_open() {
+  display_panel_t *selected = panel;
+  for (int i = 0; i < panel_count; i++) {
+    if (open_transport(&panels[i]) == -1) {
+      for (int j = 0; j < i; j++)
+        panels[j].transport->close(panels[j].transport);
+      return -1;
+    }
+    pthread_mutex_init(&panels[i].mutex, NULL);
+    panel = &panels[i];
+    display_brightness(0);
   }
-  display_brightness(0);
+  panel = selected;
   return 0;
 }
 
 void display_close() {
-  wiringPiSPIxClose(SPI_CHIP_ENABLE, SPI_CHANNEL);
+  for (int i = 0; i < panel_count; i++) {
+    display_transport *t = panels[i].transport;
+    t->flush(t);
+    t->close(t);
+    pthread_mutex_destroy(&panels[i].mutex);
+  }
 }
 
 void display_hardware_reset() {
-  digitalWrite(RESET_PIN, LOW);
+  display_transport *transport = panel->transport;
+  transport->reset_pin(transport, 0);
   usleep(10);
-  digitalWrite(RESET_PIN, HIGH);
+  transport->reset_pin(transport, 1);
   msleep(10);
   reset_display_state();
 }
@@ -101,31 +153,19 @@ void display_hardware_reset() {
 void display_brightness(unsigned int brightness) {
   if(brightness > MAX_BRIGHTNESS)
     brightness = MAX_BRIGHTNESS;
-  if(brightness == 0) {
-    pinMode(BACKLIGHT_PIN, OUTPUT);
-    digitalWrite(BACKLIGHT_PIN, 0);
-  } else if(brightness == MAX_BRIGHTNESS) {
-    pinMode(BACKLIGHT_PIN, OUTPUT);
-    digitalWrite(BACKLIGHT_PIN, 1);
-  } else {
-      pinMode(BACKLIGHT_PIN, PWM_OUTPUT);
-      pwmSetMode(PWM_MODE_MS);
-      pwmSetClock(BRIGHTNESS_CLOCK_DIVISOR);
-      pwmSetRange(MAX_BRIGHTNESS);
-      pwmWrite(BACKLIGHT_PIN, brightness);
-  }
+  panel->transport->backlight(panel->transport, brightness);
   if (brightness != 0)
-    display_state.previous_brightness = brightness;
+    panel->state.previous_brightness = brightness;
 }
 
-pthread_mutex_t display_mut;
-
 void display_lock() {
-  pthread_mutex_lock(&display_mut);
+  uint64_t start = time_monotonic_ns();
+  pthread_mutex_lock(&panel->mutex);
+  stats_record_since(STATS_LOCK_WAIT, start);
 }
 
 void display_unlock() {
-  pthread_mutex_unlock(&display_mut);
+  pthread_mutex_unlock(&panel->mutex);
 }
 
 void display_software_reset() {
@@ -135,10 +175,10 @@ void display_software_reset() {
 }
 
 void display_sleep(enum display_option state) {
-  if (state == display_state.sleep_mode)
+  if (state == panel->state.sleep_mode)
     return;
   time_point t = get_time();
-  double elapsed = real_time_s(display_state.last_sleep_change, t);
+  double elapsed = real_time_s(panel->state.last_sleep_change, t);
   // need to wait 120 sec after last sleep state change
   double wait = 120 - (elapsed * 1000);
   if (wait >= 0)
@@ -147,93 +187,105 @@ void display_sleep(enum display_option state) {
     display_brightness(0);
     send_command(SLEEP_IN_MODE);
   } else {
-    display_brightness(display_state.previous_brightness);
+    display_brightness(panel->state.previous_brightness);
     send_command(SLEEP_OUT_MODE);
   }
   msleep(5);
-  display_state.last_sleep_change = t;
-  display_state.sleep_mode = state;
+  panel->state.last_sleep_change = t;
+  panel->state.sleep_mode = state;
 }
 
 void display_on(enum display_option option) {
-  if (option == display_state.on)
+  if (option == panel->state.on)
     return;
   if (option == DISPLAY_ENABLE)
     send_command(DISPLAY_ON);
   else
     send_command(DISPLAY_OFF);
-  display_state.on = option;
+  panel->state.on = option;
 }
 
 void display_invert(enum display_option option) {
-  if (option == display_state.invert)
+  if (option == panel->state.invert)
     return;
   if (option == DISPLAY_ENABLE)
     send_command(INVERT_ON);
   else
     send_command(INVERT_OFF);
-  display_state.invert = option;
+  panel->state.invert = option;
 }
 
 void display_set_partial(uint16_t start, uint16_t end) {
-  if (display_state.partial_mode != DISPLAY_ENABLE)
+  if (panel->state.partial_mode != DISPLAY_ENABLE)
     send_command(PARTIAL_MODE);
-  display_state.partial_mode = DISPLAY_ENABLE;
+  panel->state.partial_mode = DISPLAY_ENABLE;
   send_command(PARTIAL_AREA_SET);
   send_4_bytes(start, end);
+  flush_spi();
 }
 
 void display_disable_partial() {
-  if (display_state.partial_mode != DISPLAY_ENABLE)
+  if (panel->state.partial_mode != DISPLAY_ENABLE)
     return;
   send_command(NORMAL_MODE);
-  display_state.partial_mode = DISPLAY_DISABLE;
+  panel->state.partial_mode = DISPLAY_DISABLE;
 }
 
 void display_idle_mode(enum display_option option) {
-  if(option == display_state.idle_mode)
+  if(option == panel->state.idle_mode)
     return;
   if(option == DISPLAY_ENABLE)
     send_command(IDLE_MODE_ON);
   else
     send_command(IDLE_MODE_OFF);
-  display_state.idle_mode = option;
+  panel->state.idle_mode = option;
 }
 
 void display_set_address_options(enum display_address_flags flags) {
+  if ((int)flags == panel->state.address_flags)
+    return;
   send_command(MEMORY_ACCESS_CONTROL);
   send_byte(flags);
-  display_state.horizontal = ((flags & ADDRESS_HORIZONTAL_ORIENTATION) > 0);
+  panel->state.address_flags = flags;
+  panel->state.horizontal = ((flags & ADDRESS_HORIZONTAL_ORIENTATION) > 0);
+  panel->state.rows_flipped = ((flags & ADDRESS_FLIP_HORIZONTAL) > 0);
+  // the offset depends on the orientation, start again unscrolled
+  if (panel->state.scroll_offset != 0)
+    send_scroll_start(0);
   enum display_option little_endian = ((flags & ADDRESS_COLOUR_LITTLE_ENDIAN) > 0);
-  if (little_endian == display_state.little_endian)
+  if (little_endian == panel->state.little_endian) {
+    flush_spi();
     return;
+  }
   send_command(RAM_CONTROL);
   uint8_t data[2];
   // default state of ram control, just changing endianess bit
   data[0] = 0x00;
   data[1] = 0xF0 | (little_endian ? 0b00001000 : 0);
   send_buffer(data, 2);
-  display_state.little_endian = little_endian;
+  flush_spi();
+  panel->state.little_endian = little_endian;
 }
 
 void display_set_colour_format(enum display_colour_format format) {
-  if (format == display_state.colour_format)
+  if (format == panel->state.colour_format)
     return;
   send_command(COLOUR_FORMAT_SET);
   send_byte(format);
-  display_state.colour_format = format;
-  switch (display_state.colour_format) {
+  flush_spi();
+  panel->state.colour_format = format;
+  switch (panel->state.colour_format) {
   default:
     fprintf(stderr, "unrecognised colour format!\n");
     exit(-1);
   case COLOUR_FORMAT_12_BIT:
-    display_state.bits_per_pixel = 12;
+    panel->state.bits_per_pixel = 12;
     break;
   case COLOUR_FORMAT_16_BIT:
-    display_state.bits_per_pixel = 16;
+    panel->state.bits_per_pixel = 16;
     break;
   case COLOUR_FORMAT_18_BIT:
-    display_state.bits_per_pixel = 24;
+    panel->state.bits_per_pixel = 24;
     break;    
   }
 }
@@ -241,44 +293,88 @@ void display_set_colour_format(enum display_colour_format format) {
 void send_draw_area(uint16_t column_start, uint16_t column_width, uint16_t column_max,
                     uint16_t row_start,    uint16_t row_width,    uint16_t row_max);
 
+void check_draw_size(unsigned int size);
+
+void send_write_ram(enum display_draw_flags flags);
+
+void finish_draw(enum display_draw_flags flags, uint64_t start);
+
 void display_set_draw_area(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
-  if (display_state.horizontal)
-    send_draw_area(x, w, DISPLAY_HORIZONTAL, y, h, DISPLAY_VERTICAL);
+  if (panel->state.horizontal)
+    send_draw_area(scrolled_position(x, w), w, DISPLAY_HORIZONTAL, y, h, DISPLAY_VERTICAL);
   else
-    send_draw_area(x, w, DISPLAY_VERTICAL, y, h, DISPLAY_HORIZONTAL);
+    send_draw_area(x, w, DISPLAY_VERTICAL, scrolled_position(y, h), h, DISPLAY_HORIZONTAL);
 }
 
 void display_set_draw_area_full() {
-  if (display_state.horizontal)
+  if (panel->state.horizontal)
     display_set_draw_area(0, 0, DISPLAY_HORIZONTAL, DISPLAY_VERTICAL);
   else  
     display_set_draw_area(0, 0, DISPLAY_VERTICAL, DISPLAY_HORIZONTAL);
 }
 
+void display_scroll(int lines) {
+  int offset = (panel->state.scroll_offset + lines) % DISPLAY_HORIZONTAL;
+  if (offset < 0)
+    offset += DISPLAY_HORIZONTAL;
+  if (!panel->state.scroll_defined) {
+    // the whole screen scrolls, no fixed areas at either end
+    send_command(VERTICAL_SCROLL_DEFINITION);
+    uint8_t area[6] = {0, 0, DISPLAY_HORIZONTAL >> 8, DISPLAY_HORIZONTAL & 0xFF, 0, 0};
+    send_buffer(area, 6);
+    panel->state.scroll_defined = 1;
+  }
+  send_scroll_start(offset);
+}
+
+int display_scroll_along_x() {
+  return panel->state.horizontal == DISPLAY_ENABLE;
+}
+
+uint16_t display_scroll_split() {
+  if (panel->state.scroll_offset == 0)
+    return 0;
+  return DISPLAY_HORIZONTAL - panel->state.scroll_offset;
+}
+
+void display_get_size(int *width, int *height) {
+  *width = panel->state.horizontal ? DISPLAY_HORIZONTAL : DISPLAY_VERTICAL;
+  *height = panel->state.horizontal ? DISPLAY_VERTICAL : DISPLAY_HORIZONTAL;
+}
+
+enum display_colour_format display_get_colour_format() {
+  return panel->state.colour_format;
+}
+
+int display_colour_little_endian() {
+  return panel->state.little_endian == DISPLAY_ENABLE;
+}
+
 void display_draw(uint8_t *colour_data, unsigned int size,
                   enum display_draw_flags flags) {  
-  if (size * 8 > (unsigned int)display_state.column_width
-      * display_state.row_width
-      * display_state.bits_per_pixel) {
-    fprintf(stderr,
-            "colour data passed was greater than draw area (%d by %d)\n",
-            display_state.column_width, display_state.row_width);
-    exit(-1);
-  }
-  if (size * 8 % display_state.bits_per_pixel != 0) {
-    fprintf(stderr,
-            "colour data passed did not have a whole number of pixels!"
-            "pixel width: %d bits, bits passed: %d\n",
-            display_state.bits_per_pixel, size * 8);
+  check_draw_size(size);
+  // timed until the flush, the colour data is only queued until then
+  uint64_t start = time_monotonic_ns();
+  send_write_ram(flags);
+  send_buffer(colour_data, size);
+  finish_draw(flags, start);
+}
+
+void display_draw_repeated(uint8_t *chunk, unsigned int chunk_size, unsigned int size,
+                           enum display_draw_flags flags) {
+  check_draw_size(size);
+  if (chunk_size * 8 % panel->state.bits_per_pixel != 0) {
+    fprintf(stderr, "repeated chunk of %d bytes is not a whole number of pixels\n",
+            chunk_size);
     exit(-1);
   }
-  if (flags & DONT_RESET_DRAW_LOCATION)
-    send_command(WRITE_RAM_CONTINUE);
-  else
-    send_command(WRITE_RAM);
-  send_buffer(colour_data, size);
-  if (!(flags & DONT_FLUSH_DRAW))
-    send_command(NO_OPERATION);
+  uint64_t start = time_monotonic_ns();
+  send_write_ram(flags);
+  // the transport only keeps pointers until the flush, so the same chunk
+  // can be queued any number of times
+  for (unsigned int sent = 0; sent < size; sent += chunk_size)
+    send_buffer(chunk, size - sent < chunk_size ? size - sent : chunk_size);
+  finish_draw(flags, start);
 }
 
 void display_combined_setup(enum display_colour_format colour_format,
@@ -302,31 +398,62 @@ void display_combined_setup(enum display_colour_format colour_format,
 
 
 void reset_display_state() {
-  display_state.sleep_mode = DISPLAY_ENABLE;
-  display_state.on = DISPLAY_DISABLE;
-  display_state.invert = DISPLAY_DISABLE;
-  display_state.last_sleep_change = time_zero();
-  display_state.partial_mode = DISPLAY_DISABLE;
-  display_state.idle_mode = DISPLAY_DISABLE;
-  display_state.horizontal = DISPLAY_DISABLE;
-  display_state.little_endian = DISPLAY_DISABLE;
-  display_state.colour_format = COLOUR_FORMAT_18_BIT;
-  display_state.bits_per_pixel = 24;
-
-  display_state.previous_brightness = MAX_BRIGHTNESS;
+  panel->state.sleep_mode = DISPLAY_ENABLE;
+  panel->state.on = DISPLAY_DISABLE;
+  panel->state.invert = DISPLAY_DISABLE;
+  panel->state.last_sleep_change = time_zero();
+  panel->state.partial_mode = DISPLAY_DISABLE;
+  panel->state.idle_mode = DISPLAY_DISABLE;
+  panel->state.address_flags = -1;
+  panel->state.horizontal = DISPLAY_DISABLE;
+  panel->state.little_endian = DISPLAY_DISABLE;
+  panel->state.rows_flipped = DISPLAY_DISABLE;
+  panel->state.scroll_offset = 0;
+  panel->state.scroll_defined = 0;
+  panel->state.colour_format = COLOUR_FORMAT_18_BIT;
+  panel->state.bits_per_pixel = 24;
+
+  panel->state.previous_brightness = MAX_BRIGHTNESS;
   
-  display_state.column_start = 0;
-  display_state.column_width = 0;
-  display_state.row_start = 0;
-  display_state.row_width = 0;
+  panel->state.draw_area_set = 0;
+  panel->state.column_start = 0;
+  panel->state.column_width = 0;
+  panel->state.row_start = 0;
+  panel->state.row_width = 0;
 }
 
-void raw_send_buffer(uint8_t *buff, unsigned int size) {
-  if (wiringPiSPIxDataRW(SPI_CHIP_ENABLE, SPI_CHANNEL, buff, size) == -1) {
-    fprintf(stderr, "Failed to send data over spi: %s\n", strerror(errno));
+// opens the panel's transport, or the default one for its wiring
+int open_transport(display_panel_t *p) {
+  int index = p - panels;
+  if (p->transport != NULL) {
+    if (p->transport->open(p->transport) == -1) {
+      fprintf(stderr, "Failed to open %s display transport for panel %d\n",
+              p->transport->name, index);
+      return -1;
+    }
+    return 0;
   }
+  // prefer spidev, falling back to wiringPi's spi
+  p->transport = transport_spidev_panel(index);
+  if (p->transport != NULL && p->transport->open(p->transport) == -1) {
+    fprintf(stderr, "Falling back to wiringPi spi\n");
+    p->transport = transport_wiringpi_panel(index);
+    if (p->transport->open(p->transport) == -1)
+      p->transport = NULL;
+  }
+  if (p->transport == NULL) {
+    fprintf(stderr, "Failed to open a display transport for panel %d\n", index);
+    return -1;
+  }
+  return 0;
+}
+
+void flush_spi() {
+  panel->transport->flush(panel->transport);
 }
 
+void send_byte(uint8_t b) { send_buffer(&b, 1); }
+
 void fill_2_bytes(uint8_t *arr, uint16_t data) {
   arr[0] = data >> 8;
   arr[1] = data;
@@ -339,25 +466,80 @@ void send_4_bytes(uint16_t d1, uint16_t d2) {
   send_buffer(data, 4);
 }
 
-void command_mode() { digitalWrite(DATA_COMMAND_PIN, LOW); }
+// commands are sent straight away, they are always followed by
+// a D/C change which would flush them anyway
+void send_command(enum display_command_byte cmd) {
+  uint8_t command = cmd;
+  panel->transport->send(panel->transport, &command, 1, TRANSPORT_COMMAND);
+  stats_count(STATS_BYTES_SENT, 1);
+  flush_spi();
+}
+
+// exits unless size bytes are whole pixels that fit the draw area
+void check_draw_size(unsigned int size) {
+  if (size * 8 > (unsigned int)panel->state.column_width
+      * panel->state.row_width
+      * panel->state.bits_per_pixel) {
+    fprintf(stderr,
+            "colour data passed was greater than draw area (%d by %d)\n",
+            panel->state.column_width, panel->state.row_width);
+    exit(-1);
+  }
+  if (size * 8 % panel->state.bits_per_pixel != 0) {
+    fprintf(stderr,
+            "colour data passed did not have a whole number of pixels!"
+            "pixel width: %d bits, bits passed: %d\n",
+            panel->state.bits_per_pixel, size * 8);
+    exit(-1);
+  }
+}
 
-void data_mode() { digitalWrite(DATA_COMMAND_PIN, HIGH); }
+void send_write_ram(enum display_draw_flags flags) {
+  if (flags & DONT_RESET_DRAW_LOCATION)
+    send_command(WRITE_RAM_CONTINUE);
+  else
+    send_command(WRITE_RAM);
+}
 
-void send_command(enum display_command_byte cmd) {
-  command_mode();
-  send_byte(cmd);
-  data_mode();
+// send the queued pixel data, timing it from start
+void finish_draw(enum display_draw_flags flags, uint64_t start) {
+  if (!(flags & DONT_FLUSH_DRAW))
+    send_command(NO_OPERATION);
+  flush_spi();
+  stats_record_since(STATS_SPI, start);
 }
 
 void send_buffer(uint8_t *buff, unsigned int size) {
   if (size == 0)
     return;
-  int transfers = size / SPI_BUFFER_SIZE;
-  int remainder = size % SPI_BUFFER_SIZE;
-  for (int i = 0; i < transfers; i++)
-    raw_send_buffer(&buff[i * SPI_BUFFER_SIZE], SPI_BUFFER_SIZE);
-  if (remainder > 0)
-    raw_send_buffer(&buff[transfers * SPI_BUFFER_SIZE], remainder);
+  panel->transport->send(panel->transport, buff, size, TRANSPORT_DATA);
+  stats_count(STATS_BYTES_SENT, size);
+}
+
+// the panel's scroll start counts memory rows from the top of the screen,
+// which run backwards to the picture when rows are flipped
+void send_scroll_start(uint16_t offset) {
+  uint16_t start = panel->state.rows_flipped
+    ? (DISPLAY_HORIZONTAL - offset) % DISPLAY_HORIZONTAL : offset;
+  send_command(VERTICAL_SCROLL_START);
+  uint8_t data[2];
+  fill_2_bytes(data, start);
+  send_buffer(data, 2);
+  flush_spi();
+  panel->state.scroll_offset = offset;
+}
+
+// where a draw area along the scroll axis sits in the scrolled memory,
+// out of range areas are left for send_draw_area to reject
+uint16_t scrolled_position(uint16_t start, uint16_t size) {
+  uint16_t split = display_scroll_split();
+  if (split == 0 || start + size > DISPLAY_HORIZONTAL)
+    return start;
+  if (start < split && start + size > split) {
+    fprintf(stderr, "Draw Area %d+%d crosses the scroll wrap at %d\n", start, size, split);
+    exit(-1);
+  }
+  return (start + panel->state.scroll_offset) % DISPLAY_HORIZONTAL;
 }
 
 
@@ -375,12 +557,19 @@ void send_draw_area(uint16_t column_start, uint16_t column_width, uint16_t colum
             column_max, row_max, column_start, column_width, row_start, row_width);    
     exit(-1);
   }
-  display_state.column_start = column_start;
-  display_state.column_width = column_width;
-  display_state.row_start = row_start;
-  display_state.row_width = row_width;
+  // the panel keeps the area until told otherwise
+  if (panel->state.draw_area_set && column_start == panel->state.column_start
+      && column_width == panel->state.column_width && row_start == panel->state.row_start
+      && row_width == panel->state.row_width)
+    return;
+  panel->state.draw_area_set = 1;
+  panel->state.column_start = column_start;
+  panel->state.column_width = column_width;
+  panel->state.row_start = row_start;
+  panel->state.row_width = row_width;
   send_command(COLUMN_ADDRESS_SET);
   send_4_bytes(column_start, column_start + column_width - 1);
   send_command(ROW_ADDRESS_SET);
   send_4_bytes(row_start, row_start + row_width - 1);
+  flush_spi();
 }
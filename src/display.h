@@ -5,22 +5,49 @@
 
 /// Library to interface with ST7789 using a raspberry pi
 /// Uses pins and SPI interface defined in 'pi_wiring_consts.h'
+/// through a transport from 'transport.h'
+/// Several panels can be driven at once, each with its own transport and
+/// state. Calls go to the panel the calling thread last selected, so one
+/// thread per panel can draw to them all at the same time.
 
 #define DISPLAY_HORIZONTAL 320
 #define DISPLAY_VERTICAL 240
 #define DISPLAY_PIXEL_COUNT DISPLAY_VERTICAL * DISPLAY_HORIZONTAL
 #define MAX_BRIGHTNESS 1024
+// most panels driven at once
+#define DISPLAY_MAX_PANELS 4
 
 enum display_option {
   DISPLAY_ENABLE = 1,
   DISPLAY_DISABLE = 0,
 };
 
-/// init gpio and spi pins
-/// returns -1 on error
+typedef struct display_transport display_transport;
+
+// use this transport for panel 0 instead of the default, call before display_open
+void display_set_transport(display_transport *transport);
+
+// the same for any panel
+void display_set_panel_transport(int panel, display_transport *transport);
+
+// the selected panel's transport, NULL before display_open
+display_transport *display_get_transport();
+
+// how many panels display_open opens, 1 by default. call before display_open
+void display_set_panel_count(int count);
+
+int display_panel_count();
+
+// send this thread's later calls to panel, each thread starts on panel 0
+void display_select_panel(int panel);
+
+int display_selected_panel();
+
+/// init gpio and spi pins of every panel, by default with spidev falling
+/// back to wiringPi's spi. returns -1 on error
 int display_open();
 
-/// close spi connection
+/// close every panel's spi connection
 void display_close();
 
 // perform a hardware reset, takes ~10ms
@@ -29,7 +56,8 @@ void display_hardware_reset();
 // set backlight brightness (0 to 1024)
 void display_brightness(unsigned int brightness);
 
-// when using multithreaded aquire the display before using
+// when using multithreaded aquire the display before using,
+// each panel has its own lock
 void display_lock();
 
 // when using mutltihreaded release the display when finished
@@ -65,7 +93,8 @@ enum display_address_flags {
   ADDRESS_REFRESH_RIGHT_TO_LEFT  = 0b00000100,
   ADDRESS_COLOUR_LITTLE_ENDIAN   = 0b00000001,
 };
-// change the orientation of the display and how colour data is read, 0 for default
+// change the orientation of the display and how colour data is read, 0 for default.
+// nothing is sent when they are already set
 void display_set_address_options(enum display_address_flags flags);
 
 enum display_colour_format {
@@ -79,12 +108,34 @@ enum display_colour_format {
 // change the colour bit depth 
 void display_set_colour_format(enum display_colour_format format);
 
-// specify area of the screen write commands will write to
+// specify area of the screen write commands will write to, nothing is sent
+// when it is already the area. while scrolled it can't cross display_scroll_split() along the scroll axis
 void display_set_draw_area(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
 
-// set draw area to whole screen
+// set draw area to whole screen, only while not scrolled
 void display_set_draw_area_full();
 
+// move the whole picture lines pixels towards 0 along the scroll axis, lines
+// moved off one end come back in at the other. Draw areas are offset to match,
+// so only the lines coming in need drawing over. Returns to 0 on reset
+void display_scroll(int lines);
+
+// the panel only scrolls along its 320 pixel side,
+// which is x in horizontal orientation and y otherwise
+int display_scroll_along_x();
+
+// where along the scroll axis the scrolled picture wraps round in the
+// display's memory, draw areas must be split there. 0 when not scrolled
+uint16_t display_scroll_split();
+
+// the selected panel's width and height in its current orientation
+void display_get_size(int *width, int *height);
+
+enum display_colour_format display_get_colour_format();
+
+// whether 16 bit colour is sent little endian, see ADDRESS_COLOUR_LITTLE_ENDIAN
+int display_colour_little_endian();
+
 enum display_draw_flags {
   // move to 0, 0 of draw area before drawing
   DONT_RESET_DRAW_LOCATION = 1,
@@ -96,6 +147,11 @@ enum display_draw_flags {
 // draw pixel data to the display, must be a whole number of pixels
 void display_draw(uint8_t *colour_data, unsigned int size, enum display_draw_flags flags);
 
+// draw size bytes made of chunk sent over and over, the last time cut short,
+// to fill an area without a buffer its size. chunk must be whole pixels
+void display_draw_repeated(uint8_t *chunk, unsigned int chunk_size, unsigned int size,
+                           enum display_draw_flags flags);
+
 // combines prexisitng functions
 // reset, unsleep, and set up colour and address, turn on display and set full draw area
 void display_combined_setup(enum display_colour_format colour_format,
@@ -0,0 +1,126 @@
+#include "display_client.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static int receive_welcome(display_client *client, client_message *welcome, int *buffer_fd);
+
+
+/// ---- Api Implementation ----
+
+
+int display_client_connect(display_client *client, const char *socket_path,
+                           int x, int y, int w, int h, int z) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "display socket path %s is too long\n", socket_path);
+    return -1;
+  }
+  strcpy(address.sun_path, socket_path);
+  client->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (client->fd == -1) {
+    fprintf(stderr, "Failed to create display socket, %s\n", strerror(errno));
+    return -1;
+  }
+  if (connect(client->fd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+    fprintf(stderr, "Failed to connect to display at %s, %s\n", socket_path,
+            strerror(errno));
+    close(client->fd);
+    return -1;
+  }
+  client_message hello = {CLIENT_HELLO, DISPLAY_CLIENT_VERSION, x, y, w, h, z, 0};
+  client_message welcome;
+  int buffer_fd;
+  if (send(client->fd, &hello, sizeof(hello), MSG_NOSIGNAL) != sizeof(hello)
+      || receive_welcome(client, &welcome, &buffer_fd) == -1) {
+    close(client->fd);
+    return -1;
+  }
+  client->width = welcome.w;
+  client->height = welcome.h;
+  client->stride = welcome.stride;
+  client->size = (size_t)client->stride * client->height;
+  client->pending = 0;
+  client->pixels = mmap(0, client->size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer_fd, 0);
+  close(buffer_fd);
+  if (client->pixels == MAP_FAILED) {
+    fprintf(stderr, "Failed to map display buffer, %s\n", strerror(errno));
+    close(client->fd);
+    return -1;
+  }
+  return 0;
+}
+
+void display_client_close(display_client *client) {
+  munmap(client->pixels, client->size);
+  close(client->fd);
+}
+
+int display_client_damage(display_client *client, int x, int y, int w, int h) {
+  client_message damage = {CLIENT_DAMAGE, DISPLAY_CLIENT_VERSION, x, y, w, h, 0, 0};
+  if (send(client->fd, &damage, sizeof(damage), MSG_NOSIGNAL) != sizeof(damage)) {
+    fprintf(stderr, "Failed to send to display, %s\n", strerror(errno));
+    return -1;
+  }
+  client->pending++;
+  return 0;
+}
+
+int display_client_wait(display_client *client) {
+  while (client->pending > 0) {
+    client_message done;
+    ssize_t got = recv(client->fd, &done, sizeof(done), 0);
+    if (got == -1 && errno == EINTR)
+      continue;
+    if (got != sizeof(done)) {
+      fprintf(stderr, "Lost the display connection\n");
+      return -1;
+    }
+    if (done.kind == CLIENT_DONE)
+      client->pending--;
+  }
+  return 0;
+}
+
+
+/// ---- Helper Definitions ----
+
+
+// read the answer to hello, with the buffer's fd attached
+static int receive_welcome(display_client *client, client_message *welcome, int *buffer_fd) {
+  union {
+    struct cmsghdr header;
+    char space[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct iovec data = {welcome, sizeof(*welcome)};
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  message.msg_control = control.space;
+  message.msg_controllen = sizeof(control.space);
+  ssize_t got = recvmsg(client->fd, &message, MSG_CMSG_CLOEXEC);
+  struct cmsghdr *attached = CMSG_FIRSTHDR(&message);
+  int have_fd = attached != NULL && attached->cmsg_level == SOL_SOCKET
+                && attached->cmsg_type == SCM_RIGHTS;
+  if (have_fd)
+    memcpy(buffer_fd, CMSG_DATA(attached), sizeof(int));
+  if (got != sizeof(*welcome) || welcome->kind != CLIENT_WELCOME || !have_fd) {
+    if (have_fd)
+      close(*buffer_fd);
+    if (got == sizeof(*welcome) && welcome->kind == CLIENT_REFUSED)
+      fprintf(stderr, "The display refused the area asked for\n");
+    else
+      fprintf(stderr, "The display didn't answer as expected\n");
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef DISPLAY_CLIENT_H
+#define DISPLAY_CLIENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/// Lets a local app draw on the panels without X or the framebuffer, when
+/// the display is run with -u socket. Build this file into the app.
+/// The app asks for an area of the picture and a z order, and is given a
+/// buffer in shared memory the size of that area, in little endian RGB565
+/// like the frames the display sends. It draws into the buffer and reports
+/// each rect it drew. The display copies reported rects out, then says
+/// so, and only those are sent to the panels. Apps with a higher z are
+/// drawn over lower ones, and where no app draws the panels are black.
+///
+/// A connection is a SOCK_SEQPACKET unix socket, one client_message per
+/// packet:
+///   app: HELLO, area and z wanted    display: WELCOME, buffer attached
+///   app: DAMAGE, rect drawn          display: DONE, rect copied out
+/// The display answers HELLO with REFUSED instead when the area isn't in
+/// the picture or it has as many apps as it takes.
+
+#define DISPLAY_CLIENT_VERSION 1
+
+enum client_message_kind {
+  CLIENT_HELLO,
+  CLIENT_WELCOME,
+  CLIENT_DAMAGE,
+  CLIENT_DONE,
+  CLIENT_REFUSED,
+};
+
+typedef struct client_message {
+  uint32_t kind;
+  uint32_t version;
+  // HELLO: the area in the picture, a width or height of 0 for all of it
+  // WELCOME: 0, 0 and the buffer's size
+  // DAMAGE: the rect drawn, within the buffer
+  int32_t x;
+  int32_t y;
+  int32_t w;
+  int32_t h;
+  // HELLO: apps with a higher z are drawn over lower ones, the newer app
+  // goes on top of equal ones
+  int32_t z;
+  // WELCOME: bytes between rows of the buffer
+  uint32_t stride;
+} client_message;
+
+typedef struct display_client {
+  int fd;
+  // the area's pixels, shared with the display
+  uint8_t *pixels;
+  size_t size;
+  int width;
+  int height;
+  int stride;
+  // rects reported but not yet copied out
+  int pending;
+} display_client;
+
+// connect to the display serving socket_path and ask for the w x h area at
+// x, y (w or h 0 for the whole picture) at z. returns -1 on error
+int display_client_connect(display_client *client, const char *socket_path,
+                           int x, int y, int w, int h, int z);
+
+// the area is cleared to black once the connection closes
+void display_client_close(display_client *client);
+
+// report a rect drawn in the buffer. it mustn't be drawn again until it has
+// been copied out, see display_client_wait. returns -1 on error
+int display_client_damage(display_client *client, int x, int y, int w, int h);
+
+// wait until every rect reported has been copied out.
+// returns -1 if the display has gone away
+int display_client_wait(display_client *client);
+
+#endif
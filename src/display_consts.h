@@ -30,8 +30,12 @@ enum display_command_byte {
 
   PARTIAL_AREA_SET = 0x30,
 
+  VERTICAL_SCROLL_DEFINITION = 0x33,
+
   MEMORY_ACCESS_CONTROL = 0x36,
 
+  VERTICAL_SCROLL_START = 0x37,
+
   IDLE_MODE_OFF = 0x38,
   IDLE_MODE_ON = 0x39,
 
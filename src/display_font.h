@@ -0,0 +1,17 @@
+#ifndef DISPLAY_FONT_H
+#define DISPLAY_FONT_H
+
+#include <stdint.h>
+
+/// The 8x8 bitmap font display_text draws with, printable ascii only.
+/// Each glyph is a byte per row from the top, bit 0 is the leftmost pixel.
+
+#define DISPLAY_FONT_WIDTH 8
+#define DISPLAY_FONT_HEIGHT 8
+#define DISPLAY_FONT_FIRST ' '
+#define DISPLAY_FONT_LAST '~'
+#define DISPLAY_FONT_GLYPHS (DISPLAY_FONT_LAST - DISPLAY_FONT_FIRST + 1)
+
+extern const uint8_t display_font[DISPLAY_FONT_GLYPHS][DISPLAY_FONT_HEIGHT];
+
+#endif
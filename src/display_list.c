@@ -0,0 +1,249 @@
+#include "display_list.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static display_list_op *add_op(display_list *list, enum display_list_op_kind kind);
+static int add_draw(display_list *list, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                    const uint8_t *data, unsigned int size, enum display_draw_flags flags,
+                    int copy);
+static int grow(void **array, size_t *capacity, size_t needed, size_t item_size);
+static int superseded(const display_list *list, int index);
+static int covered(const display_list *list, int index, int colour, int address);
+static int bits_per_pixel(int format);
+static int fills_area(const display_list_op *op, int bits);
+
+
+/// ---- Api Implementation ----
+
+
+void display_list_init(display_list *list) {
+  memset(list, 0, sizeof(*list));
+}
+
+void display_list_free(display_list *list) {
+  free(list->ops);
+  free(list->bytes);
+  display_list_init(list);
+}
+
+void display_list_clear(display_list *list) {
+  list->count = 0;
+  list->byte_count = 0;
+}
+
+int display_list_colour_format(display_list *list, enum display_colour_format format) {
+  display_list_op *op = add_op(list, DISPLAY_LIST_COLOUR_FORMAT);
+  if (op == NULL)
+    return -1;
+  op->value = format;
+  return 0;
+}
+
+int display_list_address_options(display_list *list, enum display_address_flags flags) {
+  display_list_op *op = add_op(list, DISPLAY_LIST_ADDRESS_OPTIONS);
+  if (op == NULL)
+    return -1;
+  op->value = flags;
+  return 0;
+}
+
+int display_list_draw(display_list *list, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                      const uint8_t *data, unsigned int size, enum display_draw_flags flags) {
+  return add_draw(list, x, y, w, h, data, size, flags, 1);
+}
+
+int display_list_draw_borrowed(display_list *list, uint16_t x, uint16_t y, uint16_t w,
+                               uint16_t h, const uint8_t *data, unsigned int size,
+                               enum display_draw_flags flags) {
+  return add_draw(list, x, y, w, h, data, size, flags, 0);
+}
+
+void display_list_optimize(display_list *list) {
+  // drop what changes nothing, tracking what the list has set so far
+  int colour = -1;
+  int address = -1;
+  int kept = 0;
+  for (int i = 0; i < list->count; i++) {
+    display_list_op *op = &list->ops[i];
+    if (op->kind == DISPLAY_LIST_COLOUR_FORMAT) {
+      if (op->value == colour || superseded(list, i))
+        continue;
+      colour = op->value;
+    } else if (op->kind == DISPLAY_LIST_ADDRESS_OPTIONS) {
+      if (op->value == address || superseded(list, i))
+        continue;
+      address = op->value;
+    } else if (covered(list, i, colour, address)) {
+      continue;
+    }
+    list->ops[kept++] = *op;
+  }
+  list->count = kept;
+
+  // chain draws that carry on where the last one ended. the area has to
+  // be filled exactly, so only once the list has set the colour format
+  int bits = 0;
+  display_list_op *chain = NULL;
+  display_list_op *last = NULL;
+  for (int i = 0; i < list->count; i++) {
+    display_list_op *op = &list->ops[i];
+    if (op->kind != DISPLAY_LIST_DRAW) {
+      if (op->kind == DISPLAY_LIST_COLOUR_FORMAT)
+        bits = bits_per_pixel(op->value);
+      chain = NULL;
+      continue;
+    }
+    op->area_h = op->h;
+    if (chain != NULL && bits && fills_area(last, bits) && op->x == chain->x
+        && op->w == chain->w && op->y == chain->y + chain->area_h) {
+      chain->area_h += op->h;
+      op->area_h = 0;
+    } else {
+      chain = op;
+    }
+    last = op;
+  }
+
+  // only the last draw needs a nop after it
+  for (int i = 0; i < list->count; i++)
+    if (list->ops[i].kind == DISPLAY_LIST_DRAW && &list->ops[i] != last)
+      list->ops[i].flags |= DONT_FLUSH_DRAW;
+}
+
+void display_list_play(const display_list *list) {
+  // chained draws would cross the wrap, so each goes to its own area
+  int scrolled = display_scroll_split() != 0;
+  for (int i = 0; i < list->count; i++) {
+    const display_list_op *op = &list->ops[i];
+    switch (op->kind) {
+    case DISPLAY_LIST_COLOUR_FORMAT:
+      display_set_colour_format(op->value);
+      break;
+    case DISPLAY_LIST_ADDRESS_OPTIONS:
+      display_set_address_options(op->value);
+      scrolled = display_scroll_split() != 0;
+      break;
+    case DISPLAY_LIST_DRAW: {
+      uint8_t *data = op->borrowed != NULL
+        ? (uint8_t *)op->borrowed : &list->bytes[op->offset];
+      if (scrolled) {
+        display_set_draw_area(op->x, op->y, op->w, op->h);
+        display_draw(data, op->size, op->flags);
+      } else if (op->area_h != 0) {
+        display_set_draw_area(op->x, op->y, op->w, op->area_h);
+        display_draw(data, op->size, op->flags);
+      } else {
+        display_draw(data, op->size, op->flags | DONT_RESET_DRAW_LOCATION);
+      }
+      break;
+    }
+    }
+  }
+}
+
+
+/// ---- Helper Definitions ----
+
+
+// returns NULL on error
+static display_list_op *add_op(display_list *list, enum display_list_op_kind kind) {
+  if ((size_t)list->count == list->capacity
+      && grow((void **)&list->ops, &list->capacity, list->count + 1,
+              sizeof(display_list_op)) == -1) {
+    fprintf(stderr, "Failed to grow display list\n");
+    return NULL;
+  }
+  display_list_op *op = &list->ops[list->count++];
+  memset(op, 0, sizeof(*op));
+  op->kind = kind;
+  return op;
+}
+
+static int add_draw(display_list *list, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                    const uint8_t *data, unsigned int size, enum display_draw_flags flags,
+                    int copy) {
+  if (copy && list->byte_count + size > list->byte_capacity
+      && grow((void **)&list->bytes, &list->byte_capacity, list->byte_count + size, 1) == -1) {
+    fprintf(stderr, "Failed to grow display list data\n");
+    return -1;
+  }
+  display_list_op *op = add_op(list, DISPLAY_LIST_DRAW);
+  if (op == NULL)
+    return -1;
+  op->x = x;
+  op->y = y;
+  op->w = w;
+  op->h = h;
+  op->area_h = h;
+  op->size = size;
+  // each draw starts at its own area, unless chained by display_list_optimize
+  op->flags = flags & DONT_FLUSH_DRAW;
+  if (copy) {
+    memcpy(&list->bytes[list->byte_count], data, size);
+    op->offset = list->byte_count;
+    list->byte_count += size;
+  } else {
+    op->borrowed = data;
+  }
+  return 0;
+}
+
+// doubles capacity until it holds needed items. returns -1 on error
+static int grow(void **array, size_t *capacity, size_t needed, size_t item_size) {
+  size_t size = *capacity ? *capacity : 16;
+  while (size < needed)
+    size *= 2;
+  void *grown = realloc(*array, size * item_size);
+  if (grown == NULL)
+    return -1;
+  *array = grown;
+  *capacity = size;
+  return 0;
+}
+
+// whether another op of the same kind replaces this one before any draw
+static int superseded(const display_list *list, int index) {
+  for (int i = index + 1; i < list->count; i++) {
+    if (list->ops[i].kind == DISPLAY_LIST_DRAW)
+      return 0;
+    if (list->ops[i].kind == list->ops[index].kind)
+      return 1;
+  }
+  return 0;
+}
+
+// whether the next draw redraws every pixel this one does. colour and
+// address are what is set for this draw, ops setting them again are passed
+// over as queued draws each come with their colour format
+static int covered(const display_list *list, int index, int colour, int address) {
+  const display_list_op *op = &list->ops[index];
+  for (int i = index + 1; i < list->count; i++) {
+    const display_list_op *next = &list->ops[i];
+    if ((next->kind == DISPLAY_LIST_COLOUR_FORMAT && next->value == colour)
+        || (next->kind == DISPLAY_LIST_ADDRESS_OPTIONS && next->value == address))
+      continue;
+    return next->kind == DISPLAY_LIST_DRAW && next->x == op->x && next->y == op->y
+      && next->w == op->w && next->h == op->h && next->size >= op->size;
+  }
+  return 0;
+}
+
+// 0 if unknown
+static int bits_per_pixel(int format) {
+  switch (format) {
+  case COLOUR_FORMAT_12_BIT:
+    return 12;
+  case COLOUR_FORMAT_16_BIT:
+    return 16;
+  case COLOUR_FORMAT_18_BIT:
+    return 24;
+  }
+  return 0;
+}
+
+// whether the draw ends exactly at the end of its area
+static int fills_area(const display_list_op *op, int bits) {
+  return (uint64_t)op->size * 8 == (uint64_t)op->w * op->h * bits;
+}
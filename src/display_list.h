@@ -0,0 +1,82 @@
+#ifndef DISPLAY_LIST_H
+#define DISPLAY_LIST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "display.h"
+
+/// Records display operations to send later in one go, and can be played
+/// any number of times, ie for a screen that never changes.
+/// display_list_optimize cuts what a list sends before it is played:
+///  - colour format and address changes that change nothing are dropped
+///  - draws completely covered by the next one are dropped
+///  - draws that carry on in memory where the last one ended (same columns,
+///    next rows) share one draw area, sent with WRITE_RAM_CONTINUE
+///  - only the last draw is flushed with a NO_OPERATION
+/// Unchanged draw areas between lists are skipped by display.c itself.
+
+enum display_list_op_kind {
+  DISPLAY_LIST_COLOUR_FORMAT,
+  DISPLAY_LIST_ADDRESS_OPTIONS,
+  DISPLAY_LIST_DRAW,
+};
+
+typedef struct display_list_op {
+  enum display_list_op_kind kind;
+  // draw area
+  uint16_t x;
+  uint16_t y;
+  uint16_t w;
+  uint16_t h;
+  // rows of the area set for the draws it starts, 0 when it carries on the last one
+  uint16_t area_h;
+  // NULL when the data is held in the list, at offset
+  const uint8_t *borrowed;
+  size_t offset;
+  unsigned int size;
+  enum display_draw_flags flags;
+  // colour format or address flags
+  int value;
+} display_list_op;
+
+typedef struct display_list {
+  display_list_op *ops;
+  int count;
+  size_t capacity;
+  // copied draw data
+  uint8_t *bytes;
+  size_t byte_count;
+  size_t byte_capacity;
+} display_list;
+
+void display_list_init(display_list *list);
+
+void display_list_free(display_list *list);
+
+// forget everything recorded, keeping the memory for the next recording
+void display_list_clear(display_list *list);
+
+/// each returns -1 on error
+
+int display_list_colour_format(display_list *list, enum display_colour_format format);
+
+int display_list_address_options(display_list *list, enum display_address_flags flags);
+
+// draw w x h pixels at x, y, the data is copied
+int display_list_draw(display_list *list, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                      const uint8_t *data, unsigned int size, enum display_draw_flags flags);
+
+// the same without copying, data must stay valid until the list is cleared
+int display_list_draw_borrowed(display_list *list, uint16_t x, uint16_t y, uint16_t w,
+                               uint16_t h, const uint8_t *data, unsigned int size,
+                               enum display_draw_flags flags);
+
+// rewrite the list to send less, see above. while the panel is scrolled
+// draws are played with their own areas, which must not cross the wrap
+void display_list_optimize(display_list *list);
+
+// send the list to the selected panel, which must be locked
+void display_list_play(const display_list *list);
+
+#endif
@@ -0,0 +1,199 @@
+#include "display_primitives.h"
+
+#include <string.h>
+
+#include "pixel_convert.h"
+
+// pixels gathered and sent at a time, even so 12 bit chunks are whole pairs
+#define CHUNK_PIXELS 512
+
+// write w pixels of row y of what is drawn, from its column x, as RGB565
+typedef void (*row_source)(void *ctx, uint16_t *pixels, int x, int y, int w);
+
+typedef struct source_t {
+  // NULL for a fill of colour
+  row_source rows;
+  void *ctx;
+  uint16_t colour;
+  // where its 0, 0 is on the panel
+  int x;
+  int y;
+} source_t;
+
+typedef struct primitives_panel_t {
+  // pixels gathered for the next send, then as sent. the transport keeps
+  // pointing at chunk until the flush that ends every draw
+  uint16_t gathered[CHUNK_PIXELS];
+  uint8_t chunk[CHUNK_PIXELS * 3];
+} primitives_panel_t;
+
+typedef struct picture_t {
+  const uint8_t *pixels;
+  int stride;
+} picture_t;
+
+typedef struct text_line_t {
+  const char *text;
+  uint16_t colour;
+  uint16_t background;
+} text_line_t;
+
+// each panel can be drawn to from its own thread
+static primitives_panel_t panels[DISPLAY_MAX_PANELS];
+
+static void draw_clipped(const source_t *source, int w, int h);
+static void split_at_scroll(const source_t *source, int x, int y, int w, int h);
+static void draw_whole_pairs(const source_t *source, int x, int y, int w, int h);
+static void stream_area(const source_t *source, int x, int y, int w, int h);
+static void stream_fill(primitives_panel_t *p, uint16_t colour, int pixels);
+static unsigned int convert_gathered(primitives_panel_t *p, int pixels);
+static void blit_rows(void *ctx, uint16_t *pixels, int x, int y, int w);
+static void text_rows(void *ctx, uint16_t *pixels, int x, int y, int w);
+
+
+/// ---- Api Implementation ----
+
+
+void display_fill_rect(int x, int y, int w, int h, uint16_t colour) {
+  source_t fill = {NULL, NULL, colour, x, y};
+  draw_clipped(&fill, w, h);
+}
+
+void display_hline(int x, int y, int w, uint16_t colour) {
+  display_fill_rect(x, y, w, 1, colour);
+}
+
+void display_vline(int x, int y, int h, uint16_t colour) {
+  display_fill_rect(x, y, 1, h, colour);
+}
+
+void display_blit(int x, int y, int w, int h, const uint8_t *pixels, int stride) {
+  picture_t picture = {pixels, stride};
+  source_t blit = {blit_rows, &picture, 0, x, y};
+  draw_clipped(&blit, w, h);
+}
+
+int display_text(int x, int y, const char *text, uint16_t colour, uint16_t background) {
+  text_line_t line = {NULL, colour, background};
+  while (1) {
+    int length = strcspn(text, "\n");
+    line.text = text;
+    source_t source = {text_rows, &line, 0, x, y};
+    draw_clipped(&source, length * DISPLAY_FONT_WIDTH, DISPLAY_FONT_HEIGHT);
+    if (text[length] == '\0')
+      return x + length * DISPLAY_FONT_WIDTH;
+    text += length + 1;
+    y += DISPLAY_FONT_HEIGHT;
+  }
+}
+
+
+/// ---- Helper Definitions ----
+
+
+// draw the part of the w x h source on the panel
+static void draw_clipped(const source_t *source, int w, int h) {
+  int width, height;
+  display_get_size(&width, &height);
+  long x0 = source->x < 0 ? 0 : source->x;
+  long y0 = source->y < 0 ? 0 : source->y;
+  long x1 = (long)source->x + w < width ? (long)source->x + w : width;
+  long y1 = (long)source->y + h < height ? (long)source->y + h : height;
+  if (x1 <= x0 || y1 <= y0)
+    return;
+  split_at_scroll(source, x0, y0, x1 - x0, y1 - y0);
+}
+
+// draw areas can't cross where the scrolled picture wraps round
+static void split_at_scroll(const source_t *source, int x, int y, int w, int h) {
+  int split = display_scroll_split();
+  if (display_scroll_along_x() && x < split && x + w > split) {
+    draw_whole_pairs(source, x, y, split - x, h);
+    draw_whole_pairs(source, split, y, x + w - split, h);
+  } else if (!display_scroll_along_x() && y < split && y + h > split) {
+    draw_whole_pairs(source, x, y, w, split - y);
+    draw_whole_pairs(source, x, split, w, y + h - split);
+  } else {
+    draw_whole_pairs(source, x, y, w, h);
+  }
+}
+
+// 12 bit colour is sent in pairs of pixels, so an odd number of them is
+// drawn as two overlapping areas of whole pairs. a lone pixel goes in 18 bit
+static void draw_whole_pairs(const source_t *source, int x, int y, int w, int h) {
+  if (display_get_colour_format() != COLOUR_FORMAT_12_BIT || w * h % 2 == 0) {
+    stream_area(source, x, y, w, h);
+  } else if (w > 1) {
+    stream_area(source, x, y, w - 1, h);
+    stream_area(source, x + w - 2, y, 2, h);
+  } else if (h > 1) {
+    stream_area(source, x, y, 1, h - 1);
+    stream_area(source, x, y + h - 2, 1, 2);
+  } else {
+    display_set_colour_format(COLOUR_FORMAT_18_BIT);
+    stream_area(source, x, y, 1, 1);
+    display_set_colour_format(COLOUR_FORMAT_12_BIT);
+  }
+}
+
+// send the area a chunk at a time, gathering whole and part rows into each
+static void stream_area(const source_t *source, int x, int y, int w, int h) {
+  primitives_panel_t *p = &panels[display_selected_panel()];
+  display_set_draw_area(x, y, w, h);
+  if (source->rows == NULL) {
+    stream_fill(p, source->colour, w * h);
+    return;
+  }
+  enum display_draw_flags flags = DONT_FLUSH_DRAW;
+  int count = 0;
+  for (int row = 0; row < h; row++) {
+    for (int column = 0; column < w;) {
+      if (count == CHUNK_PIXELS) {
+        display_draw(p->chunk, convert_gathered(p, count), flags);
+        flags |= DONT_RESET_DRAW_LOCATION;
+        count = 0;
+      }
+      int run = w - column < CHUNK_PIXELS - count ? w - column : CHUNK_PIXELS - count;
+      source->rows(source->ctx, &p->gathered[count], x + column - source->x,
+                   y + row - source->y, run);
+      count += run;
+      column += run;
+    }
+  }
+  display_draw(p->chunk, convert_gathered(p, count), flags & ~DONT_FLUSH_DRAW);
+}
+
+// fill the draw area, repeating one chunk of colour
+static void stream_fill(primitives_panel_t *p, uint16_t colour, int pixels) {
+  int count = pixels < CHUNK_PIXELS ? pixels : CHUNK_PIXELS;
+  for (int i = 0; i < count; i++)
+    p->gathered[i] = colour;
+  unsigned int chunk_size = convert_gathered(p, count);
+  display_draw_repeated(p->chunk, chunk_size,
+                        pixel_panel_row_bytes(display_get_colour_format(), pixels), 0);
+}
+
+// convert pixels gathered into the chunk, returns its size in bytes
+static unsigned int convert_gathered(primitives_panel_t *p, int pixels) {
+  enum display_colour_format format = display_get_colour_format();
+  pixel_convert_row(p->chunk, format, display_colour_little_endian(),
+                    (const uint8_t *)p->gathered, PIXEL_FORMAT_RGB565, pixels);
+  return pixel_panel_row_bytes(format, pixels);
+}
+
+static void blit_rows(void *ctx, uint16_t *pixels, int x, int y, int w) {
+  picture_t *picture = ctx;
+  memcpy(pixels, &picture->pixels[(size_t)y * picture->stride + x * 2], w * 2);
+}
+
+// glyph rows are expanded from the font's bits as they're gathered
+static void text_rows(void *ctx, uint16_t *pixels, int x, int y, int w) {
+  text_line_t *line = ctx;
+  for (int i = 0; i < w; i++, x++) {
+    unsigned char c = line->text[x / DISPLAY_FONT_WIDTH];
+    if (c < DISPLAY_FONT_FIRST || c > DISPLAY_FONT_LAST)
+      c = '?';
+    pixels[i] = display_font[c - DISPLAY_FONT_FIRST][y] >> x % DISPLAY_FONT_WIDTH & 1
+      ? line->colour : line->background;
+  }
+}
@@ -0,0 +1,39 @@
+#ifndef DISPLAY_PRIMITIVES_H
+#define DISPLAY_PRIMITIVES_H
+
+#include <stdint.h>
+
+#include "display.h"
+#include "display_font.h"
+
+/// Shapes, images and text drawn straight to the selected panel, for status
+/// screens and tests with no frame to mirror. Nothing the size of what is
+/// drawn is held: fills send one small chunk of pixels over and over, and
+/// images and text go out a chunk of rows at a time, text expanded from
+/// the font's bits as it goes.
+/// Coordinates are in the panel's current orientation, anything off the
+/// panel is clipped, and areas are split where its scrolling wraps.
+/// Colours are RGB565, converted to the panel's colour format as sent.
+
+// RGB565 from 8 bit channels
+#define DISPLAY_RGB(r, g, b) \
+  (uint16_t)(((r) & 0xF8) << 8 | ((g) & 0xFC) << 3 | ((b) & 0xFF) >> 3)
+
+void display_fill_rect(int x, int y, int w, int h, uint16_t colour);
+
+// w pixels right from x, y
+void display_hline(int x, int y, int w, uint16_t colour);
+
+// h pixels down from x, y
+void display_vline(int x, int y, int h, uint16_t colour);
+
+// draw a w x h picture of little endian RGB565 pixels, its rows stride
+// bytes apart, with its top left at x, y
+void display_blit(int x, int y, int w, int h, const uint8_t *pixels, int stride);
+
+// draw text in the font from display_font.h over background, a newline
+// starting another line below x. characters the font lacks are drawn as '?'.
+// returns the x after the last character
+int display_text(int x, int y, const char *text, uint16_t colour, uint16_t background);
+
+#endif
@@ -0,0 +1,307 @@
+#include "display_queue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "pixel_convert.h"
+
+// largest draw, in 18 bit colour
+#define SPLIT_BUFFER_SIZE (DISPLAY_PIXEL_COUNT * 3)
+// times the owner yields to a producer still filling the next slot before
+// sleeping instead, which lets producers of a lower priority run
+#define FILL_WAIT_YIELDS 16
+#define FILL_WAIT_US 50
+
+static uint64_t enqueue(display_t *display, display_op op);
+static int dequeue(display_t *display, display_op *op);
+static void *owner_main(void *display_ptr);
+static int next_ready(display_t *display);
+static void finish(display_t *display, int count);
+static void run_op(display_t *display, display_op *op);
+static void record_draw(display_t *display, display_op *op);
+static void send_batch(display_t *display);
+
+
+/// ---- Api Implementation ----
+
+
+display_t *display_start(int panel) {
+  display_t *display = malloc(sizeof(*display));
+  uint8_t *split = malloc(SPLIT_BUFFER_SIZE);
+  if (display == NULL || split == NULL) {
+    fprintf(stderr, "Failed to allocate display queue\n");
+    free(display);
+    free(split);
+    return NULL;
+  }
+  display->panel = panel;
+  display->split = split;
+  display_list_init(&display->batch);
+  display->batch_count = 0;
+  for (int i = 0; i < DISPLAY_QUEUE_SIZE; i++)
+    atomic_init(&display->cells[i].sequence, i);
+  atomic_init(&display->tail, 0);
+  display->head = 0;
+  atomic_init(&display->done, 0);
+  atomic_init(&display->stop, 0);
+  atomic_init(&display->waiters, 0);
+  if (sem_init(&display->queued, 0, 0) == -1) {
+    fprintf(stderr, "Failed to create display queue semaphore: %s\n", strerror(errno));
+    free(split);
+    free(display);
+    return NULL;
+  }
+  pthread_mutex_init(&display->mutex, NULL);
+  pthread_cond_init(&display->progress, NULL);
+  int failed = pthread_create(&display->thread, NULL, owner_main, display);
+  if (failed) {
+    fprintf(stderr, "failed to open panel %d owner thread! %s\n", panel, strerror(failed));
+    sem_destroy(&display->queued);
+    pthread_cond_destroy(&display->progress);
+    pthread_mutex_destroy(&display->mutex);
+    display_list_free(&display->batch);
+    free(split);
+    free(display);
+    return NULL;
+  }
+  return display;
+}
+
+void display_stop(display_t *display) {
+  atomic_store(&display->stop, 1);
+  sem_post(&display->queued);
+  pthread_join(display->thread, NULL);
+  sem_destroy(&display->queued);
+  pthread_cond_destroy(&display->progress);
+  pthread_mutex_destroy(&display->mutex);
+  display_list_free(&display->batch);
+  free(display->split);
+  free(display);
+}
+
+uint64_t display_queue_draw(display_t *display, uint16_t x, uint16_t y, uint16_t w,
+                            uint16_t h, uint8_t *data, unsigned int size,
+                            enum display_colour_format format,
+                            enum display_draw_flags flags) {
+  display_op op = {DISPLAY_OP_DRAW, x, y, w, h, data, 0, size, format, flags, 0};
+  return enqueue(display, op);
+}
+
+uint64_t display_queue_draw_borrowed(display_t *display, uint16_t x, uint16_t y,
+                                     uint16_t w, uint16_t h, const uint8_t *data,
+                                     unsigned int size, enum display_colour_format format,
+                                     enum display_draw_flags flags) {
+  display_op op = {DISPLAY_OP_DRAW, x, y, w, h, (uint8_t *)data, 1, size, format,
+                   flags, 0};
+  return enqueue(display, op);
+}
+
+uint64_t display_queue_scroll(display_t *display, int lines) {
+  display_op op = {.kind = DISPLAY_OP_SCROLL, .value = lines};
+  return enqueue(display, op);
+}
+
+uint64_t display_queue_sleep(display_t *display, enum display_option option) {
+  display_op op = {.kind = DISPLAY_OP_SLEEP, .value = option};
+  return enqueue(display, op);
+}
+
+uint64_t display_queue_brightness(display_t *display, unsigned int brightness) {
+  display_op op = {.kind = DISPLAY_OP_BRIGHTNESS, .value = brightness};
+  return enqueue(display, op);
+}
+
+void display_wait(display_t *display, uint64_t ticket) {
+  if (atomic_load(&display->done) >= ticket)
+    return;
+  // counted before done is checked again, so the owner either sees a
+  // waiter and signals or finished early enough for the check to see it
+  atomic_fetch_add(&display->waiters, 1);
+  pthread_mutex_lock(&display->mutex);
+  while (atomic_load(&display->done) < ticket)
+    pthread_cond_wait(&display->progress, &display->mutex);
+  pthread_mutex_unlock(&display->mutex);
+  atomic_fetch_sub(&display->waiters, 1);
+}
+
+
+/// ---- Helper Definitions ----
+
+
+// each slot's sequence starts at its index. a producer that claims
+// position p fills slot p % size once its sequence is p, then sets it to
+// p + 1 for the owner. the owner empties it and sets it to p + size,
+// ready for the producer claiming the same slot on the next pass
+static uint64_t enqueue(display_t *display, display_op op) {
+  uint64_t position = atomic_load_explicit(&display->tail, memory_order_relaxed);
+  display_queue_cell *cell;
+  while (1) {
+    cell = &display->cells[position & (DISPLAY_QUEUE_SIZE - 1)];
+    uint64_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    int64_t lag = (int64_t)(sequence - position);
+    if (lag == 0) {
+      if (atomic_compare_exchange_weak_explicit(&display->tail, &position, position + 1,
+                                                memory_order_relaxed, memory_order_relaxed))
+        break;
+    } else if (lag < 0) {
+      // full, the owner is a whole ring behind
+      sched_yield();
+      position = atomic_load_explicit(&display->tail, memory_order_relaxed);
+    } else {
+      // another producer claimed it first
+      position = atomic_load_explicit(&display->tail, memory_order_relaxed);
+    }
+  }
+  cell->op = op;
+  atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+  sem_post(&display->queued);
+  return position + 1;
+}
+
+// returns 0 when nothing is ready
+static int dequeue(display_t *display, display_op *op) {
+  display_queue_cell *cell = &display->cells[display->head & (DISPLAY_QUEUE_SIZE - 1)];
+  uint64_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+  if (sequence != display->head + 1)
+    return 0;
+  *op = cell->op;
+  atomic_store_explicit(&cell->sequence, display->head + DISPLAY_QUEUE_SIZE,
+                        memory_order_release);
+  display->head++;
+  return 1;
+}
+
+static void *owner_main(void *display_ptr) {
+  display_t *display = display_ptr;
+  display_select_panel(display->panel);
+  while (1) {
+    while (sem_wait(&display->queued) == -1 && errno == EINTR)
+      ;
+    // every post but display_stop's follows a slot being filled, though
+    // not always the next one when producers finish out of order. then
+    // the next one has been claimed and is being filled
+    display_op op;
+    int ready = dequeue(display, &op);
+    for (int i = 0; !ready && display->head != atomic_load(&display->tail); i++) {
+      if (i < FILL_WAIT_YIELDS)
+        sched_yield();
+      else
+        usleep(FILL_WAIT_US);
+      ready = dequeue(display, &op);
+    }
+    // nothing claimed, the post was display_stop's
+    if (!ready) {
+      if (atomic_load(&display->stop))
+        break;
+      continue;
+    }
+    if (op.kind == DISPLAY_OP_DRAW) {
+      record_draw(display, &op);
+      // the rest of a frame already queued goes out with it in one list
+      if ((op.flags & DONT_FLUSH_DRAW) && display->batch_count < DISPLAY_QUEUE_SIZE
+          && next_ready(display))
+        continue;
+      send_batch(display);
+      continue;
+    }
+    send_batch(display);
+    run_op(display, &op);
+    finish(display, 1);
+  }
+  return NULL;
+}
+
+// whether the owner can dequeue again straight away
+static int next_ready(display_t *display) {
+  display_queue_cell *cell = &display->cells[display->head & (DISPLAY_QUEUE_SIZE - 1)];
+  return atomic_load_explicit(&cell->sequence, memory_order_acquire) == display->head + 1;
+}
+
+static void finish(display_t *display, int count) {
+  atomic_fetch_add(&display->done, count);
+  if (atomic_load(&display->waiters) > 0) {
+    pthread_mutex_lock(&display->mutex);
+    pthread_cond_broadcast(&display->progress);
+    pthread_mutex_unlock(&display->mutex);
+  }
+}
+
+static void run_op(display_t *display, display_op *op) {
+  display_lock();
+  switch (op->kind) {
+  case DISPLAY_OP_DRAW:
+    // batched up by owner_main instead
+    break;
+  case DISPLAY_OP_SCROLL:
+    display_scroll(op->value);
+    break;
+  case DISPLAY_OP_SLEEP:
+    display_sleep(op->value);
+    break;
+  case DISPLAY_OP_BRIGHTNESS:
+    display_brightness(op->value);
+    break;
+  }
+  display_unlock();
+}
+
+// add a draw to the batch, splitting areas over where the scrolled memory
+// wraps in two. draws that can't be recorded are dropped
+static void record_draw(display_t *display, display_op *op) {
+  display_list *batch = &display->batch;
+  display->batch_data[display->batch_count++] = op->borrowed ? NULL : op->data;
+  display_list_colour_format(batch, op->format);
+  int along_x = display_scroll_along_x();
+  int split = display_scroll_split();
+  int start = along_x ? op->x : op->y;
+  int length = along_x ? op->w : op->h;
+  if (split <= start || split >= start + length) {
+    display_list_draw_borrowed(batch, op->x, op->y, op->w, op->h, op->data, op->size,
+                               op->flags);
+    return;
+  }
+  int row_bytes = pixel_panel_row_bytes(op->format, op->w);
+  if (!along_x) {
+    // rows are whole, so each part is a run of them
+    int rows = split - op->y;
+    display_list_draw_borrowed(batch, op->x, op->y, op->w, rows, op->data,
+                               rows * row_bytes, DONT_FLUSH_DRAW);
+    display_list_draw_borrowed(batch, op->x, split, op->w, op->h - rows,
+                               &op->data[rows * row_bytes], (op->h - rows) * row_bytes,
+                               op->flags);
+    return;
+  }
+  // columns are split out of every row. scrolls are even, so 12 bit
+  // pixel pairs stay whole
+  int columns = split - op->x;
+  int first_bytes = pixel_panel_row_bytes(op->format, columns);
+  int second_bytes = row_bytes - first_bytes;
+  for (int y = 0; y < op->h; y++)
+    memcpy(&display->split[y * first_bytes], &op->data[y * row_bytes], first_bytes);
+  display_list_draw(batch, op->x, op->y, columns, op->h, display->split,
+                    op->h * first_bytes, DONT_FLUSH_DRAW);
+  for (int y = 0; y < op->h; y++)
+    memcpy(&display->split[y * second_bytes], &op->data[y * row_bytes + first_bytes],
+           second_bytes);
+  display_list_draw(batch, split, op->y, op->w - columns, op->h, display->split,
+                    op->h * second_bytes, op->flags);
+}
+
+// send the draws recorded so far as one list, then free their data
+static void send_batch(display_t *display) {
+  if (display->batch_count == 0)
+    return;
+  display_list_optimize(&display->batch);
+  display_lock();
+  display_list_play(&display->batch);
+  display_unlock();
+  for (int i = 0; i < display->batch_count; i++)
+    free(display->batch_data[i]);
+  display_list_clear(&display->batch);
+  finish(display, display->batch_count);
+  display->batch_count = 0;
+}
@@ -0,0 +1,118 @@
+#ifndef DISPLAY_QUEUE_H
+#define DISPLAY_QUEUE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+#include <pthread.h>
+
+#include "display.h"
+#include "display_list.h"
+
+/// A handle to one open panel, owned by a thread of its own that does all
+/// of its spi work. Any number of threads queue operations on it without
+/// locks and carry on while they are sent, one after the other in the
+/// order they were queued. Callers never wait on display_lock, so a slow
+/// operation like sleeping the panel doesn't hold up drawing threads.
+/// The queue is a bounded multi producer ring with a sequence number per
+/// slot (Vyukov's), queueing only blocks while it is full.
+/// Draws of a frame that are already queued when the owner gets to them
+/// are sent together as one optimized display list.
+/// Use the handle or the plain display_ functions for a panel, not both at
+/// once: the owner thread holds the panel's display_lock while it works.
+
+// operations queued at once, a power of two
+#define DISPLAY_QUEUE_SIZE 256
+
+enum display_op_kind {
+  DISPLAY_OP_DRAW,
+  DISPLAY_OP_SCROLL,
+  DISPLAY_OP_SLEEP,
+  DISPLAY_OP_BRIGHTNESS,
+};
+
+typedef struct display_op {
+  enum display_op_kind kind;
+  // draw area
+  uint16_t x;
+  uint16_t y;
+  uint16_t w;
+  uint16_t h;
+  // owned by the queue and freed once sent, unless borrowed
+  uint8_t *data;
+  int borrowed;
+  unsigned int size;
+  enum display_colour_format format;
+  enum display_draw_flags flags;
+  // scroll lines, sleep option or brightness
+  int value;
+} display_op;
+
+typedef struct display_queue_cell {
+  // which pass of the ring the slot is ready for, see display_queue.c
+  atomic_uint_fast64_t sequence;
+  display_op op;
+} display_queue_cell;
+
+typedef struct display_t {
+  int panel;
+  display_queue_cell cells[DISPLAY_QUEUE_SIZE];
+  // next position producers claim
+  atomic_uint_fast64_t tail;
+  // next position the owner runs, only it touches this
+  uint64_t head;
+  // operations finished, tickets up to this are done
+  atomic_uint_fast64_t done;
+  // posted once per queued operation, and by display_stop
+  sem_t queued;
+  atomic_int stop;
+  pthread_t thread;
+  // for display_wait, only used while someone is waiting
+  atomic_int waiters;
+  pthread_mutex_t mutex;
+  pthread_cond_t progress;
+  // draws over the scroll wrap are repacked here, owner only
+  uint8_t *split;
+  // draws waiting to be sent together, and their data to free after,
+  // NULL for borrowed data
+  display_list batch;
+  uint8_t *batch_data[DISPLAY_QUEUE_SIZE];
+  int batch_count;
+} display_t;
+
+// start an owner thread for panel, which display_open has opened and
+// nothing else is using. returns NULL on error
+display_t *display_start(int panel);
+
+// send everything already queued, then stop the owner thread and free the
+// handle. nothing may queue on it once this is called
+void display_stop(display_t *display);
+
+/// --- any thread ---
+/// each returns a ticket to wait for that operation with
+
+// draw w x h pixels of data at x, y in format, switching the panel to it
+// first. data must come from malloc, the queue frees it once sent.
+// areas over where the scrolled memory wraps are split in two
+uint64_t display_queue_draw(display_t *display, uint16_t x, uint16_t y, uint16_t w,
+                            uint16_t h, uint8_t *data, unsigned int size,
+                            enum display_colour_format format,
+                            enum display_draw_flags flags);
+
+// the same without handing data over, it must stay valid until the draw's
+// ticket is done
+uint64_t display_queue_draw_borrowed(display_t *display, uint16_t x, uint16_t y,
+                                     uint16_t w, uint16_t h, const uint8_t *data,
+                                     unsigned int size, enum display_colour_format format,
+                                     enum display_draw_flags flags);
+
+uint64_t display_queue_scroll(display_t *display, int lines);
+
+uint64_t display_queue_sleep(display_t *display, enum display_option option);
+
+uint64_t display_queue_brightness(display_t *display, unsigned int brightness);
+
+// block until the operation with ticket, and everything before it, is sent
+void display_wait(display_t *display, uint64_t ticket);
+
+#endif
@@ -0,0 +1,513 @@
+#include "emulator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "display_consts.h"
+
+// MADCTL bits
+#define ROW_ORDER 0x80
+#define COLUMN_ORDER 0x40
+#define EXCHANGE 0x20
+#define BGR_ORDER 0x08
+// RAM_CONTROL second parameter bit
+#define LITTLE_ENDIAN_PIXELS 0x08
+
+// command being received when none has been sent yet
+#define NO_COMMAND -1
+// parameter counts for commands that take pixels or are unknown
+#define PIXEL_STREAM -1
+#define UNKNOWN_COMMAND -2
+
+static int expected_parameters(int command);
+static void start_command(st7789_emulator *emu, uint8_t command);
+static void finish_command(st7789_emulator *emu);
+static void apply_parameters(st7789_emulator *emu);
+static void receive_pixel_byte(st7789_emulator *emu, uint8_t byte);
+static void write_pixel(st7789_emulator *emu, uint8_t r, uint8_t g, uint8_t b);
+static int pixel_group_bytes(st7789_emulator *emu);
+static void addressed_to_memory(st7789_emulator *emu, int x, int y, int *column, int *row);
+static void remember_shown(st7789_emulator *emu);
+static void flag(st7789_emulator *emu, const char *format, ...);
+
+
+/// ---- Api Implementation ----
+
+
+st7789_emulator *emulator_create() {
+  st7789_emulator *emu = calloc(1, sizeof(st7789_emulator));
+  if (emu == NULL) {
+    fprintf(stderr, "Failed to allocate emulator\n");
+    return NULL;
+  }
+  emu->memory = calloc(EMULATOR_COLUMNS * EMULATOR_ROWS, 3);
+  emu->shown = calloc(EMULATOR_COLUMNS * EMULATOR_ROWS, 3);
+  if (emu->memory == NULL || emu->shown == NULL) {
+    fprintf(stderr, "Failed to allocate emulator frame memory\n");
+    free(emu->memory);
+    free(emu->shown);
+    free(emu);
+    return NULL;
+  }
+  emu->panel_needs_invert = 1;
+  emulator_reset(emu);
+  return emu;
+}
+
+void emulator_destroy(st7789_emulator *emu) {
+  if (emu == NULL)
+    return;
+  free(emu->memory);
+  free(emu->shown);
+  free(emu);
+}
+
+void emulator_reset(st7789_emulator *emu) {
+  // register defaults after reset from the datasheet
+  emu->madctl = 0;
+  emu->colmod = 0x66;
+  emu->ram_control[0] = 0x00;
+  emu->ram_control[1] = 0xF0;
+  emu->column_start = 0;
+  emu->column_end = EMULATOR_COLUMNS - 1;
+  emu->row_start = 0;
+  emu->row_end = EMULATOR_ROWS - 1;
+  emu->partial_start = 0;
+  emu->partial_end = EMULATOR_ROWS - 1;
+  emu->scroll_top = 0;
+  emu->scroll_height = EMULATOR_ROWS;
+  emu->scroll_bottom = 0;
+  emu->scroll_start = 0;
+  emu->sleeping = 1;
+  emu->display_on = 0;
+  emu->inverted = 0;
+  emu->partial_mode = 0;
+  emu->idle_mode = 0;
+  emu->command = NO_COMMAND;
+  emu->parameter_count = 0;
+  emu->write_column = 0;
+  emu->write_row = 0;
+  emu->write_started = 0;
+  emu->pixel_byte_count = 0;
+  emu->last_level = -1;
+}
+
+void emulator_feed(st7789_emulator *emu, const uint8_t *buff, unsigned int size,
+                   enum transport_level level) {
+  if (size == 0)
+    return;
+  if ((int)level != emu->last_level) {
+    emu->frame.runs++;
+    emu->last_level = level;
+  }
+  if (level == TRANSPORT_COMMAND) {
+    for (unsigned int i = 0; i < size; i++)
+      start_command(emu, buff[i]);
+    return;
+  }
+
+  int expected = expected_parameters(emu->command);
+  if (emu->command == NO_COMMAND) {
+    flag(emu, "%u data bytes sent before any command", size);
+    return;
+  }
+  if (expected == PIXEL_STREAM) {
+    emu->frame.pixel_bytes += size;
+    for (unsigned int i = 0; i < size; i++)
+      receive_pixel_byte(emu, buff[i]);
+    return;
+  }
+  emu->frame.parameter_bytes += size;
+  for (unsigned int i = 0; i < size; i++) {
+    if (emu->parameter_count >= expected || expected == UNKNOWN_COMMAND) {
+      flag(emu, "extra parameter 0x%02x for command 0x%02x", buff[i], emu->command);
+      continue;
+    }
+    emu->parameters[emu->parameter_count++] = buff[i];
+    if (emu->parameter_count == expected)
+      apply_parameters(emu);
+  }
+}
+
+void emulator_transport_sink(void *ctx, const uint8_t *buff, unsigned int size,
+                             enum transport_level level) {
+  emulator_feed(ctx, buff, size, level);
+}
+
+void emulator_end_frame(st7789_emulator *emu) {
+  emu->total.commands += emu->frame.commands;
+  emu->total.command_bytes += emu->frame.command_bytes;
+  emu->total.parameter_bytes += emu->frame.parameter_bytes;
+  emu->total.pixel_bytes += emu->frame.pixel_bytes;
+  emu->total.pixels += emu->frame.pixels;
+  emu->total.runs += emu->frame.runs;
+  emu->last_frame = emu->frame;
+  memset(&emu->frame, 0, sizeof(emu->frame));
+  emu->pixels_since_frame = 0;
+  emu->frames++;
+}
+
+double emulator_transfer_time_s(const emulator_stats *stats, uint32_t spi_hz,
+                                double run_overhead_s) {
+  uint64_t bytes = stats->command_bytes + stats->parameter_bytes + stats->pixel_bytes;
+  return (double)bytes * 8 / spi_hz + stats->runs * run_overhead_s;
+}
+
+void emulator_screen_pixel(st7789_emulator *emu, int column, int row, uint8_t rgb[3]) {
+  if (emu->sleeping || !emu->display_on
+      || (emu->partial_mode && (row < emu->partial_start || row > emu->partial_end))) {
+    rgb[0] = rgb[1] = rgb[2] = 0;
+    return;
+  }
+  int memory_row = row;
+  int top = emu->scroll_top;
+  int height = emu->scroll_height;
+  if (height > 0 && row >= top && row < top + height)
+    memory_row = top + ((emu->scroll_start - top) + (row - top)) % height;
+  if (memory_row < 0 || memory_row >= EMULATOR_ROWS)
+    memory_row = row;
+  uint8_t *p = &emu->memory[(memory_row * EMULATOR_COLUMNS + column) * 3];
+  int invert = emu->inverted != emu->panel_needs_invert;
+  for (int i = 0; i < 3; i++) {
+    uint8_t c = invert ? ~p[i] : p[i];
+    // idle mode only shows 8 colours
+    if (emu->idle_mode)
+      c = (c & 0x80) ? 0xFF : 0x00;
+    rgb[i] = c;
+  }
+}
+
+void emulator_shown_pixel(st7789_emulator *emu, int column, int row, uint8_t rgb[3]) {
+  if (emu->has_shown && (emu->sleeping || !emu->display_on))
+    memcpy(rgb, &emu->shown[(row * EMULATOR_COLUMNS + column) * 3], 3);
+  else
+    emulator_screen_pixel(emu, column, row, rgb);
+}
+
+void emulator_addressed_pixel(st7789_emulator *emu, int x, int y, uint8_t rgb[3]) {
+  int column, row;
+  addressed_to_memory(emu, x, y, &column, &row);
+  memcpy(rgb, &emu->memory[(row * EMULATOR_COLUMNS + column) * 3], 3);
+}
+
+void emulator_addressed_size(st7789_emulator *emu, int *width, int *height) {
+  *width = (emu->madctl & EXCHANGE) ? EMULATOR_ROWS : EMULATOR_COLUMNS;
+  *height = (emu->madctl & EXCHANGE) ? EMULATOR_COLUMNS : EMULATOR_ROWS;
+}
+
+int emulator_write_ppm(st7789_emulator *emu, const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "Failed to open %s for the emulated screen\n", path);
+    return -1;
+  }
+  fprintf(f, "P6\n%d %d\n255\n", EMULATOR_COLUMNS, EMULATOR_ROWS);
+  for (int row = 0; row < EMULATOR_ROWS; row++)
+    for (int column = 0; column < EMULATOR_COLUMNS; column++) {
+      uint8_t rgb[3];
+      emulator_shown_pixel(emu, column, row, rgb);
+      fwrite(rgb, 1, 3, f);
+    }
+  fclose(f);
+  return 0;
+}
+
+void emulator_print_summary(st7789_emulator *emu, uint32_t spi_hz) {
+  emulator_stats *t = &emu->total;
+  printf("emulator: %llu frames, %llu commands, %llu command bytes, "
+         "%llu parameter bytes, %llu pixel bytes\n",
+         (unsigned long long)emu->frames, (unsigned long long)t->commands,
+         (unsigned long long)t->command_bytes, (unsigned long long)t->parameter_bytes,
+         (unsigned long long)t->pixel_bytes);
+  if (emu->frames > 0) {
+    emulator_stats *f = &emu->last_frame;
+    printf("last frame: %llu command bytes, %llu parameter bytes, %llu pixel bytes, "
+           "%.3fms at %.1fMHz\n",
+           (unsigned long long)f->command_bytes, (unsigned long long)f->parameter_bytes,
+           (unsigned long long)f->pixel_bytes,
+           emulator_transfer_time_s(f, spi_hz, 0) * 1e3, spi_hz / 1e6);
+  }
+  printf("%d problems in the command stream\n", emu->error_count);
+  for (int i = 0; i < emu->error_count && i < EMULATOR_MAX_ERRORS; i++)
+    printf("  %s\n", emu->errors[i]);
+}
+
+
+/// ---- Helper Definitions ----
+
+
+static int expected_parameters(int command) {
+  switch (command) {
+  case NO_OPERATION:
+  case SOFTWARE_RESET:
+  case SLEEP_IN_MODE:
+  case SLEEP_OUT_MODE:
+  case PARTIAL_MODE:
+  case NORMAL_MODE:
+  case INVERT_OFF:
+  case INVERT_ON:
+  case DISPLAY_OFF:
+  case DISPLAY_ON:
+  case IDLE_MODE_OFF:
+  case IDLE_MODE_ON:
+    return 0;
+  case MEMORY_ACCESS_CONTROL:
+  case COLOUR_FORMAT_SET:
+  case DISPLAY_BRIGHTNESS_CONTROL:
+    return 1;
+  case RAM_CONTROL:
+  case VERTICAL_SCROLL_START:
+    return 2;
+  case COLUMN_ADDRESS_SET:
+  case ROW_ADDRESS_SET:
+  case PARTIAL_AREA_SET:
+    return 4;
+  case VERTICAL_SCROLL_DEFINITION:
+    return 6;
+  case WRITE_RAM:
+  case WRITE_RAM_CONTINUE:
+    return PIXEL_STREAM;
+  default:
+    return UNKNOWN_COMMAND;
+  }
+}
+
+static void start_command(st7789_emulator *emu, uint8_t command) {
+  finish_command(emu);
+  emu->frame.commands++;
+  emu->frame.command_bytes++;
+  emu->command = command;
+  emu->parameter_count = 0;
+  switch (command) {
+  case NO_OPERATION:
+    // display_draw flushes with a nop, so treat it as the end of a frame
+    if (emu->pixels_since_frame)
+      emulator_end_frame(emu);
+    break;
+  case SOFTWARE_RESET:
+    remember_shown(emu);
+    emulator_reset(emu);
+    break;
+  case SLEEP_IN_MODE:
+    remember_shown(emu);
+    emu->sleeping = 1;
+    break;
+  case SLEEP_OUT_MODE:
+    emu->sleeping = 0;
+    break;
+  case PARTIAL_MODE:
+    emu->partial_mode = 1;
+    break;
+  case NORMAL_MODE:
+    emu->partial_mode = 0;
+    break;
+  case INVERT_OFF:
+    emu->inverted = 0;
+    break;
+  case INVERT_ON:
+    emu->inverted = 1;
+    break;
+  case DISPLAY_OFF:
+    remember_shown(emu);
+    emu->display_on = 0;
+    break;
+  case DISPLAY_ON:
+    emu->display_on = 1;
+    break;
+  case IDLE_MODE_OFF:
+    emu->idle_mode = 0;
+    break;
+  case IDLE_MODE_ON:
+    emu->idle_mode = 1;
+    break;
+  case WRITE_RAM:
+    emu->write_column = emu->column_start;
+    emu->write_row = emu->row_start;
+    emu->write_started = 1;
+    break;
+  case WRITE_RAM_CONTINUE:
+    if (!emu->write_started)
+      flag(emu, "write ram continue without a previous write ram");
+    emu->write_started = 1;
+    break;
+  default:
+    if (expected_parameters(command) == UNKNOWN_COMMAND)
+      flag(emu, "unknown command 0x%02x", command);
+    break;
+  }
+}
+
+// check the previous command got everything it needed
+static void finish_command(st7789_emulator *emu) {
+  if (emu->command == NO_COMMAND)
+    return;
+  int expected = expected_parameters(emu->command);
+  if (expected == PIXEL_STREAM) {
+    if (emu->pixel_byte_count != 0)
+      flag(emu, "%d bytes of an incomplete pixel left when command sent",
+           emu->pixel_byte_count);
+    emu->pixel_byte_count = 0;
+  } else if (expected > 0 && emu->parameter_count < expected) {
+    flag(emu, "command 0x%02x got %d of %d parameters",
+         emu->command, emu->parameter_count, expected);
+  }
+}
+
+static void apply_parameters(st7789_emulator *emu) {
+  uint8_t *p = emu->parameters;
+  uint16_t first = p[0] << 8 | p[1];
+  uint16_t second = p[2] << 8 | p[3];
+  int width, height;
+  emulator_addressed_size(emu, &width, &height);
+  switch (emu->command) {
+  case COLUMN_ADDRESS_SET:
+    if (first > second || second >= width)
+      flag(emu, "column range %d to %d invalid, %d columns addressable",
+           first, second, width);
+    emu->column_start = first;
+    emu->column_end = second;
+    break;
+  case ROW_ADDRESS_SET:
+    if (first > second || second >= height)
+      flag(emu, "row range %d to %d invalid, %d rows addressable",
+           first, second, height);
+    emu->row_start = first;
+    emu->row_end = second;
+    break;
+  case PARTIAL_AREA_SET:
+    emu->partial_start = first;
+    emu->partial_end = second;
+    break;
+  case MEMORY_ACCESS_CONTROL:
+    emu->madctl = p[0];
+    break;
+  case COLOUR_FORMAT_SET:
+    emu->colmod = p[0];
+    if ((p[0] & 0x0F) != 0x3 && (p[0] & 0x0F) != 0x5 && (p[0] & 0x0F) != 0x6)
+      flag(emu, "unsupported colour format 0x%02x", p[0]);
+    break;
+  case RAM_CONTROL:
+    emu->ram_control[0] = p[0];
+    emu->ram_control[1] = p[1];
+    break;
+  case VERTICAL_SCROLL_DEFINITION: {
+    uint16_t bottom = p[4] << 8 | p[5];
+    if (first + second + bottom != EMULATOR_ROWS)
+      flag(emu, "scroll areas %d + %d + %d don't add up to %d rows",
+           first, second, bottom, EMULATOR_ROWS);
+    emu->scroll_top = first;
+    emu->scroll_height = second;
+    emu->scroll_bottom = bottom;
+    break;
+  }
+  case VERTICAL_SCROLL_START:
+    if (first < emu->scroll_top || first >= emu->scroll_top + emu->scroll_height)
+      flag(emu, "scroll start %d outside scroll area %d to %d", first,
+           emu->scroll_top, emu->scroll_top + emu->scroll_height - 1);
+    emu->scroll_start = first;
+    break;
+  }
+}
+
+static int pixel_group_bytes(st7789_emulator *emu) {
+  switch (emu->colmod & 0x0F) {
+  case 0x3:
+    return 3; // 2 pixels
+  case 0x5:
+    return 2;
+  default:
+    return 3;
+  }
+}
+
+static void receive_pixel_byte(st7789_emulator *emu, uint8_t byte) {
+  emu->pixel_bytes[emu->pixel_byte_count++] = byte;
+  if (emu->pixel_byte_count < pixel_group_bytes(emu))
+    return;
+  emu->pixel_byte_count = 0;
+  uint8_t *b = emu->pixel_bytes;
+  switch (emu->colmod & 0x0F) {
+  case 0x3: {
+    // RRRRGGGG BBBBRRRR GGGGBBBB
+    uint8_t c[6] = { b[0] >> 4, b[0] & 0xF, b[1] >> 4, b[1] & 0xF, b[2] >> 4, b[2] & 0xF };
+    write_pixel(emu, c[0] * 17, c[1] * 17, c[2] * 17);
+    write_pixel(emu, c[3] * 17, c[4] * 17, c[5] * 17);
+    break;
+  }
+  case 0x5: {
+    uint16_t p = (emu->ram_control[1] & LITTLE_ENDIAN_PIXELS)
+      ? (b[1] << 8 | b[0]) : (b[0] << 8 | b[1]);
+    uint8_t r = p >> 11, g = (p >> 5) & 0x3F, bl = p & 0x1F;
+    write_pixel(emu, r << 3 | r >> 2, g << 2 | g >> 4, bl << 3 | bl >> 2);
+    break;
+  }
+  default:
+    // 6 bits per channel in the top of each byte
+    write_pixel(emu, (b[0] & 0xFC) | b[0] >> 6, (b[1] & 0xFC) | b[1] >> 6,
+                (b[2] & 0xFC) | b[2] >> 6);
+    break;
+  }
+}
+
+static void write_pixel(st7789_emulator *emu, uint8_t r, uint8_t g, uint8_t b) {
+  if (emu->sleeping && emu->frame.pixels == 0)
+    flag(emu, "pixels written while asleep");
+  if (emu->write_row > emu->row_end) {
+    emu->write_row = emu->row_start;
+    flag(emu, "pixels written past the end of the draw area, wrapped to the start");
+  }
+  int width, height;
+  emulator_addressed_size(emu, &width, &height);
+  if (emu->write_column < width && emu->write_row < height) {
+    int column, row;
+    addressed_to_memory(emu, emu->write_column, emu->write_row, &column, &row);
+    uint8_t *p = &emu->memory[(row * EMULATOR_COLUMNS + column) * 3];
+    p[0] = (emu->madctl & BGR_ORDER) ? b : r;
+    p[1] = g;
+    p[2] = (emu->madctl & BGR_ORDER) ? r : b;
+  }
+  emu->frame.pixels++;
+  emu->pixels_since_frame = 1;
+
+  if (++emu->write_column > emu->column_end) {
+    emu->write_column = emu->column_start;
+    emu->write_row++;
+  }
+}
+
+static void addressed_to_memory(st7789_emulator *emu, int x, int y, int *column, int *row) {
+  int c = x, r = y;
+  if (emu->madctl & EXCHANGE) {
+    c = y;
+    r = x;
+  }
+  if (emu->madctl & COLUMN_ORDER)
+    c = EMULATOR_COLUMNS - 1 - c;
+  if (emu->madctl & ROW_ORDER)
+    r = EMULATOR_ROWS - 1 - r;
+  *column = c;
+  *row = r;
+}
+
+// keep the screen before it goes blank, so it can still be written out
+static void remember_shown(st7789_emulator *emu) {
+  if (emu->sleeping || !emu->display_on)
+    return;
+  for (int row = 0; row < EMULATOR_ROWS; row++)
+    for (int column = 0; column < EMULATOR_COLUMNS; column++)
+      emulator_screen_pixel(emu, column, row,
+                            &emu->shown[(row * EMULATOR_COLUMNS + column) * 3]);
+  emu->has_shown = 1;
+}
+
+static void flag(st7789_emulator *emu, const char *format, ...) {
+  if (emu->error_count < EMULATOR_MAX_ERRORS) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(emu->errors[emu->error_count], EMULATOR_ERROR_LENGTH, format, args);
+    va_end(args);
+  }
+  emu->error_count++;
+}
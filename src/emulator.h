@@ -0,0 +1,123 @@
+#ifndef DISPLAY_EMULATOR_H
+#define DISPLAY_EMULATOR_H
+
+#include <stdint.h>
+
+#include "transport.h"
+
+/// Software model of the ST7789 controller.
+/// Feed it the command and data stream display.c sends (ie as the memory
+/// transport's sink) and it keeps an emulated frame memory, counts the
+/// traffic of each frame and flags sequences the controller would reject
+/// or misinterpret. Timing requirements (sleep, reset) are not modelled.
+
+// frame memory size, in the panel's native portrait orientation
+#define EMULATOR_COLUMNS 240
+#define EMULATOR_ROWS 320
+// problems past this many are counted but their messages dropped
+#define EMULATOR_MAX_ERRORS 16
+#define EMULATOR_ERROR_LENGTH 96
+
+typedef struct emulator_stats {
+  uint64_t commands;
+  uint64_t command_bytes;
+  uint64_t parameter_bytes;
+  uint64_t pixel_bytes;
+  uint64_t pixels;
+  // changes between command and data, each needs a separate transfer
+  uint64_t runs;
+} emulator_stats;
+
+typedef struct st7789_emulator {
+  // frame memory, 8 bits per channel rgb
+  uint8_t *memory;
+
+  // registers
+  uint8_t madctl;
+  uint8_t colmod;
+  uint8_t ram_control[2];
+  uint16_t column_start, column_end;
+  uint16_t row_start, row_end;
+  uint16_t partial_start, partial_end;
+  uint16_t scroll_top, scroll_height, scroll_bottom;
+  uint16_t scroll_start;
+  int sleeping;
+  int display_on;
+  int inverted;
+  int partial_mode;
+  int idle_mode;
+  // ips panels like the adafruit board show true colours when inverted
+  int panel_needs_invert;
+
+  // command being received
+  int command;
+  uint8_t parameters[8];
+  int parameter_count;
+  // memory write position, in addressed (not physical) coordinates
+  int write_column, write_row;
+  int write_started;
+  // bytes of an incomplete pixel group
+  uint8_t pixel_bytes[3];
+  int pixel_byte_count;
+  int last_level;
+  int pixels_since_frame;
+
+  emulator_stats frame;
+  emulator_stats last_frame;
+  emulator_stats total;
+  uint64_t frames;
+
+  // the screen as last shown before sleep, display off or reset blanked it,
+  // 8 bits per channel rgb
+  uint8_t *shown;
+  int has_shown;
+
+  char errors[EMULATOR_MAX_ERRORS][EMULATOR_ERROR_LENGTH];
+  int error_count;
+} st7789_emulator;
+
+// returns NULL on error
+st7789_emulator *emulator_create();
+
+void emulator_destroy(st7789_emulator *emu);
+
+// state after a hardware reset, statistics are kept
+void emulator_reset(st7789_emulator *emu);
+
+void emulator_feed(st7789_emulator *emu, const uint8_t *buff, unsigned int size,
+                   enum transport_level level);
+
+// matches memory_transport_options.sink, ctx is the emulator
+void emulator_transport_sink(void *ctx, const uint8_t *buff, unsigned int size,
+                             enum transport_level level);
+
+// finish counting the current frame, also done when a NO_OPERATION
+// follows pixel writes as display_draw does when flushing
+void emulator_end_frame(st7789_emulator *emu);
+
+// time the frame's bytes take at the given spi clock,
+// plus run_overhead_s for every command/data run
+double emulator_transfer_time_s(const emulator_stats *stats, uint32_t spi_hz,
+                                double run_overhead_s);
+
+// colour the panel shows at a physical position, after scrolling, partial mode,
+// inversion and display off are applied
+void emulator_screen_pixel(st7789_emulator *emu, int column, int row, uint8_t rgb[3]);
+
+// colour in frame memory at an address in the current MADCTL orientation,
+// ie what was drawn there with display_set_draw_area and display_draw
+void emulator_addressed_pixel(st7789_emulator *emu, int x, int y, uint8_t rgb[3]);
+
+// width and height of the address space in the current orientation
+void emulator_addressed_size(st7789_emulator *emu, int *width, int *height);
+
+// what the panel shows, or while it is blank what it showed last before
+// sleep, display off or reset blanked it, ie after a program shut it down
+void emulator_shown_pixel(st7789_emulator *emu, int column, int row, uint8_t rgb[3]);
+
+// write emulator_shown_pixel's picture to a binary ppm image, returns -1 on error
+int emulator_write_ppm(st7789_emulator *emu, const char *path);
+
+void emulator_print_summary(st7789_emulator *emu, uint32_t spi_hz);
+
+#endif
@@ -0,0 +1,187 @@
+#include "fb_capture.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <linux/fb.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "time.h"
+
+#define FRAME_PIXEL_BYTES 2
+// how long the panning offset is reused before asking the driver again
+#define PAN_CHECK_MS 100
+
+static size_t visible_offset(fb_capture *fb);
+static int open_raw_file(fb_capture *fb, int frame_width, int frame_height);
+static int screen_format(struct fb_var_screeninfo *var, enum pixel_format *format);
+static int is_888(struct fb_var_screeninfo *var);
+
+
+/// ---- Api Implementation ----
+
+
+int fb_capture_open(fb_capture *fb, const char *path, int frame_width,
+                    int frame_height) {
+  fb->fd = open(path, O_RDONLY);
+  if (fb->fd < 0) {
+    fprintf(stderr, "Failed to open framebuffer, %s\n", strerror(errno));
+    return -1;
+  }
+
+  struct fb_var_screeninfo var;
+  struct fb_fix_screeninfo fix;
+  fb->raw = 0;
+  struct stat file;
+  if (fstat(fb->fd, &file) == 0 && S_ISREG(file.st_mode))
+    return open_raw_file(fb, frame_width, frame_height);
+  if (ioctl(fb->fd, FBIOGET_VSCREENINFO, &var) == -1
+      || ioctl(fb->fd, FBIOGET_FSCREENINFO, &fix) == -1) {
+    fprintf(stderr, "Failed to get framebuffer info, %s\n", strerror(errno));
+    close(fb->fd);
+    return -1;
+  }
+  if (screen_format(&var, &fb->format) == -1) {
+    fprintf(stderr, "framebuffer has unsupported format, %d bits per pixel red at %d\n",
+            var.bits_per_pixel, var.red.offset);
+    close(fb->fd);
+    return -1;
+  }
+  fb->width = var.xres;
+  fb->height = var.yres;
+  fb->stride = fix.line_length;
+  fb->map_size = fix.smem_len;
+  fb->frame_width = frame_width;
+  fb->frame_height = frame_height;
+  fb->visible = 0;
+  fb->visible_checked_ns = 0;
+
+  fb->map = mmap(0, fb->map_size, PROT_READ, MAP_SHARED, fb->fd, 0);
+  if (fb->map == MAP_FAILED) {
+    fprintf(stderr, "Failed to map screen data %s\n", strerror(errno));
+    close(fb->fd);
+    return -1;
+  }
+  return 0;
+}
+
+void fb_capture_close(fb_capture *fb) {
+  munmap(fb->map, fb->map_size);
+  close(fb->fd);
+}
+
+const uint8_t *fb_capture_frame(fb_capture *fb, uint8_t *frame, int *stride) {
+  const uint8_t *visible = &fb->map[visible_offset(fb)];
+  if (fb->format == PIXEL_FORMAT_RGB565
+      && fb->width >= fb->frame_width && fb->height >= fb->frame_height) {
+    *stride = fb->stride;
+    return visible;
+  }
+  int width = fb->width < fb->frame_width ? fb->width : fb->frame_width;
+  int height = fb->height < fb->frame_height ? fb->height : fb->frame_height;
+  int row_bytes = fb->frame_width * FRAME_PIXEL_BYTES;
+  int copy_bytes = width * FRAME_PIXEL_BYTES;
+  pixel_convert(frame, row_bytes, COLOUR_FORMAT_16_BIT, 1, visible, fb->stride,
+                fb->format, width, height);
+  // frame may hold anything, so the padding is cleared every time
+  if (copy_bytes < row_bytes)
+    for (int y = 0; y < height; y++)
+      memset(&frame[y * row_bytes + copy_bytes], 0, row_bytes - copy_bytes);
+  memset(&frame[height * row_bytes], 0, (size_t)(fb->frame_height - height) * row_bytes);
+  *stride = row_bytes;
+  return frame;
+}
+
+const uint8_t *fb_capture_source(fb_capture *fb, int *stride) {
+  *stride = fb->stride;
+  return &fb->map[visible_offset(fb)];
+}
+
+
+/// ---- Helper Definitions ----
+
+
+// start of the panned visible area in the mapping. the driver is only
+// asked every PAN_CHECK_MS rather than on every frame
+static size_t visible_offset(fb_capture *fb) {
+  if (fb->raw)
+    return 0;
+  uint64_t now = time_monotonic_ns();
+  if (now - fb->visible_checked_ns < PAN_CHECK_MS * 1000000ull)
+    return fb->visible;
+  fb->visible_checked_ns = now;
+  fb->visible = 0;
+  struct fb_var_screeninfo var;
+  if (ioctl(fb->fd, FBIOGET_VSCREENINFO, &var) == -1)
+    return 0;
+  int pixel_bytes = pixel_format_bytes(fb->format);
+  size_t offset = (size_t)var.yoffset * fb->stride + var.xoffset * pixel_bytes;
+  size_t last = offset + (size_t)(fb->height - 1) * fb->stride + fb->width * pixel_bytes;
+  if (last <= fb->map_size)
+    fb->visible = offset;
+  return fb->visible;
+}
+
+static int screen_format(struct fb_var_screeninfo *var, enum pixel_format *format) {
+  switch (var->bits_per_pixel) {
+  case 16:
+    // 5-6-5 only, 16 bit also covers 1555 and 4444 layouts
+    if (var->red.length != 5 || var->green.length != 6 || var->green.offset != 5
+        || var->blue.length != 5)
+      return -1;
+    if (var->red.offset == 11 && var->blue.offset == 0)
+      *format = PIXEL_FORMAT_RGB565;
+    else if (var->red.offset == 0 && var->blue.offset == 11)
+      *format = PIXEL_FORMAT_BGR565;
+    else
+      return -1;
+    return 0;
+  case 24:
+    *format = PIXEL_FORMAT_RGB888;
+    return is_888(var) ? 0 : -1;
+  case 32:
+    // any alpha is ignored
+    *format = PIXEL_FORMAT_XRGB8888;
+    return is_888(var) ? 0 : -1;
+  default:
+    return -1;
+  }
+}
+
+// 8 bits each of red, green and blue from the top down
+static int is_888(struct fb_var_screeninfo *var) {
+  return var->red.length == 8 && var->red.offset == 16
+    && var->green.length == 8 && var->green.offset == 8
+    && var->blue.length == 8 && var->blue.offset == 0;
+}
+
+// a regular file holds an unpadded RGB565 frame and nothing else
+static int open_raw_file(fb_capture *fb, int frame_width, int frame_height) {
+  fb->raw = 1;
+  fb->format = PIXEL_FORMAT_RGB565;
+  fb->width = frame_width;
+  fb->height = frame_height;
+  fb->stride = frame_width * FRAME_PIXEL_BYTES;
+  fb->map_size = (size_t)fb->stride * frame_height;
+  fb->frame_width = frame_width;
+  fb->frame_height = frame_height;
+  struct stat file;
+  if (fstat(fb->fd, &file) == -1 || (size_t)file.st_size < fb->map_size) {
+    fprintf(stderr, "framebuffer file is smaller than a %d x %d RGB565 frame\n",
+            frame_width, frame_height);
+    close(fb->fd);
+    return -1;
+  }
+  fb->map = mmap(0, fb->map_size, PROT_READ, MAP_SHARED, fb->fd, 0);
+  if (fb->map == MAP_FAILED) {
+    fprintf(stderr, "Failed to map framebuffer file %s\n", strerror(errno));
+    close(fb->fd);
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef DISPLAY_FB_CAPTURE_H
+#define DISPLAY_FB_CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pixel_convert.h"
+
+/// Reads frames straight out of a mapped linux framebuffer.
+/// The visible area follows panning (x/y offsets), checked every 100ms,
+/// and can have a padded stride. RGB565 framebuffers at least as big as the frame are read in
+/// place, cropped to the top left. Smaller ones and other pixel formats
+/// are converted into a padded RGB565 frame.
+/// A regular file in place of the device is read as a raw RGB565 frame
+/// of the wanted size, for running without a framebuffer.
+/// fb_capture_source gives the whole visible area instead, as it is,
+/// for scaling down to the frame size.
+
+typedef struct fb_capture {
+  int fd;
+  uint8_t *map;
+  size_t map_size;
+  // bytes between rows
+  int stride;
+  // framebuffer resolution
+  int width;
+  int height;
+  // frame size wanted
+  int frame_width;
+  int frame_height;
+  enum pixel_format format;
+  // reading a regular file rather than a framebuffer device
+  int raw;
+  // offset of the panned visible area in the map, and when it was last
+  // read from the driver
+  size_t visible;
+  uint64_t visible_checked_ns;
+} fb_capture;
+
+// map the framebuffer at path for RGB565 frames of the given size,
+// returns -1 on error
+int fb_capture_open(fb_capture *fb, const char *path, int frame_width,
+                    int frame_height);
+
+void fb_capture_close(fb_capture *fb);
+
+// the current frame, rows *stride bytes apart. points into the mapping
+// when possible, so can change while being read. Otherwise it is converted
+// into frame, which must hold frame_width x frame_height pixels
+const uint8_t *fb_capture_frame(fb_capture *fb, uint8_t *frame, int *stride);
+
+// the whole visible area, fb->width x fb->height pixels in fb->format with
+// rows *stride bytes apart. points into the mapping, so can change while read
+const uint8_t *fb_capture_source(fb_capture *fb, int *stride);
+
+#endif
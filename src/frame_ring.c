@@ -0,0 +1,118 @@
+#include "frame_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define FRAME_RING_FRESH 0x80000000u
+
+
+/// ---- Api Implementation ----
+
+
+int frame_ring_init(frame_ring *ring, unsigned int frame_bytes) {
+  for (int i = 0; i < FRAME_RING_SLOTS; i++) {
+    ring->slots[i].data = calloc(frame_bytes, 1);
+    ring->slots[i].full_redraw = 1;
+    ring->slots[i].hint_count = FRAME_HINTS_ALL;
+    ring->slots[i].source = NULL;
+    if (ring->slots[i].data == NULL) {
+      fprintf(stderr, "Failed to allocate frame ring slots of %u bytes\n", frame_bytes);
+      for (int j = 0; j < i; j++)
+        free(ring->slots[j].data);
+      return -1;
+    }
+  }
+  ring->filling = 0;
+  atomic_init(&ring->waiting, 1);
+  ring->sending = 2;
+  atomic_init(&ring->dropped, 0);
+  atomic_init(&ring->woken, 0);
+  if (sem_init(&ring->published, 0, 0) == -1) {
+    fprintf(stderr, "Failed to create frame ring semaphore: %s\n", strerror(errno));
+    for (int i = 0; i < FRAME_RING_SLOTS; i++)
+      free(ring->slots[i].data);
+    return -1;
+  }
+  return 0;
+}
+
+void frame_ring_free(frame_ring *ring) {
+  for (int i = 0; i < FRAME_RING_SLOTS; i++) {
+    free(ring->slots[i].data);
+    ring->slots[i].data = NULL;
+  }
+  sem_destroy(&ring->published);
+}
+
+frame_t *frame_ring_filling(frame_ring *ring) {
+  return &ring->slots[ring->filling];
+}
+
+void frame_add_hint(frame_t *frame, damage_rect rect) {
+  if (frame->hint_count == FRAME_HINTS_ALL)
+    return;
+  if (frame->hint_count == FRAME_MAX_HINTS) {
+    frame->hint_count = FRAME_HINTS_ALL;
+    return;
+  }
+  frame->hints[frame->hint_count++] = rect;
+}
+
+int frame_ring_publish(frame_ring *ring) {
+  unsigned int previous = atomic_exchange_explicit(
+      &ring->waiting, ring->filling | FRAME_RING_FRESH, memory_order_acq_rel);
+  ring->filling = previous & ~FRAME_RING_FRESH;
+  int dropped = (previous & FRAME_RING_FRESH) != 0;
+  if (dropped)
+    atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+  else {
+    // the transmit thread is done with this slot
+    ring->slots[ring->filling].full_redraw = 0;
+    ring->slots[ring->filling].hint_count = 0;
+  }
+  sem_post(&ring->published);
+  return dropped;
+}
+
+frame_t *frame_ring_take(frame_ring *ring) {
+  // only the capture thread can change the waiting slot after this,
+  // and it only ever replaces it with another fresh one
+  if (!(atomic_load_explicit(&ring->waiting, memory_order_acquire) & FRAME_RING_FRESH))
+    return NULL;
+  unsigned int taken = atomic_exchange_explicit(
+      &ring->waiting, ring->sending, memory_order_acq_rel);
+  ring->sending = taken & ~FRAME_RING_FRESH;
+  return &ring->slots[ring->sending];
+}
+
+frame_t *frame_ring_wait(frame_ring *ring, unsigned int timeout_ms) {
+  struct timespec until;
+  clock_gettime(CLOCK_REALTIME, &until);
+  until.tv_sec += timeout_ms / 1000;
+  until.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+  if (until.tv_nsec >= 1000000000) {
+    until.tv_sec++;
+    until.tv_nsec -= 1000000000;
+  }
+  // clear posts for frames that will be taken now, any published after
+  // this leave a post behind so the wait below can't miss them
+  while (sem_trywait(&ring->published) == 0)
+    ;
+  frame_t *frame = frame_ring_take(ring);
+  if (frame != NULL || atomic_exchange(&ring->woken, 0))
+    return frame;
+  while (sem_timedwait(&ring->published, &until) == -1)
+    if (errno != EINTR)
+      return NULL;
+  atomic_store(&ring->woken, 0);
+  // NULL if woken without a frame
+  return frame_ring_take(ring);
+}
+
+void frame_ring_wake(frame_ring *ring) {
+  atomic_store(&ring->woken, 1);
+  sem_post(&ring->published);
+}
@@ -0,0 +1,83 @@
+#ifndef DISPLAY_FRAME_RING_H
+#define DISPLAY_FRAME_RING_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+
+#include "damage.h"
+
+/// Passes frames from one capture thread to one transmit thread without locks.
+/// Only the newest frame is kept, when transmitting is slower than capturing
+/// the frames that were never taken are dropped rather than queued up.
+/// Three preallocated slots: one being filled, one being sent, one waiting.
+
+#define FRAME_RING_SLOTS 3
+// damage hints a frame holds before it is treated as entirely changed
+#define FRAME_MAX_HINTS 16
+// hint_count when any part of the frame may have changed
+#define FRAME_HINTS_ALL -1
+
+typedef struct frame_t {
+  uint8_t *data;
+  // when set pixels are read from here instead of data, ie straight out of
+  // a mapped framebuffer, with rows source_stride bytes apart
+  const uint8_t *source;
+  int source_stride;
+  // display contents should be redrawn entirely,
+  // stays set if the frame is dropped so the next one carries it
+  int full_redraw;
+  // areas that may differ from the previous frame, data outside them is
+  // stale and must not be read. kept if the frame is dropped, so the
+  // capture thread adds to them and refreshes all of them in the next frame
+  damage_rect hints[FRAME_MAX_HINTS];
+  int hint_count;
+  // when the screen was read, from time_monotonic_ns
+  uint64_t captured_ns;
+} frame_t;
+
+typedef struct frame_ring {
+  frame_t slots[FRAME_RING_SLOTS];
+  // index of the slot waiting to be taken, FRAME_RING_FRESH set if not yet taken
+  atomic_uint waiting;
+  // slot owned by the capture thread
+  unsigned int filling;
+  // slot owned by the transmit thread
+  unsigned int sending;
+  atomic_uint dropped;
+  // set by frame_ring_wake until the transmit thread wakes
+  atomic_int woken;
+  sem_t published;
+} frame_ring;
+
+// allocate slots of frame_bytes each, returns -1 on error
+int frame_ring_init(frame_ring *ring, unsigned int frame_bytes);
+
+void frame_ring_free(frame_ring *ring);
+
+/// --- capture thread ---
+
+// the slot to capture into
+frame_t *frame_ring_filling(frame_ring *ring);
+
+// mark an area of the filling frame as possibly changed
+void frame_add_hint(frame_t *frame, damage_rect rect);
+
+// make the filled slot the newest frame
+// returns 1 if the previous frame was dropped without being taken
+int frame_ring_publish(frame_ring *ring);
+
+/// --- transmit thread ---
+
+// take the newest frame, or NULL if there is no new one since the last take
+// the frame stays valid until the next take
+frame_t *frame_ring_take(frame_ring *ring);
+
+// take the newest frame, waiting up to timeout_ms for one to be published
+// returns NULL on timeout or when woken by frame_ring_wake
+frame_t *frame_ring_wait(frame_ring *ring, unsigned int timeout_ms);
+
+// wake the transmit thread if it is waiting, without publishing a frame
+void frame_ring_wake(frame_ring *ring);
+
+#endif
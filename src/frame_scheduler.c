@@ -0,0 +1,145 @@
+#include "frame_scheduler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "stats.h"
+#include "time.h"
+
+static int wait_until(frame_scheduler *scheduler, uint64_t give_up_ns);
+static void set_level(frame_scheduler *scheduler, int level);
+
+
+/// ---- Api Implementation ----
+
+
+scheduler_policy scheduler_default_policy(unsigned int max_fps) {
+  scheduler_policy policy;
+  memset(&policy, 0, sizeof(policy));
+  policy.rates[0] = max_fps;
+  policy.idle_ms[0] = 1000;
+  policy.rates[1] = max_fps < 10 ? max_fps : 10;
+  policy.idle_ms[1] = 5000;
+  policy.rates[2] = 1;
+  policy.level_count = 3;
+  return policy;
+}
+
+int scheduler_init(frame_scheduler *scheduler, scheduler_policy policy) {
+  if (policy.level_count < 1 || policy.level_count > SCHEDULER_MAX_LEVELS) {
+    fprintf(stderr, "scheduler needs 1 to %d rates, got %d\n",
+            SCHEDULER_MAX_LEVELS, policy.level_count);
+    return -1;
+  }
+  for (int i = 0; i < policy.level_count; i++)
+    if (policy.rates[i] == 0) {
+      fprintf(stderr, "scheduler rates must be above 0\n");
+      return -1;
+    }
+  scheduler->policy = policy;
+  atomic_init(&scheduler->level, 0);
+  stats_set_capture_policy(policy.rates, policy.idle_ms, policy.level_count);
+  set_level(scheduler, 0);
+  atomic_init(&scheduler->idle_since_ns, time_monotonic_ns());
+  scheduler->last_frame_ns = 0;
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  int failed = pthread_cond_init(&scheduler->changed, &attr);
+  pthread_condattr_destroy(&attr);
+  if (failed) {
+    fprintf(stderr, "Failed to create scheduler condition: %s\n", strerror(failed));
+    return -1;
+  }
+  pthread_mutex_init(&scheduler->mutex, NULL);
+  return 0;
+}
+
+void scheduler_free(frame_scheduler *scheduler) {
+  pthread_cond_destroy(&scheduler->changed);
+  pthread_mutex_destroy(&scheduler->mutex);
+}
+
+void scheduler_wait(frame_scheduler *scheduler) {
+  wait_until(scheduler, UINT64_MAX);
+}
+
+int scheduler_wait_for(frame_scheduler *scheduler, unsigned int timeout_ms) {
+  return wait_until(scheduler, time_monotonic_ns() + (uint64_t)timeout_ms * 1000000);
+}
+
+void scheduler_frame_done(frame_scheduler *scheduler, int changed) {
+  uint64_t now = time_monotonic_ns();
+  int level = atomic_load(&scheduler->level);
+  if (changed) {
+    atomic_store(&scheduler->idle_since_ns, now);
+    if (level != 0) {
+      pthread_mutex_lock(&scheduler->mutex);
+      set_level(scheduler, 0);
+      pthread_cond_broadcast(&scheduler->changed);
+      pthread_mutex_unlock(&scheduler->mutex);
+    }
+    return;
+  }
+  if (level + 1 >= scheduler->policy.level_count)
+    return;
+  uint64_t idle_ns = now - atomic_load(&scheduler->idle_since_ns);
+  if (idle_ns >= (uint64_t)scheduler->policy.idle_ms[level] * 1000000) {
+    atomic_store(&scheduler->idle_since_ns, now);
+    set_level(scheduler, level + 1);
+  }
+}
+
+unsigned int scheduler_current_rate(frame_scheduler *scheduler) {
+  return scheduler->policy.rates[atomic_load(&scheduler->level)];
+}
+
+
+/// ---- Helper Definitions ----
+
+
+// wait for the next frame to be due, or the monotonic clock to reach
+// give_up_ns. returns 1 if the frame is due
+static int wait_until(frame_scheduler *scheduler, uint64_t give_up_ns) {
+  int due_now = 0;
+  // the due time last slept until, only it is scheduled rather than
+  // moved by a change of rate or already past from a slow frame
+  uint64_t slept_until = 0;
+  uint64_t now;
+  pthread_mutex_lock(&scheduler->mutex);
+  while (1) {
+    int level = atomic_load(&scheduler->level);
+    uint64_t due = scheduler->last_frame_ns
+      + 1000000000ull / scheduler->policy.rates[level];
+    now = time_monotonic_ns();
+    if (now >= due) {
+      due_now = 1;
+      if (slept_until == due)
+        stats_record(STATS_PACING_LATENESS, now - due);
+      break;
+    }
+    if (now >= give_up_ns)
+      break;
+    uint64_t wake = due < give_up_ns ? due : give_up_ns;
+    slept_until = wake;
+    struct timespec until;
+    until.tv_sec = wake / 1000000000;
+    until.tv_nsec = wake % 1000000000;
+    // woken early when a change raises the rate, then the due time is rechecked
+    pthread_cond_timedwait(&scheduler->changed, &scheduler->mutex, &until);
+  }
+  pthread_mutex_unlock(&scheduler->mutex);
+  if (due_now)
+    scheduler->last_frame_ns = now;
+  return due_now;
+}
+
+// the rate in use is also kept in the stats
+static void set_level(frame_scheduler *scheduler, int level) {
+  atomic_store(&scheduler->level, level);
+  stats_set(STATS_CAPTURE_LEVEL, level);
+  stats_set(STATS_CAPTURE_RATE, scheduler_current_rate(scheduler));
+}
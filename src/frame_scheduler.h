@@ -0,0 +1,56 @@
+#ifndef DISPLAY_FRAME_SCHEDULER_H
+#define DISPLAY_FRAME_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/// Paces frame captures by how often the content changes.
+/// Runs at the top rate while frames change, steps down through slower
+/// idle rates as unchanged time builds up, and jumps back to the top rate
+/// (waking any wait early) as soon as a changed frame is reported.
+
+#define SCHEDULER_MAX_LEVELS 4
+
+typedef struct scheduler_policy {
+  // frames per second of each level, fastest first
+  unsigned int rates[SCHEDULER_MAX_LEVELS];
+  // how long frames must stay unchanged at a level before stepping down
+  unsigned int idle_ms[SCHEDULER_MAX_LEVELS];
+  int level_count;
+} scheduler_policy;
+
+typedef struct frame_scheduler {
+  scheduler_policy policy;
+  // index into policy.rates
+  atomic_int level;
+  // when the content last changed or the level last stepped down
+  _Atomic uint64_t idle_since_ns;
+  uint64_t last_frame_ns;
+  pthread_mutex_t mutex;
+  pthread_cond_t changed;
+} frame_scheduler;
+
+// 60 -> 10 -> 1 fps, stepping down after 1s at 60 and 5s at 10
+scheduler_policy scheduler_default_policy(unsigned int max_fps);
+
+// returns -1 on error
+int scheduler_init(frame_scheduler *scheduler, scheduler_policy policy);
+
+void scheduler_free(frame_scheduler *scheduler);
+
+// sleep until the next frame is due at the current rate
+void scheduler_wait(frame_scheduler *scheduler);
+
+// like scheduler_wait, but give up after timeout_ms so other work can be
+// done between frames. returns 1 once the frame is due, 0 on timeout
+int scheduler_wait_for(frame_scheduler *scheduler, unsigned int timeout_ms);
+
+// report whether a frame differed from the last one, can be called
+// from a different thread to the one waiting
+void scheduler_frame_done(frame_scheduler *scheduler, int changed);
+
+// frames per second currently being scheduled, also in the stats file
+unsigned int scheduler_current_rate(frame_scheduler *scheduler);
+
+#endif
@@ -1,9 +1,16 @@
 #include <stdio.h> // printf
-#include <string.h> // memset, memcpy
+#include <string.h> // memset, memcpy, strcmp
 #include <errno.h>
+#include <stdlib.h> // atoi
+#include <unistd.h> // getopt
 
 #include "display.h"
+#include "display_consts.h"
+#include "display_primitives.h"
+#include "emulator.h"
 #include "mirror.h"
+#include "realtime.h"
+#include "transport.h"
 
 #include <fcntl.h>
 #include <linux/fb.h>
@@ -27,26 +34,191 @@ void test() {
   display_brightness(MAX_BRIGHTNESS);
   display_on(DISPLAY_ENABLE);
   
-  const int size = DISPLAY_PIXEL_COUNT * 2;
-  uint8_t data[size];
-  memset(data, 0xAA, size);
-  display_set_draw_area_full();
-  display_draw(data, size, DONT_FLUSH_DRAW);
-
-  int size2 = 80 * 40 * 2;
-  display_set_draw_area(40, 40, 80, 40);
-  uint8_t data2[size2];
-  memset(data2, 0xFF, size2);
-  display_draw(data2, size2, 0);
+  int width, height;
+  display_get_size(&width, &height);
+  display_fill_rect(0, 0, width, height, 0xAAAA);
+  display_fill_rect(40, 40, 80, 40, 0xFFFF);
+  display_text(40, 88, "display test", 0xFFFF, 0xAAAA);
 }
 
-int main() {
+void usage(const char *name) {
+  fprintf(stderr, "usage: %s [-t wiringpi|spidev|memory] [-e screen.ppm] [-f fps] [-T] [-C] [-V]\n"
+          "          [-s stats.prom] [-b framebuffer] [-S box|bilinear] [-j threads]\n"
+          "          [-w columnsxrows] [-R priority] [-c capture_cpu,spi_cpu] [-J]\n"
+          "          [-r recording] [-p recording] [-P] [-u socket]\n"
+          "  -t  transport to send display data with\n"
+          "  -f  fastest capture rate, slower while the screen is unchanged\n"
+          "  -T  don't resend framebuffer areas that changed while being sent\n"
+          "  -C  keep 16 bit colour during heavy motion\n"
+          "  -V  don't use the panel's scrolling to follow scrolled frames\n"
+          "  -b  framebuffer device to mirror, or a file holding a raw RGB565 frame\n"
+          "  -S  filter shrinking screens larger than the panel with\n"
+          "  -j  threads to share each frame's pixel work between, defaults to one per core\n"
+          "  -s  rewrite a file every second with latency and throughput stats\n"
+          "  -w  drive several panels as tiles of one picture, ie 2x1 for two side by side\n"
+          "  -R  run capturing and sending SCHED_FIFO at priority (1 to %d), locked in memory\n"
+          "  -c  pin the capture and sending threads to these cores, -1 for any\n"
+          "  -J  print how late captures woke for their frames on exit\n"
+          "  -r  record every changed frame sent to a file\n"
+          "  -p  show a recording, over and over, instead of the screen\n"
+          "  -P  play the recording as fast as -f allows, not at its recorded speed\n"
+          "  -u  show apps drawing through display_client.h, connecting to socket,\n"
+          "      instead of the screen\n"
+          "  -e  emulate the display in memory, writing what it shows on exit,\n"
+          "      with -N before the extension for each panel after the first\n",
+          name, REALTIME_MAX_PRIORITY);
+}
+
+// where panel's emulated screen is written, path for the first panel
+void panel_image_path(char *buff, size_t size, const char *path, int panel) {
+  if (panel == 0) {
+    snprintf(buff, size, "%s", path);
+    return;
+  }
+  const char *dot = strrchr(path, '.');
+  if (dot == NULL || strchr(dot, '/') != NULL)
+    dot = path + strlen(path);
+  snprintf(buff, size, "%.*s-%d%s", (int)(dot - path), path, panel, dot);
+}
+
+int main(int argc, char **argv) {
+  int opt;
+  const char *emulator_image = NULL;
+  const char *transport_name = NULL;
+  mirror_options mirror = mirror_default_options();
+  while ((opt = getopt(argc, argv, "t:e:f:TCVs:b:S:j:w:R:c:Jr:p:Pu:")) != -1) {
+    switch (opt) {
+    case 'f':
+      mirror.max_fps = atoi(optarg);
+      if (mirror.max_fps == 0) {
+        fprintf(stderr, "fps must be a number above 0\n");
+        return -1;
+      }
+      break;
+    case 'e':
+      emulator_image = optarg;
+      break;
+    case 'T':
+      mirror.tear_check = 0;
+      break;
+    case 'C':
+      mirror.adaptive_depth = 0;
+      break;
+    case 'V':
+      mirror.hardware_scroll = 0;
+      break;
+    case 's':
+      mirror.stats_path = optarg;
+      break;
+    case 'b':
+      mirror.framebuffer_path = optarg;
+      break;
+    case 'S':
+      if (strcmp(optarg, scale_filter_name(SCALE_FILTER_BOX)) == 0)
+        mirror.scale_filter = SCALE_FILTER_BOX;
+      else if (strcmp(optarg, scale_filter_name(SCALE_FILTER_BILINEAR)) == 0)
+        mirror.scale_filter = SCALE_FILTER_BILINEAR;
+      else {
+        fprintf(stderr, "scale filter %s is unknown\n", optarg);
+        return -1;
+      }
+      break;
+    case 'j':
+      mirror.threads = atoi(optarg);
+      if (mirror.threads < 1) {
+        fprintf(stderr, "threads must be a number above 0\n");
+        return -1;
+      }
+      break;
+    case 'w':
+      if (sscanf(optarg, "%dx%d", &mirror.panel_columns, &mirror.panel_rows) != 2
+          || mirror.panel_columns < 1 || mirror.panel_rows < 1
+          || mirror.panel_columns * mirror.panel_rows > DISPLAY_MAX_PANELS) {
+        fprintf(stderr, "wall must be columnsxrows of at most %d panels\n",
+                DISPLAY_MAX_PANELS);
+        return -1;
+      }
+      break;
+    case 'R':
+      mirror.realtime_priority = atoi(optarg);
+      if (mirror.realtime_priority < 1 || mirror.realtime_priority > REALTIME_MAX_PRIORITY) {
+        fprintf(stderr, "realtime priority must be 1 to %d\n", REALTIME_MAX_PRIORITY);
+        return -1;
+      }
+      break;
+    case 'c':
+      if (sscanf(optarg, "%d,%d", &mirror.capture_cpu, &mirror.spi_cpu) != 2
+          || mirror.capture_cpu < -1 || mirror.spi_cpu < -1) {
+        fprintf(stderr, "cores must be capture_cpu,spi_cpu, -1 for any\n");
+        return -1;
+      }
+      break;
+    case 'J':
+      mirror.jitter_report = 1;
+      break;
+    case 'r':
+      mirror.record_path = optarg;
+      break;
+    case 'p':
+      mirror.source = MIRROR_SOURCE_REPLAY;
+      mirror.replay_path = optarg;
+      break;
+    case 'P':
+      mirror.replay_full_speed = 1;
+      break;
+    case 'u':
+      mirror.source = MIRROR_SOURCE_CLIENTS;
+      mirror.client_socket = optarg;
+      break;
+    case 't':
+      transport_name = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  int panels = mirror.panel_columns * mirror.panel_rows;
+  display_set_panel_count(panels);
+  st7789_emulator *emulators[DISPLAY_MAX_PANELS] = {NULL};
+  for (int i = 0; i < panels; i++) {
+    if (emulator_image != NULL) {
+      emulators[i] = emulator_create();
+      if (emulators[i] == NULL)
+        return -1;
+      memory_transport_options options = memory_transport_default_options();
+      options.sink = emulator_transport_sink;
+      options.sink_ctx = emulators[i];
+      display_set_panel_transport(i, memory_transport_create(options));
+    } else if (transport_name != NULL) {
+      display_transport *transport = transport_by_name(transport_name, i);
+      if (transport == NULL) {
+        fprintf(stderr, "transport %s is unknown or not built in for panel %d\n",
+                transport_name, i);
+        return -1;
+      }
+      display_set_panel_transport(i, transport);
+    }
+  }
+
   if (display_open() == -1)
     return -1;
 
   //test();
-  mirror_display();
+  mirror_display(mirror);
   
   display_close();
+  for (int i = 0; i < panels; i++) {
+    display_select_panel(i);
+    memory_transport_print_summary(display_get_transport());
+    if (emulators[i] != NULL) {
+      char path[256];
+      panel_image_path(path, sizeof(path), emulator_image, i);
+      emulator_print_summary(emulators[i], DISPLAY_SPI_FREQUENCY);
+      emulator_write_ppm(emulators[i], path);
+      emulator_destroy(emulators[i]);
+    }
+  }
   return 0;
 }
@@ -1,9 +1,26 @@
 #include "mirror.h"
 
 #include "display.h"
+#include "display_queue.h"
+#include "colour_depth.h"
+#include "client_capture.h"
+#include "cursor.h"
+#include "damage.h"
+#include "fb_capture.h"
+#include "frame_ring.h"
+#include "frame_scheduler.h"
+#include "pixel_convert.h"
+#include "realtime.h"
+#include "recording.h"
+#include "scale.h"
+#include "scroll_detect.h"
+#include "stats.h"
 #include "time.h"
+#include "x_capture.h"
+#include "x_cursor.h"
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,9 +31,6 @@
 #include <unistd.h>
 #include <signal.h>
 #include <fcntl.h>
-#include <linux/fb.h>
-#include <sys/mman.h>
-#include <sys/ioctl.h>
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
@@ -24,12 +38,29 @@
 
 #define COLOUR_BYTES 2
 
+// one panel's frame
 #define BUFF_SIZE DISPLAY_PIXEL_COUNT * COLOUR_BYTES
 
-#define FRAMES_UNTIL_MOUSE_GONE 60 * 5
+// the mouse is hidden once it stops moving for this long
+#define MOUSE_GONE_NS 5000000000ull
+// how often the pointer is read while X is captured, in between frames
+#define CURSOR_POLL_MS 8
+
+// how long the transmit thread waits for a frame, and the capture thread
+// for X damage, before checking for shutdown
+#define FRAME_WAIT_MS 100
+
+// times a framebuffer frame is resent when it changed while being sent
+#define TEAR_RESENDS 2
+
+// fewest rows converted in a band when a conversion is shared between threads
+#define CONVERT_BAND_ROWS 16
+
+// the display is scrolled to match a frame when that leaves at least
+// 1/SCROLL_MIN_SAVING of the lines along the scroll axis not needing resending
+#define SCROLL_MIN_SAVING 8
 
 #define FRAMEBUFFER_FILE "/dev/fb0"
-// pass NULL to use DISPLAY env var
 #define X_DISPLAY ":0.0"
 
 enum active_window {
@@ -39,52 +70,227 @@ enum active_window {
 };
 
 struct manager_info_t {
+  // the whole picture, over every panel
+  int width;
+  int height;
+  // panels side by side, the rest are in rows below
+  int panel_columns;
+  // opened by the manager, closed by the capture thread if capturing fails.
+  // x_lock is held to change it and while the manager uses it
   Display* display;
+  pthread_mutex_t x_lock;
   Window window;
-  enum active_window active;
-  uint8_t *framebuffer;
+  // size of the X screen, scaled down to fit the display when larger
+  int x_width;
+  int x_height;
+  const char *x_display;
+  enum mirror_source source;
+  // written by the manager, and the capture thread when X goes away
+  _Atomic enum active_window active;
+  fb_capture framebuffer;
+  // played instead of the framebuffer by MIRROR_SOURCE_REPLAY
+  replay replay;
+  int replay_full_speed;
+  // composed instead by MIRROR_SOURCE_CLIENTS
+  client_capture clients;
+  // every changed frame is written here by the transmit thread when set
+  int recording;
+  recorder recorder;
+  // recheck framebuffer frames after sending them
+  int tear_check;
+  // drop to 12 bit colour during heavy motion
+  int adaptive_depth;
+  // scroll the display to follow scrolled frames
+  int hardware_scroll;
+  // how sources larger than the display are shrunk
+  enum scale_filter scale_filter;
+  // threads sharing each frame's scaling, diffing and converting
+  work_pool pool;
+  // rewritten every second with the latency stats, NULL for none
+  const char *stats_path;
+  // fault buffers in before they're first used
+  int realtime;
+  // captured frames waiting to be sent
+  frame_ring frames;
+  // set by the transmit thread when it can't use hinted frames until
+  // it has had a whole one
+  atomic_int whole_frame_wanted;
+  // paces captures, slowing down while nothing changes
+  frame_scheduler scheduler;
+  // the mouse, drawn over frames as they're sent
+  cursor_overlay cursor;
+  // each panel's handle, everything sent while running goes through these
+  display_t *panels[DISPLAY_MAX_PANELS];
 };
 
-int map_framebuffer(uint8_t **screen_data);
-
-int close_threads = 0;
+atomic_int close_threads = 0;
 
 void *active_screen_manager(void *info_ptr);
-void* screen_renderer(void* info_ptr);
+void* screen_capturer(void* info_ptr);
+void* screen_transmitter(void* info_ptr);
+
+// an area converted in bands of rows on a pool's threads
+struct convert_job_t {
+  uint8_t *dst;
+  int dst_stride;
+  // 12 bit is dithered, 16 bit is little endian
+  enum display_colour_format dst_format;
+  const uint8_t *src;
+  int src_stride;
+  enum pixel_format src_format;
+  // where the area is on screen, which lines the dither pattern up
+  damage_rect area;
+  int bands;
+};
+void convert_shared(work_pool *pool, struct convert_job_t *job);
+void convert_band(void *job_ptr, int band, int worker);
+int open_source(struct manager_info_t *info, mirror_options *options);
+void close_source(struct manager_info_t *info);
+
+mirror_options mirror_default_options() {
+  mirror_options options;
+  options.max_fps = 60;
+  options.tear_check = 1;
+  options.adaptive_depth = 1;
+  options.hardware_scroll = 1;
+  options.scale_filter = SCALE_FILTER_BOX;
+  // one per core
+  options.threads = sysconf(_SC_NPROCESSORS_ONLN);
+  options.stats_path = NULL;
+  options.framebuffer_path = FRAMEBUFFER_FILE;
+  options.x_display = X_DISPLAY;
+  options.source = MIRROR_SOURCE_AUTO;
+  options.record_path = NULL;
+  options.replay_path = NULL;
+  options.replay_full_speed = 0;
+  options.client_socket = NULL;
+  options.panel_columns = 1;
+  options.panel_rows = 1;
+  options.realtime_priority = 0;
+  options.capture_cpu = -1;
+  options.spi_cpu = -1;
+  options.jitter_report = 0;
+  return options;
+}
 
-void mirror_display() {
+void mirror_display(mirror_options options) {
   struct manager_info_t info;
+  if (options.panel_columns * options.panel_rows != display_panel_count()) {
+    fprintf(stderr, "a %d x %d wall needs %d panels, %d are open\n", options.panel_columns,
+            options.panel_rows, options.panel_columns * options.panel_rows,
+            display_panel_count());
+    return;
+  }
+  info.width = options.panel_columns * DISPLAY_HORIZONTAL;
+  info.height = options.panel_rows * DISPLAY_VERTICAL;
+  info.panel_columns = options.panel_columns;
   info.active = FRAMEBUFFER;
+  atomic_init(&info.whole_frame_wanted, 0);
   info.display = NULL;
-  int fb = map_framebuffer(&info.framebuffer);
-  if (fb == -1)
+  pthread_mutex_init(&info.x_lock, NULL);
+  info.x_display = options.x_display;
+  info.source = options.source;
+  info.replay_full_speed = options.replay_full_speed;
+  info.tear_check = options.tear_check;
+  info.adaptive_depth = options.adaptive_depth;
+  info.hardware_scroll = options.hardware_scroll;
+  info.scale_filter = options.scale_filter;
+  info.stats_path = options.stats_path;
+  info.realtime = options.realtime_priority != 0;
+  // fail now rather than every second once running
+  if (info.stats_path != NULL && stats_write_file(info.stats_path) == -1)
+    return;
+  // everything allocated from here on is locked in too
+  if (info.realtime && realtime_lock_memory() == -1)
+    fprintf(stderr, "Buffers may still fault in while running\n");
+  if (open_source(&info, &options) == -1)
     return;
+  if (frame_ring_init(&info.frames, info.width * info.height * COLOUR_BYTES) == -1) {
+    close_source(&info);
+    return;
+  }
+  if (scheduler_init(&info.scheduler, scheduler_default_policy(options.max_fps)) == -1) {
+    frame_ring_free(&info.frames);
+    close_source(&info);
+    return;
+  }
+  if (work_pool_init(&info.pool, options.threads) == -1) {
+    scheduler_free(&info.scheduler);
+    frame_ring_free(&info.frames);
+    close_source(&info);
+    return;
+  }
+  // the pool's threads run at the priority of the threads sharing work with them,
+  // on any core
+  for (int i = 1; i < info.pool.thread_count; i++)
+    realtime_configure_thread(info.pool.threads[i], -1, options.realtime_priority);
+  cursor_overlay_init(&info.cursor);
+  if (info.realtime)
+    for (int i = 0; i < FRAME_RING_SLOTS; i++)
+      realtime_prefault(info.frames.slots[i].data, info.width * info.height * COLOUR_BYTES);
 
-  display_combined_setup(COLOUR_FORMAT_16_BIT,
-			 ADDRESS_FLIP_HORIZONTAL | ADDRESS_HORIZONTAL_ORIENTATION | ADDRESS_COLOUR_LITTLE_ENDIAN);
-  display_brightness(MAX_BRIGHTNESS/1.5);
+  for (int i = 0; i < display_panel_count(); i++) {
+    display_select_panel(i);
+    display_combined_setup(COLOUR_FORMAT_16_BIT,
+                           ADDRESS_FLIP_HORIZONTAL | ADDRESS_HORIZONTAL_ORIENTATION
+                           | ADDRESS_COLOUR_LITTLE_ENDIAN);
+    display_brightness(MAX_BRIGHTNESS/1.5);
+  }
+  display_select_panel(0);
+  for (int i = 0; i < display_panel_count(); i++) {
+    info.panels[i] = display_start(i);
+    if (info.panels[i] == NULL) {
+      while (i-- > 0)
+        display_stop(info.panels[i]);
+      cursor_overlay_free(&info.cursor);
+      work_pool_free(&info.pool);
+      scheduler_free(&info.scheduler);
+      frame_ring_free(&info.frames);
+      close_source(&info);
+      return;
+    }
+    // the panels are sent to at the same priority as the transmit thread,
+    // so neither can keep the other from finishing a queued draw
+    realtime_configure_thread(info.panels[i]->thread, options.spi_cpu,
+                              options.realtime_priority);
+  }
+  info.recording = options.record_path != NULL
+                   && recorder_open(&info.recorder, options.record_path, info.width,
+                                    info.height) == 0;
 
   XInitThreads();
-  
-  pthread_t manager_thread, screen_renderer_thread;
+
+  // block interrupts before starting threads so they all inherit it
+  // and only the sigwait below receives it
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGINT);
+  sigprocmask(SIG_BLOCK, &sigset, NULL);
+
+  // left set by the last run
+  close_threads = 0;
+  pthread_t manager_thread, capture_thread, transmit_thread;
   int failed = pthread_create(&manager_thread, NULL, active_screen_manager, &info);
   if(failed) {
     fprintf(stderr, "failed to open screen manager thread! %s\n", strerror(failed));
     return;
   }
-  failed = pthread_create(&screen_renderer_thread, NULL, screen_renderer, &info);
+  failed = pthread_create(&capture_thread, NULL, screen_capturer, &info);
+  if(failed) {
+    fprintf(stderr, "failed to open screen capture thread! %s\n", strerror(failed));
+    return;
+  }
+  realtime_configure_thread(capture_thread, options.capture_cpu, options.realtime_priority);
+  failed = pthread_create(&transmit_thread, NULL, screen_transmitter, &info);
   if(failed) {
-    fprintf(stderr, "failed to open screen render thread! %s\n", strerror(failed));
+    fprintf(stderr, "failed to open screen transmit thread! %s\n", strerror(failed));
     return;
   }
+  realtime_configure_thread(transmit_thread, options.spi_cpu, options.realtime_priority);
 
   // wait until we get an interrupt signal
 
-  sigset_t sigset;
-  sigemptyset(&sigset);
-  sigaddset(&sigset, SIGINT);
   int sig;
-  sigprocmask(SIG_BLOCK, &sigset, NULL);
   failed = sigwait(&sigset, &sig);
   if(failed)
     fprintf(stderr, "failed to wait for interrupt signal! %s\n", strerror(failed));
@@ -95,16 +301,36 @@ void mirror_display() {
   
   if((failed = pthread_join(manager_thread, NULL)))
     fprintf(stderr, "failed to join manager thread %s\n", strerror(failed));
-  if((failed = pthread_join(screen_renderer_thread, NULL)))
-    fprintf(stderr, "failed to join screen render thread %s\n", strerror(failed));
-  
-  munmap(info.framebuffer, BUFF_SIZE);
-  close(fb);
+  if((failed = pthread_join(capture_thread, NULL)))
+    fprintf(stderr, "failed to join screen capture thread %s\n", strerror(failed));
+  if((failed = pthread_join(transmit_thread, NULL)))
+    fprintf(stderr, "failed to join screen transmit thread %s\n", strerror(failed));
 
-  display_lock();
-  display_software_reset();
-  display_brightness(0);
-  display_unlock();
+  // closed once no thread can still be using it
+  if (info.display != NULL)
+    XCloseDisplay(info.display);
+  pthread_mutex_destroy(&info.x_lock);
+  cursor_overlay_free(&info.cursor);
+  work_pool_free(&info.pool);
+  scheduler_free(&info.scheduler);
+  frame_ring_free(&info.frames);
+  close_source(&info);
+  if (info.recording)
+    recorder_close(&info.recorder);
+
+  // whatever was queued, like waking the panels, is sent first
+  for (int i = 0; i < display_panel_count(); i++)
+    display_stop(info.panels[i]);
+  for (int i = 0; i < display_panel_count(); i++) {
+    display_select_panel(i);
+    display_lock();
+    display_software_reset();
+    display_brightness(0);
+    display_unlock();
+  }
+  display_select_panel(0);
+  if (options.jitter_report)
+    stats_print_distribution(STATS_PACING_LATENESS, stdout);
 }
 
 /// ---- Manager Thread ----
@@ -118,13 +344,15 @@ enum open_x_state {
   UNAVAILABLE_X,
   UNSUPPORTED_X,
 };
-enum open_x_state try_open_x(Window* window, Display** display);
+enum open_x_state try_open_x(const char *name, int fit_width, int fit_height,
+                             Window* window, Display** display, int *width, int *height);
 
 int get_x_tty();
 int get_active_tty();
 
 int is_display_sleeping(Display *display);
-void update_sleep_state(int sleeping, enum active_window* state);
+void set_panels_sleeping(struct manager_info_t *info, enum display_option option);
+void update_sleep_state(struct manager_info_t *info, int sleeping);
 
 void* active_screen_manager(void* info_ptr) {
   struct manager_info_t *info = info_ptr;
@@ -132,10 +360,13 @@ void* active_screen_manager(void* info_ptr) {
   int unsupported_x = 0;
   XSetIOErrorHandler(x_error_handler);
   while(!close_threads) {
-    if (info->display == NULL && !unsupported_x) {
+    pthread_mutex_lock(&info->x_lock);
+    if (info->display == NULL && !unsupported_x
+        && (info->source == MIRROR_SOURCE_AUTO || info->source == MIRROR_SOURCE_X)) {
       Xtty = -1;
       
-      switch (try_open_x(&info->window, &info->display)) {	
+      switch (try_open_x(info->x_display, info->width, info->height, &info->window,
+                         &info->display, &info->x_width, &info->x_height)) {
       case OPENED_X:
         Xtty = get_x_tty();
         break;
@@ -150,112 +381,358 @@ void* active_screen_manager(void* info_ptr) {
     }
 
     int display_sleeping = is_display_sleeping(info->display);
-    update_sleep_state(display_sleeping, &info->active);
+    int have_x = info->display != NULL;
+    pthread_mutex_unlock(&info->x_lock);
+    update_sleep_state(info, display_sleeping);
 
-    if (!display_sleeping && Xtty != -1)
+    if (!display_sleeping && info->source == MIRROR_SOURCE_X && have_x)
+      info->active = X_BUFFER;
+    else if (!display_sleeping && Xtty != -1)
       info->active = get_active_tty() == Xtty ? X_BUFFER : FRAMEBUFFER;
+    if (info->stats_path != NULL)
+      stats_write_file(info->stats_path);
     sleep(1);
   }
-  if (info->display != NULL) {
-    XCloseDisplay(info->display);
-    info->display = NULL;
-  }
   return NULL;
 }
 
 
-/// ---- Renderer Thread ----
+/// ---- Capture Thread ----
+
+// the pointer as the capture thread last read it
+struct pointer_info_t {
+  x_cursor x;
+  // -1 while X isn't being captured
+  int x_pos;
+  int y_pos;
+  int visible;
+  uint64_t moved_ns;
+  cursor_image image;
+};
+
+// shrinks sources that aren't the display's size
+struct source_scale_t {
+  // what the scaler is set up for, 0 x 0 when it isn't
+  int width;
+  int height;
+  enum pixel_format format;
+  int diff_source;
+  // set up without error
+  int ready;
+  scaler scaler;
+  // the source as last read, when its changes are found by comparing
+  damage_tracker previous;
+};
 
-void get_mouse_pos(Display *display, Window window, int *x, int *y);
-void draw_mouse(uint8_t *data, int x, int y);
+void follow_pointer(struct manager_info_t *info, struct pointer_info_t *pointer,
+                    scaler *scaler);
+void hide_pointer(struct manager_info_t *info, struct pointer_info_t *pointer);
+int prepare_scaling(struct manager_info_t *info, struct source_scale_t *scale,
+                    int width, int height, enum pixel_format format, int diff_source);
+void release_scaling(struct source_scale_t *scale);
+void scale_changes(frame_t *frame, struct source_scale_t *scale,
+                   const damage_rect *rects, int count, const uint8_t *source, int stride);
+void copy_hinted(struct manager_info_t *info, frame_t *frame, const uint8_t *screen,
+                 int stride, enum pixel_format format);
+int replay_frame(struct manager_info_t *info, struct source_scale_t *scale,
+                 frame_t *frame, uint64_t *started_ns);
+int capture_clients(struct manager_info_t *info, frame_t *frame, uint64_t *last_ns);
+void hint_changed(struct manager_info_t *info, frame_t *frame, damage_rect r);
+void publish_frame(frame_ring *frames);
 
-void* screen_renderer(void* info_ptr) {
+void* screen_capturer(void* info_ptr) {
   struct manager_info_t* info = info_ptr;
-  static uint8_t screen_data[BUFF_SIZE];
-  int mouse_x = -1;
-  int mouse_y = -1;
-  int static_mouse_frames = FRAMES_UNTIL_MOUSE_GONE;
+  enum active_window previous_active = SLEEPING;
+  x_capture capture;
+  capture.display = NULL;
+  capture.image = NULL;
+  capture.have_shm = 0;
+  struct pointer_info_t pointer;
+  pointer.x_pos = -1;
+  pointer.y_pos = -1;
+  pointer.visible = 0;
+  pointer.moved_ns = 0;
+  struct source_scale_t scale;
+  scale.width = scale.height = 0;
+  scale.ready = 0;
+  // when the recording started playing, by the pace it's played at
+  uint64_t replay_started_ns = 0;
+  // when apps' drawing was last composed
+  uint64_t clients_ns = 0;
   while (!close_threads) {
-    if (info->active == SLEEPING) {
+    enum active_window active = info->active;
+    frame_t *frame = frame_ring_filling(&info->frames);
+    // display contents are unknown after sleeping or switching source
+    if (active != previous_active || atomic_exchange(&info->whole_frame_wanted, 0))
+      frame->full_redraw = 1;
+    if (frame->full_redraw)
+      frame->hint_count = FRAME_HINTS_ALL;
+    previous_active = active;
+    frame->source = NULL;
+    if (active != X_BUFFER)
+      hide_pointer(info, &pointer);
+    if (active == SLEEPING) {
       sleep(1);
-      mouse_x = -1;
-      mouse_y = -1;
-    } else if(info->active == FRAMEBUFFER) {
-      memcpy(screen_data, info->framebuffer, BUFF_SIZE);
-      display_lock();
-      display_draw(screen_data, BUFF_SIZE, 0);
-      display_unlock();
-      mouse_x = -1;
-      mouse_y = -1;
-    } else if(info->active == X_BUFFER) {
-      if (info->display == NULL)
-	goto x_draw_failed;
-      if(setjmp(x_err_env))
-        goto x_draw_failed;
-      
-      XImage *img = XGetImage(info->display, info->window,
-			      0, 0, DISPLAY_HORIZONTAL, DISPLAY_VERTICAL,
-			      AllPlanes, ZPixmap);
-      if(img == NULL)
-        goto x_draw_failed;
-      
-      int x, y;
-      get_mouse_pos(info->display, info->window, &x, &y);
-      int moved = !((x == mouse_x || mouse_x == -1) &&
-                    (y == mouse_y || mouse_y == -1));
-      if (moved)
-        static_mouse_frames = 0;
-      mouse_x = x;
-      mouse_y = y;
-      if (static_mouse_frames < FRAMES_UNTIL_MOUSE_GONE) {
-        draw_mouse((uint8_t *)img->data, x, y);
-        if (!moved)
-	  static_mouse_frames++;
-      } 
-
-      display_lock();
-      display_draw((uint8_t*)img->data, BUFF_SIZE, 0);
-      display_unlock();
-      XDestroyImage(img);
       continue;
-    x_draw_failed:
-      info->active = FRAMEBUFFER;
+    }
+    if (info->source == MIRROR_SOURCE_REPLAY) {
+      if (replay_frame(info, &scale, frame, &replay_started_ns))
+        publish_frame(&info->frames);
+      continue;
+    }
+    if (info->source == MIRROR_SOURCE_CLIENTS) {
+      if (capture_clients(info, frame, &clients_ns))
+        publish_frame(&info->frames);
+      continue;
+    }
+    if(active == FRAMEBUFFER) {
+      scheduler_wait(&info->scheduler);
+      fb_capture *fb = &info->framebuffer;
+      if (prepare_scaling(info, &scale, fb->width, fb->height, fb->format, 1)) {
+        // compared at full size first, so only what changed is scaled
+        int stride;
+        frame->captured_ns = time_monotonic_ns();
+        const uint8_t *source = fb_capture_source(fb, &stride);
+        damage_rect whole = {0, 0, fb->width, fb->height};
+        scale_changes(frame, &scale, &whole, 1, source, stride);
+        publish_frame(&info->frames);
+        continue;
+      }
+      // read by the transmit thread in place, rather than copied here
+      uint64_t start = time_monotonic_ns();
+      const uint8_t *pixels = fb_capture_frame(&info->framebuffer, frame->data,
+                                               &frame->source_stride);
+      stats_record_since(STATS_CAPTURE, start);
+      frame->captured_ns = start;
+      if (pixels != frame->data)
+        frame->source = pixels;
+      frame->hint_count = FRAME_HINTS_ALL;
+      publish_frame(&info->frames);
+    } else if(active == X_BUFFER) {
+      // only this thread closes it, so it stays open while used below
+      pthread_mutex_lock(&info->x_lock);
+      Display *display = info->display;
+      pthread_mutex_unlock(&info->x_lock);
+      // set once the connection is lost, when nothing more can be sent
+      int x_lost = 0;
+      if (display == NULL)
+	goto x_capture_failed;
+      if(setjmp(x_err_env)) {
+        x_lost = 1;
+        goto x_capture_failed;
+      }
+
+      if (capture.display != display) {
+        x_capture_close(&capture);
+        if (x_capture_open(&capture, display, info->window,
+                           info->x_width, info->x_height) == -1)
+          goto x_capture_failed;
+        x_cursor_open(&pointer.x, display, info->window);
+      }
+      // without damage events every update is the whole screen, so it
+      // is compared against the last to find what changed
+      int scaling = prepare_scaling(info, &scale, capture.width, capture.height,
+                                    capture.format, !capture.have_damage);
+      if (!scaling && (capture.width != info->width || capture.height != info->height))
+        goto x_capture_failed;
+      // the pointer is read while waiting for the frame, so it keeps
+      // moving smoothly however slowly the screen is being captured
+      do
+        follow_pointer(info, &pointer, scaling ? &scale.scaler : NULL);
+      while (!scheduler_wait_for(&info->scheduler, CURSOR_POLL_MS) && !close_threads);
+
+      damage_rect rects[FRAME_MAX_HINTS];
+      int count = x_capture_update(&capture, CURSOR_POLL_MS, rects, FRAME_MAX_HINTS);
+      if (count == -1)
+        goto x_capture_failed;
+      if (count == 0)
+        continue;
+      frame->captured_ns = time_monotonic_ns();
+
+      if (scaling) {
+        scale_changes(frame, &scale, rects, count, (uint8_t *)capture.image->data,
+                      capture.image->bytes_per_line);
+        publish_frame(&info->frames);
+        continue;
+      }
+      for (int i = 0; i < count; i++)
+        frame_add_hint(frame, rects[i]);
+      uint64_t start = time_monotonic_ns();
+      copy_hinted(info, frame, (uint8_t *)capture.image->data,
+                  capture.image->bytes_per_line, capture.format);
+      stats_record_since(STATS_CONVERT, start);
+      publish_frame(&info->frames);
+      continue;
+    x_capture_failed:
+      // the server's side of the shm goes with the connection
+      if (x_lost)
+        x_capture_abandon(&capture);
+      else
+        x_capture_close(&capture);
+      pthread_mutex_lock(&info->x_lock);
+      if (info->display != NULL)
+        XCloseDisplay(info->display);
       info->display = NULL;
+      pthread_mutex_unlock(&info->x_lock);
+      info->active = FRAMEBUFFER;
     }
   }
+  x_capture_close(&capture);
+  release_scaling(&scale);
+  // don't leave the transmit thread waiting
+  frame_ring_wake(&info->frames);
   return NULL;
 }
 
 
-/// ---- Helpers ----
+/// ---- Transmit Thread ----
 
-int map_framebuffer(uint8_t** screen_data) {  
-  int fb = open(FRAMEBUFFER_FILE, O_RDONLY);
-  if(fb < 0) {
-    fprintf(stderr, "Failed to open framebuffer, %s\n", strerror(errno));
-    return -1;
-  }
+// one panel's part of the picture
+struct panel_tile_t {
+  display_t *display;
+  // where the panel is in the picture
+  damage_rect area;
+  // ticket of the last draw queued
+  uint64_t queued;
+  // rects are converted into here and lent to the panel until it has sent them
+  uint8_t converted[BUFF_SIZE];
+};
 
-  struct fb_var_screeninfo info;
-  if (ioctl(fb, FBIOGET_VSCREENINFO, &info) == -1) {
-    fprintf(stderr, "Failed to get framebuffer info, %s\n", strerror(errno));
-    close(fb);
-    return -1;
-  }
-  if(info.xres != DISPLAY_HORIZONTAL || info.yres != DISPLAY_VERTICAL) {
-    printf("framebuffer res did not match display - fb: %d x %d - display: %d x %d\n",
-	   info.xres, info.yres, DISPLAY_HORIZONTAL, DISPLAY_VERTICAL);
-    close(fb);
-    return -1;
+// the panels the picture is split over, as tiles. rects are converted
+// here and queued on each panel, whose own thread sends them, so panels
+// on separate spi buses send at the same time
+struct panel_wall_t {
+  struct panel_tile_t tiles[DISPLAY_MAX_PANELS];
+  int count;
+  // the cursor goes over a copy of a rect
+  uint8_t cursor_data[BUFF_SIZE];
+  // shares converting large rects
+  work_pool *pool;
+};
+
+struct panel_wall_t *open_wall(struct manager_info_t *info);
+void draw_damage(struct panel_wall_t *wall, damage_tracker *damage,
+                 const cursor_state *cursor, enum display_colour_format format);
+void draw_cursor(struct panel_wall_t *wall, damage_tracker *damage,
+                 const cursor_state *cursor, damage_rect was,
+                 enum display_colour_format format);
+void draw_rects(struct panel_wall_t *wall, damage_tracker *damage, const cursor_state *cursor,
+                const damage_rect *rects, int count, enum display_colour_format format);
+unsigned int convert_rect(struct panel_wall_t *wall, damage_tracker *damage,
+                          const cursor_state *cursor, damage_rect r,
+                          enum display_colour_format format, uint8_t *rect_data);
+damage_rect pair_aligned(damage_rect r);
+int sent_area_changed(damage_tracker *damage, const uint8_t *pixels, int stride);
+long damaged_pixels(damage_tracker *damage);
+void set_colour_depth(damage_tracker *damage, enum display_colour_format format);
+// line hashes of the frame last sent, so each frame is only hashed once
+struct scroll_hashes_t {
+  uint64_t lines[DISPLAY_HORIZONTAL];
+  // lines are of damage.frame as it is now
+  int valid;
+};
+
+int follow_scroll(struct panel_wall_t *wall, damage_tracker *damage,
+                  struct scroll_hashes_t *hashes, damage_rect cursor_area,
+                  const uint8_t *pixels, int stride, enum display_colour_format format);
+
+void* screen_transmitter(void* info_ptr) {
+  struct manager_info_t* info = info_ptr;
+  long pixel_count = (long)info->width * info->height;
+  struct panel_wall_t *wall = open_wall(info);
+  if (wall == NULL)
+    return NULL;
+  damage_tracker damage;
+  if (damage_init(&damage, info->width, info->height, COLOUR_BYTES) == -1) {
+    free(wall);
+    return NULL;
   }
-  
-  *screen_data = mmap(0, BUFF_SIZE, PROT_READ, MAP_SHARED, fb, 0);
-  if(screen_data == MAP_FAILED) {
-    fprintf(stderr, "Failed to map screen data %s\n", strerror(errno));
-    close(fb);
-    return -1;
+  damage.pool = &info->pool;
+  if (info->realtime)
+    realtime_prefault(damage.frame, (size_t)damage.width * damage.height * COLOUR_BYTES);
+  colour_depth depth;
+  colour_depth_init(&depth, colour_depth_default_policy());
+  // the cursor as it is on the display, damage.frame holds what is under it
+  cursor_state cursor;
+  memset(&cursor, 0, sizeof(cursor));
+  struct scroll_hashes_t scroll_hashes;
+  scroll_hashes.valid = 0;
+  while (!close_threads) {
+    frame_t *frame = frame_ring_wait(&info->frames, FRAME_WAIT_MS);
+    damage_rect cursor_was = cursor_rect(&cursor, damage.width, damage.height);
+    int cursor_moved = cursor_overlay_read(&info->cursor, &cursor);
+    if (frame == NULL) {
+      // a still screen sends no frames, so settling is checked here too
+      if (info->adaptive_depth
+          && colour_depth_update(&depth, time_monotonic_ns(), 0, pixel_count)) {
+        set_colour_depth(&damage, depth.format);
+        draw_damage(wall, &damage, &cursor, depth.format);
+      }
+      // woken by the pointer moving over a still screen
+      if (cursor_moved)
+        draw_cursor(wall, &damage, &cursor, cursor_was, depth.format);
+      continue;
+    }
+    if (frame->full_redraw)
+      damage_invalidate(&damage);
+    const uint8_t *pixels = frame->data;
+    int stride = info->width * COLOUR_BYTES;
+    if (frame->source != NULL) {
+      pixels = frame->source;
+      stride = frame->source_stride;
+    }
+    uint64_t start = time_monotonic_ns();
+    // hinted frames are stale outside the hints, so can't be searched.
+    // the hashes only stay valid while every frame sent is
+    if (info->hardware_scroll && frame->hint_count == FRAME_HINTS_ALL && !damage.invalid) {
+      if (follow_scroll(wall, &damage, &scroll_hashes, cursor_was, pixels, stride,
+                        depth.format)) {
+        // the cursor was taken off before scrolling, it goes back on below
+        cursor_moved = 1;
+        cursor_was = (damage_rect){0, 0, 0, 0};
+      }
+    } else {
+      scroll_hashes.valid = 0;
+    }
+    if (frame->hint_count == FRAME_HINTS_ALL)
+      damage_update(&damage, pixels, stride);
+    else if (damage_update_region(&damage, pixels, stride, frame->hints,
+                                  frame->hint_count) == 0 && damage.invalid)
+      // ie a scroll failed to allocate, hints are no use until a whole frame
+      atomic_store(&info->whole_frame_wanted, 1);
+    stats_record_since(STATS_DIFF, start);
+    if (damage.rect_count > 0)
+      stats_count(STATS_FRAMES_SENT, 1);
+    // the cursor alone doesn't speed up capturing, it is followed separately
+    scheduler_frame_done(&info->scheduler, damage.rect_count > 0);
+    if (info->adaptive_depth
+        && colour_depth_update(&depth, time_monotonic_ns(), damaged_pixels(&damage),
+                               pixel_count))
+      set_colour_depth(&damage, depth.format);
+    draw_damage(wall, &damage, &cursor, depth.format);
+    if (cursor_moved)
+      draw_cursor(wall, &damage, &cursor, cursor_was, depth.format);
+    if (damage.rect_count > 0) {
+      uint64_t now = time_monotonic_ns();
+      stats_record(STATS_FRAME_LATENCY, now - frame->captured_ns);
+      // after queueing, so it overlaps with the panels sending
+      if (info->recording
+          && recorder_write(&info->recorder, damage.frame, frame->captured_ns) == -1)
+        info->recording = 0;
+    }
+
+    // the framebuffer can be mid write while it's read, if what was
+    // sent has changed since, send the latest version straight away
+    for (int i = 0; i < TEAR_RESENDS && info->tear_check && frame->source != NULL
+           && sent_area_changed(&damage, pixels, stride); i++) {
+      scroll_hashes.valid = 0;
+      damage_update(&damage, pixels, stride);
+      draw_damage(wall, &damage, &cursor, depth.format);
+    }
   }
-  return fb;
+  damage_free(&damage);
+  free(wall);
+  return NULL;
 }
 
 
@@ -292,24 +769,28 @@ int get_x_tty() {
   return -1;
 }
 
-enum open_x_state try_open_x(Window* window, Display** display) {
-  *display = XOpenDisplay(X_DISPLAY);
+enum open_x_state try_open_x(const char *name, int fit_width, int fit_height,
+                             Window* window, Display** display, int *width, int *height) {
+  *display = XOpenDisplay(name);
   if (!*display)
     return UNAVAILABLE_X;
   *window = DefaultRootWindow(*display);
   XWindowAttributes xwa;
   XGetWindowAttributes(*display, *window, &xwa);
-  if(xwa.width  != DISPLAY_HORIZONTAL
-     || xwa.height != DISPLAY_VERTICAL
-     || xwa.depth  != 8 * COLOUR_BYTES) {
+  // the exact pixel layout is checked when capture starts,
+  // larger screens are scaled down to fit
+  if(!scaler_supported(xwa.width, xwa.height, fit_width, fit_height)
+     || (xwa.depth != 16 && xwa.depth != 24)) {
     fprintf(stderr, "X window has unsupported format %d bit %dx%d,"
-	    " must be %d bit %d x %d\n",
+	    " must be 16 or 24 bit and at most %d x %d\n",
 	    xwa.depth, xwa.width, xwa.height,
-	    COLOUR_BYTES * 8, DISPLAY_HORIZONTAL, DISPLAY_VERTICAL);
+	    fit_width * (SCALE_MAX_TAPS - 2), fit_height * (SCALE_MAX_TAPS - 2));
     XCloseDisplay(*display);
     *display = NULL;
     return UNSUPPORTED_X;
   }
+  *width = xwa.width;
+  *height = xwa.height;
   return OPENED_X;
 }
 
@@ -323,52 +804,501 @@ int is_display_sleeping(Display *display) {
   return 0;
 }
 
-void update_sleep_state(int sleeping, enum active_window* state) {
-  if (sleeping && *state != SLEEPING) {
-    *state = SLEEPING;
-    sleep(1); // wait for render thread to stop
-    display_lock();
-    display_sleep(DISPLAY_ENABLE);
-    display_unlock();
-  } else if (!sleeping && *state == SLEEPING) {
-    display_lock();
-    display_sleep(DISPLAY_DISABLE);
-    display_unlock();
-    *state = FRAMEBUFFER;
+// queued behind anything still being drawn, rather than waiting for it
+void set_panels_sleeping(struct manager_info_t *info, enum display_option option) {
+  for (int i = 0; i < display_panel_count(); i++)
+    display_queue_sleep(info->panels[i], option);
+}
+
+void update_sleep_state(struct manager_info_t *info, int sleeping) {
+  if (sleeping && info->active != SLEEPING) {
+    info->active = SLEEPING;
+    set_panels_sleeping(info, DISPLAY_ENABLE);
+  } else if (!sleeping && info->active == SLEEPING) {
+    set_panels_sleeping(info, DISPLAY_DISABLE);
+    info->active = FRAMEBUFFER;
   }
 }
 
 
-/// ---- Draw Thread Helpers ----
+/// ---- Capture Thread Helpers ----
 
-void get_mouse_pos(Display *display, Window window, int *x, int *y) {
-  int rootx, rooty;
-  unsigned int mask;
-  Window root, child;
-  XQueryPointer(display, window, &root, &child, &rootx,
-		&rooty, x, y, &mask);
+void follow_pointer(struct manager_info_t *info, struct pointer_info_t *pointer,
+                    scaler *scaler) {
+  int x, y;
+  int new_image = x_cursor_update(&pointer->x, &x, &y, &pointer->image);
+  // the cursor image keeps its size, only where it is drawn is scaled
+  if (scaler != NULL)
+    scaler_map_point(scaler, &x, &y);
+  if (new_image)
+    cursor_overlay_set_image(&info->cursor, &pointer->image);
+  uint64_t now = time_monotonic_ns();
+  if (pointer->x_pos != -1 && (x != pointer->x_pos || y != pointer->y_pos))
+    pointer->moved_ns = now;
+  int visible = pointer->moved_ns != 0 && now - pointer->moved_ns < MOUSE_GONE_NS;
+  if (!new_image && x == pointer->x_pos && y == pointer->y_pos
+      && visible == pointer->visible)
+    return;
+  pointer->x_pos = x;
+  pointer->y_pos = y;
+  pointer->visible = visible;
+  cursor_overlay_move(&info->cursor, x, y, visible);
+  // the screen may be still, so the cursor can't wait for a frame
+  frame_ring_wake(&info->frames);
 }
 
-void draw_mouse(uint8_t *data, int x, int y) {
-  int size = 10;
-  int width = 2;
-  for (int x_pos = x; x_pos < x + size && x_pos < DISPLAY_HORIZONTAL;
-       x_pos++) {
-    for (int y_pos = y; y_pos < y + size && y_pos < DISPLAY_VERTICAL; y_pos++) {
-      int mouse_x = x_pos - x;
-      int mouse_y = y_pos - y;
-      if (mouse_x + mouse_y > size)
-        continue;
+void hide_pointer(struct manager_info_t *info, struct pointer_info_t *pointer) {
+  if (pointer->x_pos == -1)
+    return;
+  pointer->x_pos = -1;
+  pointer->y_pos = -1;
+  pointer->visible = 0;
+  pointer->moved_ns = 0;
+  cursor_overlay_move(&info->cursor, 0, 0, 0);
+}
 
-      uint8_t col = 0xFF;
-      if (mouse_x < width || mouse_y < width || mouse_x + mouse_y > size - width)
-	col = 0x00;
-      
-      for (int b = 0; b < COLOUR_BYTES; b++) {
-	int screenp = y_pos * DISPLAY_HORIZONTAL * COLOUR_BYTES +
-	  x_pos * COLOUR_BYTES + b;
-	data[screenp] = col;
+// set up scaling for a source, or check it is still set up. returns 1 if
+// the source needs scaling and can be, 0 if it is the display's size or
+// too large. diff_source finds the changes by comparing sources
+int prepare_scaling(struct manager_info_t *info, struct source_scale_t *scale,
+                    int width, int height, enum pixel_format format, int diff_source) {
+  if (width == info->width && height == info->height) {
+    release_scaling(scale);
+    return 0;
+  }
+  if (scale->width == width && scale->height == height && scale->format == format
+      && scale->diff_source == diff_source)
+    return scale->ready;
+  release_scaling(scale);
+  // remembered when it fails too, so it isn't retried every frame
+  scale->width = width;
+  scale->height = height;
+  scale->format = format;
+  scale->diff_source = diff_source;
+  if (scaler_init(&scale->scaler, width, height, format, info->width, info->height,
+                  info->scale_filter, &info->pool) == -1)
+    return 0;
+  if (diff_source && damage_init(&scale->previous, width, height,
+                                 pixel_format_bytes(format)) == -1) {
+    scaler_free(&scale->scaler);
+    return 0;
+  }
+  scale->ready = 1;
+  return 1;
+}
+
+void release_scaling(struct source_scale_t *scale) {
+  if (scale->ready) {
+    scaler_free(&scale->scaler);
+    if (scale->diff_source)
+      damage_free(&scale->previous);
+  }
+  scale->ready = 0;
+  scale->width = scale->height = 0;
+}
+
+// hint the parts of the frame the changed source rects show up in and
+// scale them. when diffing, the source is compared against the last one
+// first and the rects it finds are used instead
+void scale_changes(frame_t *frame, struct source_scale_t *scale,
+                   const damage_rect *rects, int count, const uint8_t *source, int stride) {
+  if (scale->diff_source) {
+    uint64_t start = time_monotonic_ns();
+    damage_update(&scale->previous, source, stride);
+    stats_record_since(STATS_DIFF, start);
+    rects = scale->previous.rects;
+    count = scale->previous.rect_count;
+    // scaled from the copy, which can't change halfway through
+    source = scale->previous.frame;
+    stride = scale->previous.width * scale->previous.pixel_bytes;
+  }
+  for (int i = 0; i < count; i++) {
+    damage_rect r = scaler_dest_rect(&scale->scaler, rects[i]);
+    if (r.w > 0)
+      frame_add_hint(frame, r);
+  }
+  uint64_t start = time_monotonic_ns();
+  int row_bytes = scale->scaler.dst_width * COLOUR_BYTES;
+  if (frame->hint_count == FRAME_HINTS_ALL) {
+    scaler_clear_borders(&scale->scaler, frame->data, row_bytes);
+    scaler_scale(&scale->scaler, frame->data, row_bytes, source, stride,
+                 scale->scaler.picture);
+  } else {
+    for (int i = 0; i < frame->hint_count; i++)
+      scaler_scale(&scale->scaler, frame->data, row_bytes, source, stride,
+                   frame->hints[i]);
+  }
+  stats_record_since(STATS_CONVERT, start);
+}
+
+// refresh the parts of the frame its hints cover from a screen image,
+// converting it to the little endian rgb565 frames use
+void copy_hinted(struct manager_info_t *info, frame_t *frame, const uint8_t *screen,
+                 int stride, enum pixel_format format) {
+  int row_bytes = info->width * COLOUR_BYTES;
+  int screen_bytes = pixel_format_bytes(format);
+  if (frame->hint_count == FRAME_HINTS_ALL) {
+    struct convert_job_t job = {frame->data, row_bytes, COLOUR_FORMAT_16_BIT, screen, stride,
+                                format, {0, 0, info->width, info->height}};
+    convert_shared(&info->pool, &job);
+    return;
+  }
+  for (int i = 0; i < frame->hint_count; i++) {
+    damage_rect r = frame->hints[i];
+    pixel_convert(&frame->data[r.y * row_bytes + r.x * COLOUR_BYTES], row_bytes,
+                  COLOUR_FORMAT_16_BIT, 1, &screen[r.y * stride + r.x * screen_bytes],
+                  stride, format, r.w, r.h);
+  }
+}
+
+// decode the recording's next frame into frame, once it is due. returns 0
+// when there is nothing to publish
+int replay_frame(struct manager_info_t *info, struct source_scale_t *scale,
+                 frame_t *frame, uint64_t *started_ns) {
+  replay *replay = &info->replay;
+  int first = replay->rewound;
+  uint64_t start = time_monotonic_ns();
+  uint64_t time_ns;
+  damage_rect changed;
+  if (!replay_next(replay, &time_ns, &changed)) {
+    replay_rewind(replay);
+    // nothing to play, rather than spinning
+    if (first)
+      sleep(1);
+    return 0;
+  }
+  stats_record_since(STATS_CAPTURE, start);
+  if (info->replay_full_speed) {
+    scheduler_wait(&info->scheduler);
+  } else {
+    // the first frame of each play sets the pace
+    if (first)
+      *started_ns = start - time_ns;
+    uint64_t due = *started_ns + time_ns;
+    for (uint64_t now = time_monotonic_ns(); now < due && !close_threads;
+         now = time_monotonic_ns()) {
+      uint64_t wait_ns = FRAME_WAIT_MS * 1000000ull;
+      time_sleep_until_ns(due - now < wait_ns ? due : now + wait_ns);
+    }
+  }
+  if (changed.h == 0)
+    return 0;
+  frame->captured_ns = time_monotonic_ns();
+  const uint8_t *pixels = (const uint8_t *)replay->frame;
+  int stride = replay->width * COLOUR_BYTES;
+  if (prepare_scaling(info, scale, replay->width, replay->height, PIXEL_FORMAT_RGB565, 0)) {
+    scale_changes(frame, scale, &changed, 1, pixels, stride);
+    return 1;
+  }
+  // the size was checked when opened, so the scaler failed to allocate
+  if (replay->width != info->width || replay->height != info->height)
+    return 0;
+  hint_changed(info, frame, changed);
+  start = time_monotonic_ns();
+  copy_hinted(info, frame, pixels, stride, PIXEL_FORMAT_RGB565);
+  stats_record_since(STATS_CONVERT, start);
+  return 1;
+}
+
+// compose what apps drew into frame, no faster than the top capture rate,
+// so apps drawing flat out are held back waiting for their answers.
+// returns 0 when nothing changed
+int capture_clients(struct manager_info_t *info, frame_t *frame, uint64_t *last_ns) {
+  time_sleep_until_ns(*last_ns + 1000000000ull / info->scheduler.policy.rates[0]);
+  damage_rect rects[FRAME_MAX_HINTS];
+  int count = client_capture_update(&info->clients, FRAME_WAIT_MS, rects, FRAME_MAX_HINTS);
+  if (count == 0)
+    return 0;
+  frame->captured_ns = time_monotonic_ns();
+  *last_ns = frame->captured_ns;
+  for (int i = 0; i < count; i++)
+    hint_changed(info, frame, rects[i]);
+  copy_hinted(info, frame, info->clients.picture, info->width * COLOUR_BYTES,
+              PIXEL_FORMAT_RGB565);
+  stats_record_since(STATS_CONVERT, frame->captured_ns);
+  return 1;
+}
+
+// changes over the whole picture are most likely a scroll, which is only
+// looked for in whole frames
+void hint_changed(struct manager_info_t *info, frame_t *frame, damage_rect r) {
+  if (r.w == info->width && r.h == info->height)
+    frame->hint_count = FRAME_HINTS_ALL;
+  else
+    frame_add_hint(frame, r);
+}
+
+void publish_frame(frame_ring *frames) {
+  stats_count(STATS_FRAMES_CAPTURED, 1);
+  if (frame_ring_publish(frames))
+    stats_count(STATS_FRAMES_DROPPED, 1);
+}
+
+
+/// ---- Transmit Thread Helpers ----
+
+// returns NULL on error
+struct panel_wall_t *open_wall(struct manager_info_t *info) {
+  struct panel_wall_t *wall = calloc(1, sizeof(*wall));
+  if (wall == NULL) {
+    fprintf(stderr, "Failed to allocate panel buffers\n");
+    return NULL;
+  }
+  wall->count = display_panel_count();
+  for (int i = 0; i < wall->count; i++) {
+    struct panel_tile_t *tile = &wall->tiles[i];
+    tile->display = info->panels[i];
+    tile->area = (damage_rect){i % info->panel_columns * DISPLAY_HORIZONTAL,
+                               i / info->panel_columns * DISPLAY_VERTICAL,
+                               DISPLAY_HORIZONTAL, DISPLAY_VERTICAL};
+    tile->queued = 0;
+  }
+  wall->pool = &info->pool;
+  return wall;
+}
+
+// send the damaged rects of the frame, with the cursor over them
+void draw_damage(struct panel_wall_t *wall, damage_tracker *damage,
+                 const cursor_state *cursor, enum display_colour_format format) {
+  draw_rects(wall, damage, cursor, damage->rects, damage->rect_count, format);
+}
+
+// resend where the cursor was, to restore what it covered, and where it is now
+void draw_cursor(struct panel_wall_t *wall, damage_tracker *damage,
+                 const cursor_state *cursor, damage_rect was,
+                 enum display_colour_format format) {
+  damage_rect rects[2];
+  int count = 0;
+  damage_rect now = cursor_rect(cursor, damage->width, damage->height);
+  if (was.w > 0)
+    rects[count++] = pair_aligned(was);
+  if (now.w > 0)
+    rects[count++] = pair_aligned(now);
+  // small moves overlap, then one rect around both is cheaper
+  if (count == 2 && rects[0].x <= rects[1].x + rects[1].w
+      && rects[1].x <= rects[0].x + rects[0].w
+      && rects[0].y <= rects[1].y + rects[1].h
+      && rects[1].y <= rects[0].y + rects[0].h) {
+    int x1 = rects[0].x + rects[0].w > rects[1].x + rects[1].w
+      ? rects[0].x + rects[0].w : rects[1].x + rects[1].w;
+    int y1 = rects[0].y + rects[0].h > rects[1].y + rects[1].h
+      ? rects[0].y + rects[0].h : rects[1].y + rects[1].h;
+    rects[0].x = rects[0].x < rects[1].x ? rects[0].x : rects[1].x;
+    rects[0].y = rects[0].y < rects[1].y ? rects[0].y : rects[1].y;
+    rects[0].w = x1 - rects[0].x;
+    rects[0].h = y1 - rects[0].y;
+    count = 1;
+  }
+  draw_rects(wall, damage, cursor, rects, count, format);
+}
+
+// send rects of the last sent frame, with the cursor over them unless
+// it is NULL. each panel only updates after its last one so they appear together
+void draw_rects(struct panel_wall_t *wall, damage_tracker *damage, const cursor_state *cursor,
+                const damage_rect *rects, int count, enum display_colour_format format) {
+  for (int p = 0; p < wall->count; p++) {
+    struct panel_tile_t *tile = &wall->tiles[p];
+    damage_rect a = tile->area;
+    damage_rect parts[DAMAGE_MAX_RECTS];
+    int part_count = 0;
+    for (int i = 0; i < count; i++) {
+      damage_rect r = rects[i];
+      int x0 = r.x > a.x ? r.x : a.x;
+      int y0 = r.y > a.y ? r.y : a.y;
+      int x1 = r.x + r.w < a.x + a.w ? r.x + r.w : a.x + a.w;
+      int y1 = r.y + r.h < a.y + a.h ? r.y + r.h : a.y + a.h;
+      if (x1 > x0 && y1 > y0)
+        parts[part_count++] = (damage_rect){x0, y0, x1 - x0, y1 - y0};
+    }
+    if (part_count == 0)
+      continue;
+    // the last rects are sent while these are converted, but no sooner,
+    // so frames queue up here and are dropped rather than in the panel's queue.
+    // that also frees up all of tile->converted
+    display_wait(tile->display, tile->queued);
+    size_t used = 0;
+    for (int i = 0; i < part_count; i++) {
+      damage_rect r = parts[i];
+      // rects can overlap, once they fill the buffer it is reused when sent
+      if (used + (size_t)r.w * r.h * COLOUR_BYTES > sizeof(tile->converted)) {
+        display_wait(tile->display, tile->queued);
+        used = 0;
       }
+      uint8_t *data = &tile->converted[used];
+      unsigned int size = convert_rect(wall, damage, cursor, r, format, data);
+      used += size;
+      tile->queued = display_queue_draw_borrowed(tile->display, r.x - a.x, r.y - a.y,
+                                                 r.w, r.h, data, size, format,
+                                                 i < part_count - 1 ? DONT_FLUSH_DRAW : 0);
+    }
+  }
+}
+
+// copy a rect of the frame out to rect_data in the panel's format, with the
+// cursor over it unless it is NULL. returns the size copied
+unsigned int convert_rect(struct panel_wall_t *wall, damage_tracker *damage,
+                          const cursor_state *cursor, damage_rect r,
+                          enum display_colour_format format, uint8_t *rect_data) {
+  uint8_t *cursor_data = wall->cursor_data;
+  int stride = damage->width * damage->pixel_bytes;
+  int row_bytes = r.w * damage->pixel_bytes;
+  uint8_t *data = &damage->frame[r.y * stride + r.x * damage->pixel_bytes];
+  // the cursor goes over a copy, the frame keeps what is under it
+  if (cursor != NULL && cursor_overlaps(cursor, r)) {
+    for (int y = 0; y < r.h; y++)
+      memcpy(&cursor_data[y * row_bytes], &data[y * stride], row_bytes);
+    cursor_blend(cursor, cursor_data, row_bytes, r);
+    data = cursor_data;
+    stride = row_bytes;
+  }
+  int panel_row_bytes = pixel_panel_row_bytes(format, r.w);
+  if (format == COLOUR_FORMAT_12_BIT) {
+    // rects are whole tiles wide and scrolls even, so rows never end
+    // halfway through a pair
+    uint64_t start = time_monotonic_ns();
+    struct convert_job_t job = {rect_data, panel_row_bytes, COLOUR_FORMAT_12_BIT, data,
+                                stride, PIXEL_FORMAT_RGB565, r};
+    convert_shared(wall->pool, &job);
+    stats_record_since(STATS_CONVERT, start);
+  } else {
+    for (int y = 0; y < r.h; y++)
+      memcpy(&rect_data[y * row_bytes], &data[y * stride], row_bytes);
+  }
+  return panel_row_bytes * r.h;
+}
+
+// widen a rect to whole pixel pairs, which 12 bit colour is sent in
+damage_rect pair_aligned(damage_rect r) {
+  int x1 = r.x + r.w;
+  r.x &= ~1;
+  r.w = ((x1 + 1) & ~1) - r.x;
+  return r;
+}
+
+long damaged_pixels(damage_tracker *damage) {
+  long pixels = 0;
+  for (int i = 0; i < damage->rect_count; i++)
+    pixels += (long)damage->rects[i].w * damage->rects[i].h;
+  return pixels;
+}
+
+// switch the colour depth, the panels change to it as they are next drawn to.
+// going back to 16 bit everything is redrawn to restore the colour lost while in 12 bit
+void set_colour_depth(damage_tracker *damage, enum display_colour_format format) {
+  if (format == COLOUR_FORMAT_16_BIT)
+    damage_redraw_all(damage);
+}
+
+// when the frame is the last one scrolled along the display's scroll axis,
+// scroll the display to match so only the lines scrolled in are resent.
+// cursor_area is where the cursor is on the display, it is taken off
+// first rather than moved with the picture. the frame is hashed into
+// hashes, as it will match damage->frame once it has been sent whole.
+// returns 1 if it scrolled
+int follow_scroll(struct panel_wall_t *wall, damage_tracker *damage,
+                  struct scroll_hashes_t *hashes, damage_rect cursor_area,
+                  const uint8_t *pixels, int stride, enum display_colour_format format) {
+  // each panel scrolls on its own, a picture moving across them can't follow
+  if (wall->count > 1)
+    return 0;
+  // only set up before the panels' threads start, so safe to read here
+  int along_x = display_scroll_along_x();
+  int length = along_x ? damage->width : damage->height;
+  // the panel scrolls its whole 320 lines, smaller frames can't follow
+  if (length != DISPLAY_HORIZONTAL)
+    return 0;
+  if (!hashes->valid)
+    scroll_hash_lines(hashes->lines, damage->frame, damage->width * damage->pixel_bytes,
+                      damage->width, damage->height, along_x);
+  uint64_t current[DISPLAY_HORIZONTAL];
+  scroll_hash_lines(current, pixels, stride, damage->width, damage->height, along_x);
+  // even, so 12 bit rects split where the scroll wraps keep whole pairs
+  int lines = scroll_detect(hashes->lines, current, length, 2,
+                            length / SCROLL_MIN_SAVING);
+  memcpy(hashes->lines, current, sizeof(current));
+  hashes->valid = 1;
+  if (lines == 0)
+    return 0;
+  if (cursor_area.w > 0) {
+    cursor_area = pair_aligned(cursor_area);
+    draw_rects(wall, damage, NULL, &cursor_area, 1, format);
+  }
+  wall->tiles[0].queued = display_queue_scroll(wall->tiles[0].display, lines);
+  damage_scroll(damage, lines, along_x);
+  return 1;
+}
+
+// whether the pixels under the last damage rects differ from what was sent
+int sent_area_changed(damage_tracker *damage, const uint8_t *pixels, int stride) {
+  int row_bytes = damage->width * damage->pixel_bytes;
+  for (int i = 0; i < damage->rect_count; i++) {
+    damage_rect r = damage->rects[i];
+    int offset = r.x * damage->pixel_bytes;
+    for (int y = r.y; y < r.y + r.h; y++)
+      if (memcmp(&damage->frame[y * row_bytes + offset], &pixels[y * stride + offset],
+                 r.w * damage->pixel_bytes))
+        return 1;
+  }
+  return 0;
+}
+
+/// ---- Shared Helpers ----
+
+// convert job's area, in bands when it is large enough to be worth sharing
+void convert_shared(work_pool *pool, struct convert_job_t *job) {
+  job->bands = work_pool_bands(pool, job->area.h, CONVERT_BAND_ROWS);
+  work_pool_run(pool, convert_band, job, job->bands);
+}
+
+void convert_band(void *job_ptr, int band, int worker) {
+  struct convert_job_t *job = job_ptr;
+  int y0 = job->area.h * band / job->bands;
+  int y1 = job->area.h * (band + 1) / job->bands;
+  uint8_t *dst = &job->dst[(size_t)y0 * job->dst_stride];
+  const uint8_t *src = &job->src[(size_t)y0 * job->src_stride];
+  if (job->dst_format == COLOUR_FORMAT_12_BIT)
+    pixel_convert_444_dithered(dst, job->dst_stride, src, job->src_stride, job->src_format,
+                               job->area.x, job->area.y + y0, job->area.w, y1 - y0);
+  else
+    pixel_convert(dst, job->dst_stride, job->dst_format, 1, src, job->src_stride,
+                  job->src_format, job->area.w, y1 - y0);
+}
+
+// the framebuffer, or the recording or apps shown in its place
+int open_source(struct manager_info_t *info, mirror_options *options) {
+  if (info->source == MIRROR_SOURCE_CLIENTS) {
+    if (options->client_socket == NULL) {
+      fprintf(stderr, "no socket to serve clients on\n");
+      return -1;
     }
+    return client_capture_open(&info->clients, options->client_socket, info->width,
+                               info->height);
+  }
+  if (info->source != MIRROR_SOURCE_REPLAY)
+    return fb_capture_open(&info->framebuffer, options->framebuffer_path, info->width,
+                           info->height);
+  if (options->replay_path == NULL) {
+    fprintf(stderr, "no recording to replay\n");
+    return -1;
   }
+  if (replay_open(&info->replay, options->replay_path) == -1)
+    return -1;
+  replay *replay = &info->replay;
+  if ((replay->width != info->width || replay->height != info->height)
+      && !scaler_supported(replay->width, replay->height, info->width, info->height)) {
+    fprintf(stderr, "a %d x %d recording can't be shown at %d x %d\n", replay->width,
+            replay->height, info->width, info->height);
+    replay_close(replay);
+    return -1;
+  }
+  return 0;
+}
+
+void close_source(struct manager_info_t *info) {
+  if (info->source == MIRROR_SOURCE_REPLAY)
+    replay_close(&info->replay);
+  else if (info->source == MIRROR_SOURCE_CLIENTS)
+    client_capture_close(&info->clients);
+  else
+    fb_capture_close(&info->framebuffer);
 }
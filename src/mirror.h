@@ -1,6 +1,69 @@
 #ifndef DISPLAY_MIRROR_H
 #define DISPLAY_MIRROR_H
 
-void mirror_display();
+#include "scale.h"
+
+enum mirror_source {
+  // X while its tty is active, otherwise the framebuffer
+  MIRROR_SOURCE_AUTO,
+  MIRROR_SOURCE_FRAMEBUFFER,
+  // X whenever it is available, ie a server without a tty like Xvfb
+  MIRROR_SOURCE_X,
+  // replay_path, over and over
+  MIRROR_SOURCE_REPLAY,
+  // apps drawing through display_client.h, connecting to client_socket
+  MIRROR_SOURCE_CLIENTS,
+};
+
+typedef struct mirror_options {
+  // fastest capture rate, slower rates are used while the screen is unchanged
+  unsigned int max_fps;
+  // resend framebuffer areas that changed while they were being sent
+  int tear_check;
+  // send in 12 bit colour during heavy motion, for a higher frame rate
+  int adaptive_depth;
+  // scroll the panel to follow scrolled frames, rather than resending them
+  int hardware_scroll;
+  // how sources larger than the panel are shrunk to fit it
+  enum scale_filter scale_filter;
+  // threads sharing each frame's scaling, diffing and converting between,
+  // one per core by default
+  int threads;
+  // rewrite this file every second with latency histograms and counters,
+  // in the prometheus text format. NULL for none
+  const char *stats_path;
+  // framebuffer device, or a file holding a raw RGB565 frame
+  const char *framebuffer_path;
+  // X display to mirror, NULL to use the DISPLAY env var
+  const char *x_display;
+  enum mirror_source source;
+  // record every changed frame as it is sent to this file, NULL for none
+  const char *record_path;
+  // recording MIRROR_SOURCE_REPLAY plays
+  const char *replay_path;
+  // play recordings back as fast as max_fps allows, rather than at the
+  // speed they were recorded
+  int replay_full_speed;
+  // unix socket MIRROR_SOURCE_CLIENTS listens on
+  const char *client_socket;
+  // the panels as tiles of one picture, columns side by side and rows one
+  // below the other, numbered along each row. display_panel_count() must
+  // be columns x rows
+  int panel_columns;
+  int panel_rows;
+  // run the capture thread and the threads sending to the panels SCHED_FIFO
+  // at this priority, with the process locked in memory. 0 for neither
+  int realtime_priority;
+  // cores those threads are pinned to, -1 for any
+  int capture_cpu;
+  int spi_cpu;
+  // print how late the capture pacing woke on exit
+  int jitter_report;
+} mirror_options;
+
+mirror_options mirror_default_options();
+
+// runs until the process receives SIGINT
+void mirror_display(mirror_options options);
 
 #endif
@@ -1,17 +1,29 @@
 #ifndef PI_WIRING_CONSTS_H
 #define PI_WIRING_CONSTS_H
 
-// whether use spi0 or spi1
-const int SPI_CHANNEL = 0;
-// which spi chip enable pin is used
-const int SPI_CHIP_ENABLE = 0;
+// how each panel is wired, by panel number. panels on separate spi
+// buses send at the same time, ones sharing a bus take turns on it
+typedef struct panel_wiring {
+  // whether use spi0 or spi1
+  int spi_channel;
+  // which spi chip enable pin is used
+  int spi_chip_enable;
+  int data_command_pin;
+  int reset_pin;
+} panel_wiring;
+
+const panel_wiring PANEL_WIRING[] = {
+  {0, 0, 25, 24},
+  {1, 0, 23, 22},
+  {0, 1, 5, 6},
+  {1, 1, 26, 27},
+};
 // the size of the pi's spi buffer (default is 4096, max is 65536)
-// can be modified in pi boot settings
+// can be modified in pi boot settings. Only used when falling back to
+// wiringPi's spi, the spidev transport reads the real limit from the kernel
 #define SPI_BUFFER_SIZE 65536
 
-// GPIO pins used for the other display inputs
+// GPIO pin driving the backlight, shared by every panel
 const int BACKLIGHT_PIN = 12;
-const int RESET_PIN = 24;
-const int DATA_COMMAND_PIN = 25;
 
 #endif
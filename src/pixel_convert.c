@@ -0,0 +1,596 @@
+#include "pixel_convert.h"
+
+#include "pixel_kernel.h"
+
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PIXEL_CONVERT_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// panel side layouts, 16 bit comes in both byte orders
+enum convert_target {
+  TARGET_444,
+  TARGET_565_LE,
+  TARGET_565_BE,
+  TARGET_666,
+  TARGET_COUNT,
+};
+
+typedef void (*convert_row_fn)(uint8_t *dst, const uint8_t *src, int width);
+typedef void (*dither_row_fn)(uint8_t *dst, const uint8_t *src, int width,
+                              int x, int y);
+
+static convert_row_fn choose_kernel(enum pixel_format src_format,
+                                    enum convert_target target);
+static convert_row_fn vector_kernel(enum pixel_format src_format,
+                                    enum convert_target target);
+static dither_row_fn choose_dither_kernel(enum pixel_format src_format);
+static enum convert_target target_for(enum display_colour_format format,
+                                      int little_endian);
+
+
+/// ---- Api Implementation ----
+
+
+int pixel_format_bytes(enum pixel_format format) {
+  switch (format) {
+  case PIXEL_FORMAT_RGB565:
+  case PIXEL_FORMAT_BGR565:
+    return 2;
+  case PIXEL_FORMAT_RGB888:
+    return 3;
+  case PIXEL_FORMAT_XRGB8888:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+const char *pixel_format_name(enum pixel_format format) {
+  switch (format) {
+  case PIXEL_FORMAT_RGB565:
+    return "rgb565";
+  case PIXEL_FORMAT_BGR565:
+    return "bgr565";
+  case PIXEL_FORMAT_RGB888:
+    return "rgb888";
+  case PIXEL_FORMAT_XRGB8888:
+    return "xrgb8888";
+  default:
+    return "unknown";
+  }
+}
+
+int pixel_panel_row_bytes(enum display_colour_format format, int width) {
+  switch (format) {
+  case COLOUR_FORMAT_12_BIT:
+    return (width * 3 + 1) / 2;
+  case COLOUR_FORMAT_18_BIT:
+    return width * 3;
+  default:
+    return width * 2;
+  }
+}
+
+void pixel_convert_row(uint8_t *dst, enum display_colour_format dst_format,
+                       int little_endian, const uint8_t *src,
+                       enum pixel_format src_format, int width) {
+  choose_kernel(src_format, target_for(dst_format, little_endian))(dst, src, width);
+}
+
+void pixel_convert(uint8_t *dst, int dst_stride, enum display_colour_format dst_format,
+                   int little_endian, const uint8_t *src, int src_stride,
+                   enum pixel_format src_format, int width, int height) {
+  convert_row_fn convert = choose_kernel(src_format, target_for(dst_format, little_endian));
+  for (int y = 0; y < height; y++)
+    convert(&dst[(size_t)y * dst_stride], &src[(size_t)y * src_stride], width);
+}
+
+int pixel_convert_vectorised(enum display_colour_format dst_format, int little_endian,
+                             enum pixel_format src_format) {
+  enum convert_target target = target_for(dst_format, little_endian);
+  return vector_kernel(src_format, target) != NULL;
+}
+
+void pixel_convert_444_dithered(uint8_t *dst, int dst_stride, const uint8_t *src,
+                                int src_stride, enum pixel_format src_format,
+                                int x, int y, int width, int height) {
+  dither_row_fn dither = choose_dither_kernel(src_format);
+  for (int row = 0; row < height; row++)
+    dither(&dst[(size_t)row * dst_stride], &src[(size_t)row * src_stride],
+           width, x, y + row);
+}
+
+
+/// ---- Scalar Kernels ----
+
+// pixels are unpacked to 8 bit channels and packed into the target
+// a pair at a time, as 12 bit packs two pixels into three bytes
+
+static inline uint8_t expand5(unsigned int v) {
+  return v << 3 | v >> 2;
+}
+
+static inline uint8_t expand6(unsigned int v) {
+  return v << 2 | v >> 4;
+}
+
+static inline void load_rgb565(const uint8_t *src, int i, uint8_t *r, uint8_t *g, uint8_t *b) {
+  unsigned int p = src[i * 2] | src[i * 2 + 1] << 8;
+  *r = expand5(p >> 11);
+  *g = expand6((p >> 5) & 0x3F);
+  *b = expand5(p & 0x1F);
+}
+
+static inline void load_bgr565(const uint8_t *src, int i, uint8_t *r, uint8_t *g, uint8_t *b) {
+  load_rgb565(src, i, b, g, r);
+}
+
+static inline void load_rgb888(const uint8_t *src, int i, uint8_t *r, uint8_t *g, uint8_t *b) {
+  *b = src[i * 3];
+  *g = src[i * 3 + 1];
+  *r = src[i * 3 + 2];
+}
+
+static inline void load_xrgb8888(const uint8_t *src, int i, uint8_t *r, uint8_t *g, uint8_t *b) {
+  *b = src[i * 4];
+  *g = src[i * 4 + 1];
+  *r = src[i * 4 + 2];
+}
+
+static inline unsigned int pack565(uint8_t r, uint8_t g, uint8_t b) {
+  return (r & 0xF8) << 8 | (g & 0xFC) << 3 | b >> 3;
+}
+
+static inline void store_565_le(uint8_t *dst, int i, const uint8_t *r, const uint8_t *g,
+                                const uint8_t *b, int count) {
+  for (int k = 0; k < count; k++) {
+    unsigned int p = pack565(r[k], g[k], b[k]);
+    dst[(i + k) * 2] = p;
+    dst[(i + k) * 2 + 1] = p >> 8;
+  }
+}
+
+static inline void store_565_be(uint8_t *dst, int i, const uint8_t *r, const uint8_t *g,
+                                const uint8_t *b, int count) {
+  for (int k = 0; k < count; k++) {
+    unsigned int p = pack565(r[k], g[k], b[k]);
+    dst[(i + k) * 2] = p >> 8;
+    dst[(i + k) * 2 + 1] = p;
+  }
+}
+
+static inline void store_666(uint8_t *dst, int i, const uint8_t *r, const uint8_t *g,
+                             const uint8_t *b, int count) {
+  for (int k = 0; k < count; k++) {
+    dst[(i + k) * 3] = r[k] & 0xFC;
+    dst[(i + k) * 3 + 1] = g[k] & 0xFC;
+    dst[(i + k) * 3 + 2] = b[k] & 0xFC;
+  }
+}
+
+// RRRRGGGG BBBBRRRR GGGGBBBB, a lone last pixel fills the first 12 bits
+static inline void store_444(uint8_t *dst, int i, const uint8_t *r, const uint8_t *g,
+                             const uint8_t *b, int count) {
+  uint8_t *out = &dst[i / 2 * 3];
+  out[0] = (r[0] & 0xF0) | g[0] >> 4;
+  out[1] = (b[0] & 0xF0) | (count == 2 ? r[1] >> 4 : 0);
+  if (count == 2)
+    out[2] = (g[1] & 0xF0) | b[1] >> 4;
+}
+
+// where pixel i starts in each target
+static inline int offset_444(int i) { return i / 2 * 3; }
+static inline int offset_565_le(int i) { return i * 2; }
+static inline int offset_565_be(int i) { return i * 2; }
+static inline int offset_666(int i) { return i * 3; }
+
+#define SCALAR_KERNEL(source, layout)                                   \
+  static void convert_##source##_##layout##_scalar(uint8_t *dst, const uint8_t *src, \
+                                                   int width) {         \
+    for (int i = 0; i < width; i += 2) {                                \
+      int count = width - i < 2 ? 1 : 2;                                \
+      uint8_t r[2] = {0}, g[2] = {0}, b[2] = {0};                       \
+      for (int k = 0; k < count; k++)                                   \
+        load_##source(src, i + k, &r[k], &g[k], &b[k]);                 \
+      store_##layout(dst, i, r, g, b, count);                           \
+    }                                                                   \
+  }
+
+#define SCALAR_KERNELS(source)                  \
+  SCALAR_KERNEL(source, 444)                    \
+  SCALAR_KERNEL(source, 565_le)                 \
+  SCALAR_KERNEL(source, 565_be)                 \
+  SCALAR_KERNEL(source, 666)
+
+SCALAR_KERNELS(rgb565)
+SCALAR_KERNELS(bgr565)
+SCALAR_KERNELS(rgb888)
+SCALAR_KERNELS(xrgb8888)
+
+#define KERNEL_ROW(source, suffix)                                      \
+  {convert_##source##_444_##suffix, convert_##source##_565_le_##suffix, \
+   convert_##source##_565_be_##suffix, convert_##source##_666_##suffix}
+
+static const convert_row_fn scalar_kernels[PIXEL_FORMAT_COUNT][TARGET_COUNT] = {
+  KERNEL_ROW(rgb565, scalar),
+  KERNEL_ROW(bgr565, scalar),
+  KERNEL_ROW(rgb888, scalar),
+  KERNEL_ROW(xrgb8888, scalar),
+};
+
+// bayer thresholds, added to each channel before it is cut to 4 bits.
+// rows repeat the pattern so vector loads can start at any column
+static const uint8_t dither_rows[4][20] = {
+  {0, 8, 2, 10, 0, 8, 2, 10, 0, 8, 2, 10, 0, 8, 2, 10, 0, 8, 2, 10},
+  {12, 4, 14, 6, 12, 4, 14, 6, 12, 4, 14, 6, 12, 4, 14, 6, 12, 4, 14, 6},
+  {3, 11, 1, 9, 3, 11, 1, 9, 3, 11, 1, 9, 3, 11, 1, 9, 3, 11, 1, 9},
+  {15, 7, 13, 5, 15, 7, 13, 5, 15, 7, 13, 5, 15, 7, 13, 5, 15, 7, 13, 5},
+};
+
+static inline uint8_t add_threshold(uint8_t v, uint8_t t) {
+  return v + t > 0xFF ? 0xFF : v + t;
+}
+
+#define SCALAR_DITHER_KERNEL(source)                                    \
+  static void dither_##source##_scalar(uint8_t *dst, const uint8_t *src, int width, \
+                                       int x, int y) {                  \
+    const uint8_t *thresholds = dither_rows[y & 3];                     \
+    for (int i = 0; i < width; i += 2) {                                \
+      int count = width - i < 2 ? 1 : 2;                                \
+      uint8_t r[2] = {0}, g[2] = {0}, b[2] = {0};                       \
+      for (int k = 0; k < count; k++) {                                 \
+        load_##source(src, i + k, &r[k], &g[k], &b[k]);                 \
+        uint8_t t = thresholds[(x + i + k) & 3];                        \
+        r[k] = add_threshold(r[k], t);                                  \
+        g[k] = add_threshold(g[k], t);                                  \
+        b[k] = add_threshold(b[k], t);                                  \
+      }                                                                 \
+      store_444(dst, i, r, g, b, count);                                \
+    }                                                                   \
+  }
+
+SCALAR_DITHER_KERNEL(rgb565)
+SCALAR_DITHER_KERNEL(bgr565)
+SCALAR_DITHER_KERNEL(rgb888)
+SCALAR_DITHER_KERNEL(xrgb8888)
+
+static const dither_row_fn scalar_dither_kernels[PIXEL_FORMAT_COUNT] = {
+  dither_rgb565_scalar, dither_bgr565_scalar, dither_rgb888_scalar,
+  dither_xrgb8888_scalar,
+};
+
+
+/// ---- X86 Kernels ----
+
+// no byte shuffles in sse2, so only the 16 bit sources and xrgb8888 into
+// 16 bit targets are vectorised. loads give 565 pixels in 16 bit lanes
+
+#ifdef PIXEL_CONVERT_X86
+
+__attribute__((target("sse2")))
+static inline __m128i xrgb_lanes_to_565_sse2(__m128i p) {
+  __m128i r = _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0xF800));
+  __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x07E0));
+  __m128i b = _mm_and_si128(_mm_srli_epi32(p, 3), _mm_set1_epi32(0x001F));
+  return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i load_xrgb8888_sse2(const uint8_t *src) {
+  __m128i a = xrgb_lanes_to_565_sse2(_mm_loadu_si128((const __m128i *)src));
+  __m128i b = xrgb_lanes_to_565_sse2(_mm_loadu_si128((const __m128i *)&src[16]));
+  // packs saturates signed, so shift into the signed range and back
+  __m128i bias = _mm_set1_epi32(0x8000);
+  __m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, bias), _mm_sub_epi32(b, bias));
+  return _mm_add_epi16(packed, _mm_set1_epi16((short)0x8000));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i load_rgb565_sse2(const uint8_t *src) {
+  return _mm_loadu_si128((const __m128i *)src);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i load_bgr565_sse2(const uint8_t *src) {
+  __m128i p = _mm_loadu_si128((const __m128i *)src);
+  return _mm_or_si128(_mm_or_si128(_mm_slli_epi16(p, 11), _mm_srli_epi16(p, 11)),
+                      _mm_and_si128(p, _mm_set1_epi16(0x07E0)));
+}
+
+__attribute__((target("sse2")))
+static inline void store_565_le_sse2(uint8_t *dst, __m128i p) {
+  _mm_storeu_si128((__m128i *)dst, p);
+}
+
+__attribute__((target("sse2")))
+static inline void store_565_be_sse2(uint8_t *dst, __m128i p) {
+  _mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_slli_epi16(p, 8), _mm_srli_epi16(p, 8)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i xrgb_lanes_to_565_avx2(__m256i p) {
+  __m256i r = _mm256_and_si256(_mm256_srli_epi32(p, 8), _mm256_set1_epi32(0xF800));
+  __m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 5), _mm256_set1_epi32(0x07E0));
+  __m256i b = _mm256_and_si256(_mm256_srli_epi32(p, 3), _mm256_set1_epi32(0x001F));
+  return _mm256_or_si256(_mm256_or_si256(r, g), b);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i load_xrgb8888_avx2(const uint8_t *src) {
+  __m256i a = xrgb_lanes_to_565_avx2(_mm256_loadu_si256((const __m256i *)src));
+  __m256i b = xrgb_lanes_to_565_avx2(_mm256_loadu_si256((const __m256i *)&src[32]));
+  // packing works within 128 bit halves, put the quarters back in order
+  return _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i load_rgb565_avx2(const uint8_t *src) {
+  return _mm256_loadu_si256((const __m256i *)src);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i load_bgr565_avx2(const uint8_t *src) {
+  __m256i p = _mm256_loadu_si256((const __m256i *)src);
+  return _mm256_or_si256(
+      _mm256_or_si256(_mm256_slli_epi16(p, 11), _mm256_srli_epi16(p, 11)),
+      _mm256_and_si256(p, _mm256_set1_epi16(0x07E0)));
+}
+
+__attribute__((target("avx2")))
+static inline void store_565_le_avx2(uint8_t *dst, __m256i p) {
+  _mm256_storeu_si256((__m256i *)dst, p);
+}
+
+__attribute__((target("avx2")))
+static inline void store_565_be_avx2(uint8_t *dst, __m256i p) {
+  _mm256_storeu_si256((__m256i *)dst,
+                      _mm256_or_si256(_mm256_slli_epi16(p, 8), _mm256_srli_epi16(p, 8)));
+}
+
+// whole steps of pixels are vectorised, the rest go to the scalar kernel
+#define X86_KERNEL(source, layout, pixel_bytes, isa, step)              \
+  __attribute__((target(#isa)))                                         \
+  static void convert_##source##_##layout##_##isa(uint8_t *dst, const uint8_t *src, \
+                                                  int width) {          \
+    int i = 0;                                                          \
+    for (; i + step <= width; i += step)                                \
+      store_##layout##_##isa(&dst[i * 2], load_##source##_##isa(&src[i * pixel_bytes])); \
+    convert_##source##_##layout##_scalar(&dst[i * 2], &src[i * pixel_bytes], width - i); \
+  }
+
+#define X86_KERNELS(isa, step)                          \
+  X86_KERNEL(rgb565, 565_le, 2, isa, step)              \
+  X86_KERNEL(rgb565, 565_be, 2, isa, step)              \
+  X86_KERNEL(bgr565, 565_le, 2, isa, step)              \
+  X86_KERNEL(bgr565, 565_be, 2, isa, step)              \
+  X86_KERNEL(xrgb8888, 565_le, 4, isa, step)            \
+  X86_KERNEL(xrgb8888, 565_be, 4, isa, step)
+
+X86_KERNELS(sse2, 8)
+X86_KERNELS(avx2, 16)
+
+#define X86_KERNEL_ROW(source, isa)                                     \
+  {NULL, convert_##source##_565_le_##isa, convert_##source##_565_be_##isa, NULL}
+
+static const convert_row_fn sse2_kernels[PIXEL_FORMAT_COUNT][TARGET_COUNT] = {
+  X86_KERNEL_ROW(rgb565, sse2),
+  X86_KERNEL_ROW(bgr565, sse2),
+  {NULL},
+  X86_KERNEL_ROW(xrgb8888, sse2),
+};
+
+static const convert_row_fn avx2_kernels[PIXEL_FORMAT_COUNT][TARGET_COUNT] = {
+  X86_KERNEL_ROW(rgb565, avx2),
+  X86_KERNEL_ROW(bgr565, avx2),
+  {NULL},
+  X86_KERNEL_ROW(xrgb8888, avx2),
+};
+
+#endif
+
+
+/// ---- NEON Kernels ----
+
+// 16 pixels at a time, structure loads and stores split and interleave
+// the channels so every pair of formats is covered
+
+#ifdef __ARM_NEON
+
+// 565 lanes to 8 bit channels, top bits repeated into the bottom
+static inline uint8x16x3_t unpack565_neon(uint16x8_t lo, uint16x8_t hi) {
+  uint8x16_t r = vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+  uint8x16_t g = vcombine_u8(vshrn_n_u16(lo, 3), vshrn_n_u16(hi, 3));
+  uint8x16_t b = vcombine_u8(vmovn_u16(vshlq_n_u16(lo, 3)), vmovn_u16(vshlq_n_u16(hi, 3)));
+  r = vandq_u8(r, vdupq_n_u8(0xF8));
+  g = vandq_u8(g, vdupq_n_u8(0xFC));
+  b = vandq_u8(b, vdupq_n_u8(0xF8));
+  uint8x16x3_t rgb;
+  rgb.val[0] = vorrq_u8(r, vshrq_n_u8(r, 5));
+  rgb.val[1] = vorrq_u8(g, vshrq_n_u8(g, 6));
+  rgb.val[2] = vorrq_u8(b, vshrq_n_u8(b, 5));
+  return rgb;
+}
+
+static inline uint8x16x3_t load_rgb565_neon(const uint8_t *src) {
+  return unpack565_neon(vld1q_u16((const uint16_t *)src),
+                        vld1q_u16((const uint16_t *)&src[16]));
+}
+
+static inline uint8x16x3_t load_bgr565_neon(const uint8_t *src) {
+  uint8x16x3_t bgr = load_rgb565_neon(src);
+  uint8x16_t b = bgr.val[0];
+  bgr.val[0] = bgr.val[2];
+  bgr.val[2] = b;
+  return bgr;
+}
+
+static inline uint8x16x3_t load_rgb888_neon(const uint8_t *src) {
+  uint8x16x3_t bgr = vld3q_u8(src);
+  uint8x16x3_t rgb = {{bgr.val[2], bgr.val[1], bgr.val[0]}};
+  return rgb;
+}
+
+static inline uint8x16x3_t load_xrgb8888_neon(const uint8_t *src) {
+  uint8x16x4_t bgrx = vld4q_u8(src);
+  uint8x16x3_t rgb = {{bgrx.val[2], bgrx.val[1], bgrx.val[0]}};
+  return rgb;
+}
+
+static inline uint16x8_t pack565_neon(uint8x8_t r, uint8x8_t g, uint8x8_t b) {
+  uint16x8_t p = vshll_n_u8(r, 8);
+  p = vsriq_n_u16(p, vshll_n_u8(g, 8), 5);
+  return vsriq_n_u16(p, vshll_n_u8(b, 8), 11);
+}
+
+static inline void store_565_le_neon(uint8_t *dst, uint8x16x3_t c) {
+  vst1q_u16((uint16_t *)dst, pack565_neon(vget_low_u8(c.val[0]), vget_low_u8(c.val[1]),
+                                          vget_low_u8(c.val[2])));
+  vst1q_u16((uint16_t *)&dst[16], pack565_neon(vget_high_u8(c.val[0]),
+                                               vget_high_u8(c.val[1]),
+                                               vget_high_u8(c.val[2])));
+}
+
+static inline void store_565_be_neon(uint8_t *dst, uint8x16x3_t c) {
+  uint16x8_t lo = pack565_neon(vget_low_u8(c.val[0]), vget_low_u8(c.val[1]),
+                               vget_low_u8(c.val[2]));
+  uint16x8_t hi = pack565_neon(vget_high_u8(c.val[0]), vget_high_u8(c.val[1]),
+                               vget_high_u8(c.val[2]));
+  vst1q_u8(dst, vrev16q_u8(vreinterpretq_u8_u16(lo)));
+  vst1q_u8(&dst[16], vrev16q_u8(vreinterpretq_u8_u16(hi)));
+}
+
+static inline void store_666_neon(uint8_t *dst, uint8x16x3_t c) {
+  uint8x16_t mask = vdupq_n_u8(0xFC);
+  uint8x16x3_t out = {{vandq_u8(c.val[0], mask), vandq_u8(c.val[1], mask),
+                       vandq_u8(c.val[2], mask)}};
+  vst3q_u8(dst, out);
+}
+
+static inline void store_444_neon(uint8_t *dst, uint8x16x3_t c) {
+  // even pixels in val[0], odd in val[1]
+  uint8x8x2_t r = vuzp_u8(vget_low_u8(c.val[0]), vget_high_u8(c.val[0]));
+  uint8x8x2_t g = vuzp_u8(vget_low_u8(c.val[1]), vget_high_u8(c.val[1]));
+  uint8x8x2_t b = vuzp_u8(vget_low_u8(c.val[2]), vget_high_u8(c.val[2]));
+  uint8x8x3_t out;
+  out.val[0] = vsri_n_u8(r.val[0], g.val[0], 4);
+  out.val[1] = vsri_n_u8(b.val[0], r.val[1], 4);
+  out.val[2] = vsri_n_u8(g.val[1], b.val[1], 4);
+  vst3_u8(dst, out);
+}
+
+#define NEON_KERNEL(source, layout, pixel_bytes)                        \
+  static void convert_##source##_##layout##_neon(uint8_t *dst, const uint8_t *src, \
+                                                 int width) {           \
+    int i = 0;                                                          \
+    for (; i + 16 <= width; i += 16)                                    \
+      store_##layout##_neon(&dst[offset_##layout(i)],                   \
+                            load_##source##_neon(&src[i * pixel_bytes])); \
+    convert_##source##_##layout##_scalar(&dst[offset_##layout(i)],     \
+                                         &src[i * pixel_bytes], width - i); \
+  }
+
+#define NEON_KERNELS(source, pixel_bytes)       \
+  NEON_KERNEL(source, 444, pixel_bytes)         \
+  NEON_KERNEL(source, 565_le, pixel_bytes)      \
+  NEON_KERNEL(source, 565_be, pixel_bytes)      \
+  NEON_KERNEL(source, 666, pixel_bytes)
+
+NEON_KERNELS(rgb565, 2)
+NEON_KERNELS(bgr565, 2)
+NEON_KERNELS(rgb888, 3)
+NEON_KERNELS(xrgb8888, 4)
+
+static const convert_row_fn neon_kernels[PIXEL_FORMAT_COUNT][TARGET_COUNT] = {
+  KERNEL_ROW(rgb565, neon),
+  KERNEL_ROW(bgr565, neon),
+  KERNEL_ROW(rgb888, neon),
+  KERNEL_ROW(xrgb8888, neon),
+};
+
+#define NEON_DITHER_KERNEL(source, pixel_bytes)                         \
+  static void dither_##source##_neon(uint8_t *dst, const uint8_t *src, int width, \
+                                     int x, int y) {                    \
+    int i = 0;                                                          \
+    for (; i + 16 <= width; i += 16) {                                  \
+      uint8x16_t t = vld1q_u8(&dither_rows[y & 3][(x + i) & 3]);        \
+      uint8x16x3_t c = load_##source##_neon(&src[i * pixel_bytes]);     \
+      c.val[0] = vqaddq_u8(c.val[0], t);                                \
+      c.val[1] = vqaddq_u8(c.val[1], t);                                \
+      c.val[2] = vqaddq_u8(c.val[2], t);                                \
+      store_444_neon(&dst[offset_444(i)], c);                           \
+    }                                                                   \
+    dither_##source##_scalar(&dst[offset_444(i)], &src[i * pixel_bytes], \
+                             width - i, x + i, y);                      \
+  }
+
+NEON_DITHER_KERNEL(rgb565, 2)
+NEON_DITHER_KERNEL(bgr565, 2)
+NEON_DITHER_KERNEL(rgb888, 3)
+NEON_DITHER_KERNEL(xrgb8888, 4)
+
+static const dither_row_fn neon_dither_kernels[PIXEL_FORMAT_COUNT] = {
+  dither_rgb565_neon, dither_bgr565_neon, dither_rgb888_neon, dither_xrgb8888_neon,
+};
+
+#endif
+
+
+/// ---- Helper Definitions ----
+
+
+static convert_row_fn choose_kernel(enum pixel_format src_format,
+                                    enum convert_target target) {
+  convert_row_fn kernel = vector_kernel(src_format, target);
+  return kernel != NULL ? kernel : scalar_kernels[src_format][target];
+}
+
+// the selected kernel's own conversion, NULL if it has none
+static convert_row_fn vector_kernel(enum pixel_format src_format,
+                                    enum convert_target target) {
+  convert_row_fn kernel = NULL;
+  switch (pixel_kernel_selected()) {
+#ifdef PIXEL_CONVERT_X86
+  case PIXEL_KERNEL_AVX2:
+    kernel = avx2_kernels[src_format][target];
+    break;
+  case PIXEL_KERNEL_SSE2:
+    kernel = sse2_kernels[src_format][target];
+    break;
+#endif
+#ifdef __ARM_NEON
+  case PIXEL_KERNEL_NEON:
+    kernel = neon_kernels[src_format][target];
+    break;
+#endif
+  default:
+    break;
+  }
+  return kernel;
+}
+
+static dither_row_fn choose_dither_kernel(enum pixel_format src_format) {
+#ifdef __ARM_NEON
+  if (pixel_kernel_selected() == PIXEL_KERNEL_NEON)
+    return neon_dither_kernels[src_format];
+#endif
+  return scalar_dither_kernels[src_format];
+}
+
+static enum convert_target target_for(enum display_colour_format format,
+                                      int little_endian) {
+  switch (format) {
+  case COLOUR_FORMAT_12_BIT:
+    return TARGET_444;
+  case COLOUR_FORMAT_18_BIT:
+    return TARGET_666;
+  default:
+    return little_endian ? TARGET_565_LE : TARGET_565_BE;
+  }
+}
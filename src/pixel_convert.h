@@ -0,0 +1,59 @@
+#ifndef DISPLAY_PIXEL_CONVERT_H
+#define DISPLAY_PIXEL_CONVERT_H
+
+#include <stdint.h>
+
+#include "display.h"
+
+/// Converts pixels from the formats X and the framebuffer give us into
+/// the ones the panel takes. 16 bit output can be byte swapped as part of
+/// the conversion rather than relying on ADDRESS_COLOUR_LITTLE_ENDIAN.
+/// Uses the kernel chosen in pixel_kernel.h: NEON handles every pair of
+/// formats, SSE2 and AVX2 the 32 and 16 bit sources into 16 bit output,
+/// the rest falls back to plain C.
+
+enum pixel_format {
+  // 16 bit little endian words RRRRRGGGGGGBBBBB, as X and the linux fb use
+  PIXEL_FORMAT_RGB565,
+  // 16 bit little endian words BBBBBGGGGGGRRRRR
+  PIXEL_FORMAT_BGR565,
+  // 24 bit little endian 0xRRGGBB, ie bytes b, g, r
+  PIXEL_FORMAT_RGB888,
+  // 32 bit little endian words 0xXXRRGGBB, ie bytes b, g, r, x
+  PIXEL_FORMAT_XRGB8888,
+  PIXEL_FORMAT_COUNT,
+};
+
+int pixel_format_bytes(enum pixel_format format);
+
+const char *pixel_format_name(enum pixel_format format);
+
+// bytes a row of width pixels takes in a panel colour format,
+// 12 bit packs pairs of pixels into 3 bytes
+int pixel_panel_row_bytes(enum display_colour_format format, int width);
+
+// convert a row of width pixels. 16 bit output is in the panel's native
+// big endian order unless little_endian is set, to match a display set up
+// with ADDRESS_COLOUR_LITTLE_ENDIAN. 12 and 18 bit output ignore it
+void pixel_convert_row(uint8_t *dst, enum display_colour_format dst_format,
+                       int little_endian, const uint8_t *src,
+                       enum pixel_format src_format, int width);
+
+// convert width x height pixels, rows are dst_stride and src_stride bytes apart
+void pixel_convert(uint8_t *dst, int dst_stride, enum display_colour_format dst_format,
+                   int little_endian, const uint8_t *src, int src_stride,
+                   enum pixel_format src_format, int width, int height);
+
+// whether the selected kernel has its own conversion between the formats,
+// rather than falling back to plain C
+int pixel_convert_vectorised(enum display_colour_format dst_format, int little_endian,
+                             enum pixel_format src_format);
+
+// convert to 12 bit like pixel_convert, with a 4x4 ordered dither to hide
+// the banding. x and y are where the first pixel is on screen, so the
+// pattern lines up between areas converted separately. NEON or plain C
+void pixel_convert_444_dithered(uint8_t *dst, int dst_stride, const uint8_t *src,
+                                int src_stride, enum pixel_format src_format,
+                                int x, int y, int width, int height);
+
+#endif
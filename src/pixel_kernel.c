@@ -0,0 +1,274 @@
+#include "pixel_kernel.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PIXEL_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+typedef int (*diff_copy_row_fn)(uint8_t *dst, const uint8_t *src, int row_bytes,
+                                int segment_bytes, uint8_t *changed);
+
+static int diff_copy_row_scalar(uint8_t *dst, const uint8_t *src, int row_bytes,
+                                int segment_bytes, uint8_t *changed);
+#ifdef PIXEL_KERNEL_X86
+static int diff_copy_row_sse2(uint8_t *dst, const uint8_t *src, int row_bytes,
+                              int segment_bytes, uint8_t *changed);
+static int diff_copy_row_avx2(uint8_t *dst, const uint8_t *src, int row_bytes,
+                              int segment_bytes, uint8_t *changed);
+#endif
+#ifdef __ARM_NEON
+static int diff_copy_row_neon(uint8_t *dst, const uint8_t *src, int row_bytes,
+                              int segment_bytes, uint8_t *changed);
+#endif
+
+static enum pixel_kernel selected = PIXEL_KERNEL_COUNT;
+static diff_copy_row_fn diff_copy_row = NULL;
+
+
+/// ---- Api Implementation ----
+
+
+int pixel_kernel_supported(enum pixel_kernel kernel) {
+  switch (kernel) {
+  case PIXEL_KERNEL_SCALAR:
+    return 1;
+#ifdef PIXEL_KERNEL_X86
+  case PIXEL_KERNEL_SSE2:
+    return __builtin_cpu_supports("sse2");
+  case PIXEL_KERNEL_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+#ifdef __ARM_NEON
+  case PIXEL_KERNEL_NEON:
+    return 1;
+#endif
+  default:
+    return 0;
+  }
+}
+
+enum pixel_kernel pixel_kernel_best() {
+  enum pixel_kernel order[] = {
+    PIXEL_KERNEL_NEON, PIXEL_KERNEL_AVX2, PIXEL_KERNEL_SSE2,
+  };
+  for (unsigned int i = 0; i < sizeof(order) / sizeof(order[0]); i++)
+    if (pixel_kernel_supported(order[i]))
+      return order[i];
+  return PIXEL_KERNEL_SCALAR;
+}
+
+void pixel_kernel_select(enum pixel_kernel kernel) {
+  if (!pixel_kernel_supported(kernel))
+    kernel = PIXEL_KERNEL_SCALAR;
+  switch (kernel) {
+#ifdef PIXEL_KERNEL_X86
+  case PIXEL_KERNEL_SSE2:
+    diff_copy_row = diff_copy_row_sse2;
+    break;
+  case PIXEL_KERNEL_AVX2:
+    diff_copy_row = diff_copy_row_avx2;
+    break;
+#endif
+#ifdef __ARM_NEON
+  case PIXEL_KERNEL_NEON:
+    diff_copy_row = diff_copy_row_neon;
+    break;
+#endif
+  default:
+    diff_copy_row = diff_copy_row_scalar;
+    break;
+  }
+  selected = kernel;
+}
+
+enum pixel_kernel pixel_kernel_selected() {
+  if (diff_copy_row == NULL)
+    pixel_kernel_select(pixel_kernel_best());
+  return selected;
+}
+
+const char *pixel_kernel_name(enum pixel_kernel kernel) {
+  switch (kernel) {
+  case PIXEL_KERNEL_SCALAR:
+    return "scalar";
+  case PIXEL_KERNEL_SSE2:
+    return "sse2";
+  case PIXEL_KERNEL_AVX2:
+    return "avx2";
+  case PIXEL_KERNEL_NEON:
+    return "neon";
+  default:
+    return "unknown";
+  }
+}
+
+int pixel_diff_copy_row(uint8_t *dst, const uint8_t *src, int row_bytes,
+                        int segment_bytes, uint8_t *changed) {
+  if (diff_copy_row == NULL)
+    pixel_kernel_select(pixel_kernel_best());
+  return diff_copy_row(dst, src, row_bytes, segment_bytes, changed);
+}
+
+int pixel_diff_copy(uint8_t *dst, const uint8_t *src, int width, int height,
+                    int pixel_bytes, int src_stride, int tile_size,
+                    uint8_t *tiles, pixel_bounds *bounds) {
+  if (diff_copy_row == NULL)
+    pixel_kernel_select(pixel_kernel_best());
+  int row_bytes = width * pixel_bytes;
+  int segment_bytes = tile_size * pixel_bytes;
+  int columns = (width + tile_size - 1) / tile_size;
+  int rows = (height + tile_size - 1) / tile_size;
+  memset(tiles, 0, columns * rows);
+
+  int y0 = -1, y1 = -1;
+  for (int y = 0; y < height; y++) {
+    uint8_t *row_tiles = &tiles[(y / tile_size) * columns];
+    if (diff_copy_row(&dst[(size_t)y * row_bytes], &src[(size_t)y * src_stride],
+                      row_bytes, segment_bytes, row_tiles)) {
+      if (y0 == -1)
+        y0 = y;
+      y1 = y;
+    }
+  }
+
+  int changed = 0;
+  int tx0 = columns, tx1 = -1;
+  for (int ty = 0; ty < rows; ty++)
+    for (int tx = 0; tx < columns; tx++)
+      if (tiles[ty * columns + tx]) {
+        changed++;
+        if (tx < tx0)
+          tx0 = tx;
+        if (tx > tx1)
+          tx1 = tx;
+      }
+
+  if (bounds != NULL) {
+    if (changed) {
+      bounds->x0 = tx0 * tile_size;
+      bounds->x1 = (tx1 + 1) * tile_size - 1;
+      if (bounds->x1 >= width)
+        bounds->x1 = width - 1;
+    } else {
+      bounds->x0 = bounds->x1 = -1;
+    }
+    bounds->y0 = y0;
+    bounds->y1 = y1;
+  }
+  return changed;
+}
+
+
+/// ---- Kernels ----
+
+// each kernel only differs in how a span is compared, differing segments
+// are copied with memcpy which is already vectorised. Most rows of most
+// frames are unchanged, so the whole row is checked before any segments
+
+#define DIFF_COPY_ROW(differs)                                          \
+  if (!differs(dst, src, row_bytes))                                    \
+    return 0;                                                           \
+  int count = 0;                                                        \
+  for (int start = 0, i = 0; start < row_bytes; start += segment_bytes, i++) { \
+    int size = row_bytes - start < segment_bytes ? row_bytes - start : segment_bytes; \
+    if (differs(&dst[start], &src[start], size)) {                      \
+      memcpy(&dst[start], &src[start], size);                           \
+      changed[i] = 1;                                                   \
+      count++;                                                          \
+    }                                                                   \
+  }                                                                     \
+  return count;
+
+static inline int differs_tail(const uint8_t *a, const uint8_t *b, int i, int size) {
+  uint8_t diff = 0;
+  for (; i < size; i++)
+    diff |= a[i] ^ b[i];
+  return diff != 0;
+}
+
+static inline int differs_scalar(const uint8_t *a, const uint8_t *b, int size) {
+  uint64_t diff = 0;
+  int i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t x, y;
+    memcpy(&x, &a[i], 8);
+    memcpy(&y, &b[i], 8);
+    diff |= x ^ y;
+  }
+  return diff != 0 || differs_tail(a, b, i, size);
+}
+
+static int diff_copy_row_scalar(uint8_t *dst, const uint8_t *src, int row_bytes,
+                                int segment_bytes, uint8_t *changed) {
+  DIFF_COPY_ROW(differs_scalar)
+}
+
+#ifdef PIXEL_KERNEL_X86
+
+__attribute__((target("sse2")))
+static inline int differs_sse2(const uint8_t *a, const uint8_t *b, int size) {
+  __m128i diff = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 16 <= size; i += 16)
+    diff = _mm_or_si128(diff, _mm_xor_si128(
+                            _mm_loadu_si128((const __m128i *)&a[i]),
+                            _mm_loadu_si128((const __m128i *)&b[i])));
+  int equal = _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) == 0xFFFF;
+  return !equal || differs_tail(a, b, i, size);
+}
+
+__attribute__((target("sse2")))
+static int diff_copy_row_sse2(uint8_t *dst, const uint8_t *src, int row_bytes,
+                              int segment_bytes, uint8_t *changed) {
+  DIFF_COPY_ROW(differs_sse2)
+}
+
+__attribute__((target("avx2")))
+static inline int differs_avx2(const uint8_t *a, const uint8_t *b, int size) {
+  __m256i diff = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 32 <= size; i += 32)
+    diff = _mm256_or_si256(diff, _mm256_xor_si256(
+                               _mm256_loadu_si256((const __m256i *)&a[i]),
+                               _mm256_loadu_si256((const __m256i *)&b[i])));
+  __m128i half = _mm_or_si128(_mm256_castsi256_si128(diff),
+                              _mm256_extracti128_si256(diff, 1));
+  for (; i + 16 <= size; i += 16)
+    half = _mm_or_si128(half, _mm_xor_si128(
+                            _mm_loadu_si128((const __m128i *)&a[i]),
+                            _mm_loadu_si128((const __m128i *)&b[i])));
+  return !_mm_testz_si128(half, half) || differs_tail(a, b, i, size);
+}
+
+__attribute__((target("avx2")))
+static int diff_copy_row_avx2(uint8_t *dst, const uint8_t *src, int row_bytes,
+                              int segment_bytes, uint8_t *changed) {
+  DIFF_COPY_ROW(differs_avx2)
+}
+
+#endif
+
+#ifdef __ARM_NEON
+
+static inline int differs_neon(const uint8_t *a, const uint8_t *b, int size) {
+  uint8x16_t diff = vdupq_n_u8(0);
+  int i = 0;
+  for (; i + 16 <= size; i += 16)
+    diff = vorrq_u8(diff, veorq_u8(vld1q_u8(&a[i]), vld1q_u8(&b[i])));
+  uint64x2_t wide = vreinterpretq_u64_u8(diff);
+  uint64_t any = vgetq_lane_u64(wide, 0) | vgetq_lane_u64(wide, 1);
+  return any != 0 || differs_tail(a, b, i, size);
+}
+
+static int diff_copy_row_neon(uint8_t *dst, const uint8_t *src, int row_bytes,
+                              int segment_bytes, uint8_t *changed) {
+  DIFF_COPY_ROW(differs_neon)
+}
+
+#endif
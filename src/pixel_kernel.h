@@ -0,0 +1,53 @@
+#ifndef DISPLAY_PIXEL_KERNEL_H
+#define DISPLAY_PIXEL_KERNEL_H
+
+#include <stdint.h>
+
+/// Compares a new frame against the last sent one while copying it over,
+/// so the change detection and capture copy are done in one pass.
+/// Uses NEON, AVX2 or SSE2 when the cpu has them, otherwise plain C.
+
+enum pixel_kernel {
+  PIXEL_KERNEL_SCALAR,
+  PIXEL_KERNEL_SSE2,
+  PIXEL_KERNEL_AVX2,
+  PIXEL_KERNEL_NEON,
+  PIXEL_KERNEL_COUNT,
+};
+
+// inclusive bounds of the changed pixels, x is rounded out to whole tiles
+typedef struct pixel_bounds {
+  int x0;
+  int y0;
+  int x1;
+  int y1;
+} pixel_bounds;
+
+// whether the kernel was compiled in and the cpu supports it
+int pixel_kernel_supported(enum pixel_kernel kernel);
+
+// fastest supported kernel
+enum pixel_kernel pixel_kernel_best();
+
+// kernel used by the diff functions, defaults to the best one
+void pixel_kernel_select(enum pixel_kernel kernel);
+
+enum pixel_kernel pixel_kernel_selected();
+
+const char *pixel_kernel_name(enum pixel_kernel kernel);
+
+// compare a row split into segments of segment_bytes (last may be shorter),
+// segments of src that differ from dst are copied to dst and marked
+// in changed (never cleared). returns number of segments that differed
+int pixel_diff_copy_row(uint8_t *dst, const uint8_t *src, int row_bytes,
+                        int segment_bytes, uint8_t *changed);
+
+// compare and copy a whole frame in tiles of tile_size pixels.
+// dst is tightly packed, rows of src are src_stride bytes apart.
+// tiles holds one byte per tile and is cleared first, bounds can be NULL.
+// returns the number of changed tiles
+int pixel_diff_copy(uint8_t *dst, const uint8_t *src, int width, int height,
+                    int pixel_bytes, int src_stride, int tile_size,
+                    uint8_t *tiles, pixel_bounds *bounds);
+
+#endif
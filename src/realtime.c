@@ -0,0 +1,60 @@
+#define _GNU_SOURCE
+#include "realtime.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+/// ---- Api Implementation ----
+
+
+int realtime_lock_memory() {
+  // large buffers are otherwise mapped and unmapped on every allocation,
+  // faulting in afresh each time
+  mallopt(M_MMAP_MAX, 0);
+  mallopt(M_TRIM_THRESHOLD, -1);
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+    fprintf(stderr, "Failed to lock memory: %s\n", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+void realtime_prefault(void *buff, size_t size) {
+  volatile uint8_t *bytes = buff;
+  long page = sysconf(_SC_PAGESIZE);
+  for (size_t i = 0; i < size; i += page)
+    bytes[i] = bytes[i];
+  if (size > 0)
+    bytes[size - 1] = bytes[size - 1];
+}
+
+int realtime_configure_thread(pthread_t thread, int cpu, int priority) {
+  if (cpu != -1) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int failed = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (failed) {
+      fprintf(stderr, "Failed to pin thread to cpu %d: %s\n", cpu, strerror(failed));
+      return -1;
+    }
+  }
+  if (priority != 0) {
+    struct sched_param param;
+    param.sched_priority = priority;
+    int failed = pthread_setschedparam(thread, SCHED_FIFO, &param);
+    if (failed) {
+      fprintf(stderr, "Failed to run thread at realtime priority %d: %s\n", priority,
+              strerror(failed));
+      return -1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef DISPLAY_REALTIME_H
+#define DISPLAY_REALTIME_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/// Keeps frame timing steady while other work runs on the pi: threads
+/// pinned to a core and run SCHED_FIFO, so ordinary processes can't delay
+/// them, and memory that never pages out or faults in mid frame.
+/// Both need root or CAP_SYS_NICE / CAP_IPC_LOCK.
+
+// highest priority realtime_configure_thread takes, leaving room above it
+// for the kernel's own threads
+#define REALTIME_MAX_PRIORITY 80
+
+// lock every page the process has and will have into memory, and keep
+// freed heap memory around rather than returning it, so later buffers are
+// reused instead of faulted in again. returns -1 on error
+int realtime_lock_memory();
+
+// write to every page of buff so it is backed before it's first needed,
+// for when memory can't be locked
+void realtime_prefault(void *buff, size_t size);
+
+// pin thread to cpu, unless it is -1, and run it SCHED_FIFO at priority,
+// unless it is 0. returns -1 on error
+int realtime_configure_thread(pthread_t thread, int cpu, int priority);
+
+#endif
@@ -0,0 +1,280 @@
+#include "recording.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ops are the kind in the top 2 bits and a pixel count in the rest
+#define OP_KIND_SHIFT 14
+#define OP_MAX_COUNT ((1 << OP_KIND_SHIFT) - 1)
+// changed pixels of one colour shorter than this are cheaper as literals
+#define MIN_FILL 3
+
+enum op_kind {
+  OP_SKIP,
+  OP_FILL,
+  OP_LITERAL,
+};
+
+static size_t encode(const uint16_t *previous, const uint16_t *current, long count,
+                     uint16_t *ops);
+static uint16_t *emit(uint16_t *ops, enum op_kind kind, long count,
+                      const uint16_t *pixels);
+static long same_run(const uint16_t *a, const uint16_t *b, long i, long count);
+static long fill_run(const uint16_t *pixels, long i, long count, long limit);
+
+
+/// ---- Api Implementation ----
+
+
+int recorder_open(recorder *recorder, const char *path, int width, int height) {
+  long pixels = (long)width * height;
+  recorder->width = width;
+  recorder->height = height;
+  recorder->frames = 0;
+  recorder->first_ns = 0;
+  // starts black, like a replay does
+  recorder->previous = calloc(pixels, sizeof(uint16_t));
+  // at worst a skip and a literal op for every two pixels
+  recorder->ops = malloc((pixels * 3 / 2 + 2) * sizeof(uint16_t));
+  if (recorder->previous == NULL || recorder->ops == NULL) {
+    fprintf(stderr, "Failed to allocate recording buffers\n");
+    free(recorder->previous);
+    free(recorder->ops);
+    return -1;
+  }
+  recorder->file = fopen(path, "wb");
+  if (recorder->file == NULL) {
+    fprintf(stderr, "Failed to open recording %s, %s\n", path, strerror(errno));
+    free(recorder->previous);
+    free(recorder->ops);
+    return -1;
+  }
+  recording_header header;
+  memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+  header.width = width;
+  header.height = height;
+  if (fwrite(&header, sizeof(header), 1, recorder->file) != 1) {
+    fprintf(stderr, "Failed to write recording %s, %s\n", path, strerror(errno));
+    recorder_close(recorder);
+    return -1;
+  }
+  return 0;
+}
+
+void recorder_close(recorder *recorder) {
+  if (fclose(recorder->file) != 0)
+    fprintf(stderr, "Failed to finish recording, %s\n", strerror(errno));
+  free(recorder->previous);
+  free(recorder->ops);
+}
+
+int recorder_write(recorder *recorder, const uint8_t *frame, uint64_t captured_ns) {
+  long pixels = (long)recorder->width * recorder->height;
+  const uint16_t *current = (const uint16_t *)frame;
+  // ie only the cursor or the colour depth changed
+  if (recorder->frames > 0 && same_run(recorder->previous, current, 0, pixels) == pixels)
+    return 0;
+  if (recorder->frames == 0)
+    recorder->first_ns = captured_ns;
+  recording_frame record;
+  record.time_ns = captured_ns - recorder->first_ns;
+  record.size = encode(recorder->previous, current, pixels, recorder->ops)
+                * sizeof(uint16_t);
+  record.reserved = 0;
+  if (fwrite(&record, sizeof(record), 1, recorder->file) != 1
+      || fwrite(recorder->ops, record.size, 1, recorder->file) != 1) {
+    fprintf(stderr, "Failed to write recording, %s\n", strerror(errno));
+    return -1;
+  }
+  memcpy(recorder->previous, current, pixels * sizeof(uint16_t));
+  recorder->frames++;
+  return 0;
+}
+
+int replay_open(replay *replay, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Failed to open recording %s, %s\n", path, strerror(errno));
+    return -1;
+  }
+  struct stat file;
+  if (fstat(fd, &file) == -1 || (size_t)file.st_size < sizeof(recording_header)) {
+    fprintf(stderr, "%s is not a recording\n", path);
+    close(fd);
+    return -1;
+  }
+  replay->map_size = file.st_size;
+  replay->map = mmap(0, replay->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping holds its own reference to the file
+  close(fd);
+  if (replay->map == MAP_FAILED) {
+    fprintf(stderr, "Failed to map recording %s, %s\n", path, strerror(errno));
+    return -1;
+  }
+  // read front to back, once per play
+  madvise((void *)replay->map, replay->map_size, MADV_SEQUENTIAL);
+  recording_header header;
+  memcpy(&header, replay->map, sizeof(header));
+  if (memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0
+      || header.width == 0 || header.height == 0
+      || header.width > UINT16_MAX || header.height > UINT16_MAX) {
+    fprintf(stderr, "%s is not a recording\n", path);
+    munmap((void *)replay->map, replay->map_size);
+    return -1;
+  }
+  replay->width = header.width;
+  replay->height = header.height;
+  replay->end = replay->map_size;
+  replay->frame = malloc((size_t)replay->width * replay->height * sizeof(uint16_t));
+  if (replay->frame == NULL) {
+    fprintf(stderr, "Failed to allocate %d x %d replay frame\n", replay->width,
+            replay->height);
+    munmap((void *)replay->map, replay->map_size);
+    return -1;
+  }
+  replay_rewind(replay);
+  return 0;
+}
+
+void replay_close(replay *replay) {
+  munmap((void *)replay->map, replay->map_size);
+  free(replay->frame);
+}
+
+int replay_next(replay *replay, uint64_t *time_ns, damage_rect *changed) {
+  if (replay->end - replay->next < sizeof(recording_frame))
+    return 0;
+  recording_frame record;
+  memcpy(&record, &replay->map[replay->next], sizeof(record));
+  const uint8_t *ops = &replay->map[replay->next + sizeof(record)];
+  if (replay->end - replay->next - sizeof(record) < record.size)
+    return 0;
+  const uint8_t *end = ops + record.size;
+  long pixels = (long)replay->width * replay->height;
+  // first and last pixel written
+  long first = pixels, last = -1;
+  long i = 0;
+  while (ops + sizeof(uint16_t) <= end) {
+    uint16_t op;
+    memcpy(&op, ops, sizeof(op));
+    ops += sizeof(op);
+    enum op_kind kind = op >> OP_KIND_SHIFT;
+    long count = op & OP_MAX_COUNT;
+    long pixel_bytes = kind == OP_FILL ? sizeof(uint16_t)
+                       : kind == OP_LITERAL ? count * sizeof(uint16_t) : 0;
+    if (kind > OP_LITERAL || count > pixels - i || end - ops < pixel_bytes) {
+      fprintf(stderr, "Recording is damaged at byte %zu, playing up to there\n",
+              (size_t)(ops - replay->map) - sizeof(op));
+      replay->end = replay->next;
+      return 0;
+    }
+    if (kind != OP_SKIP) {
+      if (first > i)
+        first = i;
+      last = i + count - 1;
+    }
+    if (kind == OP_FILL) {
+      uint16_t colour;
+      memcpy(&colour, ops, sizeof(colour));
+      for (long j = 0; j < count; j++)
+        replay->frame[i + j] = colour;
+    } else if (kind == OP_LITERAL) {
+      memcpy(&replay->frame[i], ops, pixel_bytes);
+    }
+    ops += pixel_bytes;
+    i += count;
+  }
+  replay->next += sizeof(record) + record.size;
+  *time_ns = record.time_ns;
+  if (replay->rewound) {
+    *changed = (damage_rect){0, 0, replay->width, replay->height};
+    replay->rewound = 0;
+  } else if (last == -1) {
+    *changed = (damage_rect){0, 0, 0, 0};
+  } else {
+    // whole rows, as runs carry on across them
+    int y0 = first / replay->width;
+    int y1 = last / replay->width;
+    *changed = (damage_rect){0, y0, replay->width, y1 - y0 + 1};
+  }
+  return 1;
+}
+
+void replay_rewind(replay *replay) {
+  memset(replay->frame, 0, (size_t)replay->width * replay->height * sizeof(uint16_t));
+  replay->next = sizeof(recording_header);
+  replay->rewound = 1;
+}
+
+
+/// ---- Helper Definitions ----
+
+
+// write the ops turning previous into current, returns how many words they took
+static size_t encode(const uint16_t *previous, const uint16_t *current, long count,
+                     uint16_t *ops) {
+  uint16_t *start = ops;
+  long i = 0;
+  while (i < count) {
+    long run = same_run(previous, current, i, count);
+    if (run > 0) {
+      ops = emit(ops, OP_SKIP, run, NULL);
+      i += run;
+      continue;
+    }
+    run = fill_run(current, i, count, count);
+    if (run >= MIN_FILL) {
+      ops = emit(ops, OP_FILL, run, &current[i]);
+      i += run;
+      continue;
+    }
+    // changed pixels up to the next unchanged one or fill
+    long literal = i;
+    while (i < count && previous[i] != current[i]
+           && fill_run(current, i, count, MIN_FILL) < MIN_FILL)
+      i++;
+    ops = emit(ops, OP_LITERAL, i - literal, &current[literal]);
+  }
+  return ops - start;
+}
+
+// split runs longer than an op holds into several
+static uint16_t *emit(uint16_t *ops, enum op_kind kind, long count,
+                      const uint16_t *pixels) {
+  while (count > 0) {
+    long part = count < OP_MAX_COUNT ? count : OP_MAX_COUNT;
+    *ops++ = kind << OP_KIND_SHIFT | part;
+    if (kind == OP_FILL) {
+      *ops++ = pixels[0];
+    } else if (kind == OP_LITERAL) {
+      memcpy(ops, pixels, part * sizeof(uint16_t));
+      ops += part;
+      pixels += part;
+    }
+    count -= part;
+  }
+  return ops;
+}
+
+// pixels from i that are the same in a and b
+static long same_run(const uint16_t *a, const uint16_t *b, long i, long count) {
+  long start = i;
+  while (i < count && a[i] == b[i])
+    i++;
+  return i - start;
+}
+
+// pixels from i the same colour as pixel i, counting at most limit
+static long fill_run(const uint16_t *pixels, long i, long count, long limit) {
+  long end = count - i < limit ? count : i + limit;
+  long start = i;
+  while (i < end && pixels[i] == pixels[start])
+    i++;
+  return i - start;
+}
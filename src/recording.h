@@ -0,0 +1,91 @@
+#ifndef DISPLAY_RECORDING_H
+#define DISPLAY_RECORDING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "damage.h"
+
+/// Records frames as they are sent, to replay later as a source in place
+/// of X or the framebuffer, ie to reproduce a slow display without the
+/// session that caused it.
+/// A recording is a header then one record per changed frame: when it was
+/// captured, relative to the first, and how it differs from the frame
+/// before as runs of 16 bit ops, each a kind and a pixel count:
+///  - skip: pixels unchanged
+///  - fill: changed pixels all one colour, given once after the op
+///  - literal: changed pixels, given in full after the op
+/// Runs carry on across rows, pixels are little endian RGB565 and the
+/// first frame is relative to a black one. Everything is written in the
+/// machine's own byte order, little endian on the pi.
+
+#define RECORDING_MAGIC "DISPREC1"
+
+typedef struct recording_header {
+  char magic[8];
+  uint32_t width;
+  uint32_t height;
+} recording_header;
+
+typedef struct recording_frame {
+  // nanoseconds after the first frame was captured
+  uint64_t time_ns;
+  // bytes of ops that follow
+  uint32_t size;
+  uint32_t reserved;
+} recording_frame;
+
+typedef struct recorder {
+  FILE *file;
+  int width;
+  int height;
+  // the frame last written
+  uint16_t *previous;
+  // the ops being encoded
+  uint16_t *ops;
+  // when the first frame was captured
+  uint64_t first_ns;
+  int frames;
+} recorder;
+
+typedef struct replay {
+  const uint8_t *map;
+  size_t map_size;
+  int width;
+  int height;
+  // offset of the next frame's record, and where the last good one ends
+  size_t next;
+  size_t end;
+  // the frame as last decoded, width x height packed little endian RGB565
+  uint16_t *frame;
+  // set by a rewind, the next frame changes the whole picture
+  int rewound;
+} replay;
+
+// start a recording of width x height frames at path, returns -1 on error
+int recorder_open(recorder *recorder, const char *path, int width, int height);
+
+// write the frames recorded so far out and close the file
+void recorder_close(recorder *recorder);
+
+// record a frame of packed little endian RGB565 pixels, captured at
+// captured_ns on the monotonic clock, unless it is the same as the last.
+// returns -1 on error
+int recorder_write(recorder *recorder, const uint8_t *frame, uint64_t captured_ns);
+
+// map the recording at path, returns -1 on error
+int replay_open(replay *replay, const char *path);
+
+void replay_close(replay *replay);
+
+// decode the next frame into replay->frame, setting when it was captured
+// relative to the first and which rows changed. returns 0 once every frame
+// has been played. a recording cut short, ie by the recorder being killed,
+// ends at its last whole frame, and a damaged one at its last good frame
+int replay_next(replay *replay, uint64_t *time_ns, damage_rect *changed);
+
+// play again from the first frame, which then changes the whole picture
+void replay_rewind(replay *replay);
+
+#endif
@@ -0,0 +1,530 @@
+#include "scale.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixel_kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCALE_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// areas made from fewer source pixels than this are scaled on the calling
+// thread alone, waking the workers costs more than they would save
+#define SPLIT_SOURCE_PIXELS (64 * 1024)
+// fewest source pixels a band is made from
+#define BAND_SOURCE_PIXELS (16 * 1024)
+// weights of a line's taps add up to this
+#define WEIGHT_ONE 256
+// widened source rows are xrgb8888
+#define WORK_PIXEL_BYTES 4
+
+typedef void (*accumulate_fn)(uint16_t *sums, const uint8_t *row, int bytes,
+                              uint16_t weight);
+typedef void (*halve_fn)(uint8_t *dst, const uint8_t *a, const uint8_t *b, int width);
+
+static int build_axis(scale_axis *axis, int src_length, int dst_length,
+                      enum scale_filter filter);
+static void free_axis(scale_axis *axis);
+static int alloc_worker(scaler *scaler, scale_worker *worker);
+static void free_worker(scale_worker *worker);
+static void scale_band(void *scaler_ptr, int band, int worker);
+static void scale_band_filtered(scaler *scaler, scale_worker *worker, int y0, int y1);
+static void scale_band_halved(scaler *scaler, scale_worker *worker, int y0, int y1);
+static const uint8_t *source_row(scaler *scaler, int y, int x0, int width,
+                                 uint8_t *buffer);
+static accumulate_fn choose_accumulate();
+static halve_fn choose_halve();
+
+
+/// ---- Api Implementation ----
+
+
+const char *scale_filter_name(enum scale_filter filter) {
+  switch (filter) {
+  case SCALE_FILTER_BOX:
+    return "box";
+  case SCALE_FILTER_BILINEAR:
+    return "bilinear";
+  default:
+    return "unknown";
+  }
+}
+
+int scaler_supported(int src_width, int src_height, int dst_width, int dst_height) {
+  // a box filtered line reads up to the ratio rounded up plus one lines,
+  // one more is left for the picture size being rounded
+  int max_ratio = SCALE_MAX_TAPS - 2;
+  return src_width > 0 && src_height > 0
+    && src_width <= max_ratio * dst_width && src_height <= max_ratio * dst_height;
+}
+
+int scaler_init(scaler *scaler, int src_width, int src_height,
+                enum pixel_format src_format, int dst_width, int dst_height,
+                enum scale_filter filter, work_pool *pool) {
+  if (!scaler_supported(src_width, src_height, dst_width, dst_height)) {
+    fprintf(stderr, "can't scale %d x %d down to %d x %d, it is too large\n",
+            src_width, src_height, dst_width, dst_height);
+    return -1;
+  }
+  memset(scaler, 0, sizeof(*scaler));
+  scaler->src_width = src_width;
+  scaler->src_height = src_height;
+  scaler->src_format = src_format;
+  scaler->dst_width = dst_width;
+  scaler->dst_height = dst_height;
+  scaler->filter = filter;
+
+  // shrink by whichever side is further over, never enlarge
+  int width, height;
+  if ((long)src_width * dst_height > (long)src_height * dst_width) {
+    width = src_width < dst_width ? src_width : dst_width;
+    height = ((long)src_height * width + src_width / 2) / src_width;
+  } else {
+    height = src_height < dst_height ? src_height : dst_height;
+    width = ((long)src_width * height + src_height / 2) / src_height;
+  }
+  if (width < 1)
+    width = 1;
+  if (height < 1)
+    height = 1;
+  scaler->picture = (damage_rect){(dst_width - width) / 2, (dst_height - height) / 2,
+                                  width, height};
+  scaler->halving = filter == SCALE_FILTER_BOX
+    && src_width == width * 2 && src_height == height * 2;
+
+  if (build_axis(&scaler->x, src_width, width, filter) == -1
+      || build_axis(&scaler->y, src_height, height, filter) == -1) {
+    free_axis(&scaler->x);
+    free_axis(&scaler->y);
+    return -1;
+  }
+
+  scaler->pool = pool;
+  int workers = pool != NULL ? pool->thread_count : 1;
+  for (int i = 0; i < workers; i++) {
+    if (alloc_worker(scaler, &scaler->workers[i]) == -1) {
+      fprintf(stderr, "Failed to allocate scaling buffers\n");
+      scaler_free(scaler);
+      return -1;
+    }
+    scaler->worker_count = i + 1;
+  }
+  printf("scaling %d x %d to %d x %d, %s filter%s, %d thread%s\n", src_width, src_height,
+         width, height, scale_filter_name(filter), scaler->halving ? " (2:1)" : "",
+         workers, workers == 1 ? "" : "s");
+  return 0;
+}
+
+void scaler_free(scaler *scaler) {
+  for (int i = 0; i < scaler->worker_count; i++)
+    free_worker(&scaler->workers[i]);
+  scaler->worker_count = 0;
+  free_axis(&scaler->x);
+  free_axis(&scaler->y);
+}
+
+damage_rect scaler_dest_rect(scaler *scaler, damage_rect source) {
+  scale_axis *axes[2] = {&scaler->x, &scaler->y};
+  int lengths[2] = {scaler->picture.w, scaler->picture.h};
+  int starts[2] = {source.x, source.y};
+  int ends[2] = {source.x + source.w, source.y + source.h};
+  int from[2], to[2];
+  for (int a = 0; a < 2; a++) {
+    // first and last lines are both in increasing order
+    scale_axis *axis = axes[a];
+    from[a] = 0;
+    while (from[a] < lengths[a] && axis->first[from[a]] + axis->count[from[a]] <= starts[a])
+      from[a]++;
+    to[a] = lengths[a];
+    while (to[a] > from[a] && axis->first[to[a] - 1] >= ends[a])
+      to[a]--;
+    if (to[a] <= from[a])
+      return (damage_rect){0, 0, 0, 0};
+  }
+  return (damage_rect){scaler->picture.x + from[0], scaler->picture.y + from[1],
+                       to[0] - from[0], to[1] - from[1]};
+}
+
+void scaler_map_point(scaler *scaler, int *x, int *y) {
+  *x = scaler->picture.x + (long)*x * scaler->picture.w / scaler->src_width;
+  *y = scaler->picture.y + (long)*y * scaler->picture.h / scaler->src_height;
+}
+
+void scaler_scale(scaler *scaler, uint8_t *dst, int dst_stride, const uint8_t *src,
+                  int src_stride, damage_rect area) {
+  // clip to the picture
+  damage_rect p = scaler->picture;
+  int x0 = area.x > p.x ? area.x : p.x;
+  int y0 = area.y > p.y ? area.y : p.y;
+  int x1 = area.x + area.w < p.x + p.w ? area.x + area.w : p.x + p.w;
+  int y1 = area.y + area.h < p.y + p.h ? area.y + area.h : p.y + p.h;
+  if (x1 <= x0 || y1 <= y0)
+    return;
+  scaler->dst = dst;
+  scaler->dst_stride = dst_stride;
+  scaler->src = src;
+  scaler->src_stride = src_stride;
+  scaler->area = (damage_rect){x0, y0, x1 - x0, y1 - y0};
+
+  long source_pixels = (long)(x1 - x0) * (y1 - y0) * scaler->src_width / p.w
+    * scaler->src_height / p.h;
+  long row_pixels = source_pixels / (y1 - y0) + 1;
+  scaler->bands = source_pixels < SPLIT_SOURCE_PIXELS ? 1
+    : work_pool_bands(scaler->pool, y1 - y0, (BAND_SOURCE_PIXELS + row_pixels - 1) / row_pixels);
+  work_pool_run(scaler->pool, scale_band, scaler, scaler->bands);
+}
+
+void scaler_clear_borders(scaler *scaler, uint8_t *dst, int dst_stride) {
+  damage_rect p = scaler->picture;
+  int row_bytes = scaler->dst_width * 2;
+  for (int y = 0; y < scaler->dst_height; y++) {
+    uint8_t *row = &dst[y * dst_stride];
+    if (y < p.y || y >= p.y + p.h) {
+      memset(row, 0, row_bytes);
+      continue;
+    }
+    memset(row, 0, p.x * 2);
+    memset(&row[(p.x + p.w) * 2], 0, row_bytes - (p.x + p.w) * 2);
+  }
+}
+
+
+/// ---- Scalar Kernels ----
+
+
+static void accumulate_scalar(uint16_t *sums, const uint8_t *row, int bytes,
+                              uint16_t weight) {
+  for (int i = 0; i < bytes; i++)
+    sums[i] += row[i] * weight;
+}
+
+// average 2x2 blocks of xrgb8888, rounding to nearest
+static void halve_scalar(uint8_t *dst, const uint8_t *a, const uint8_t *b, int width) {
+  for (int i = 0; i < width * 4; i++) {
+    int pixel = i / 4 * 8 + i % 4;
+    dst[i] = (a[pixel] + a[pixel + 4] + b[pixel] + b[pixel + 4] + 2) >> 2;
+  }
+}
+
+
+/// ---- SIMD Kernels ----
+
+// 16 bytes of sums a step. AVX2 runs the SSE2 kernels, they are limited
+// by loading the source rather than the arithmetic
+
+#ifdef SCALE_X86
+
+__attribute__((target("sse2")))
+static void accumulate_sse2(uint16_t *sums, const uint8_t *row, int bytes,
+                            uint16_t weight) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i w = _mm_set1_epi16(weight);
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)&row[i]);
+    __m128i lo = _mm_loadu_si128((const __m128i *)&sums[i]);
+    __m128i hi = _mm_loadu_si128((const __m128i *)&sums[i + 8]);
+    lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), w));
+    hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), w));
+    _mm_storeu_si128((__m128i *)&sums[i], lo);
+    _mm_storeu_si128((__m128i *)&sums[i + 8], hi);
+  }
+  accumulate_scalar(&sums[i], &row[i], bytes - i, weight);
+}
+
+// two neighbouring pixels widened to 16 bit lanes, summed down to one
+__attribute__((target("sse2")))
+static inline __m128i pair_sum_sse2(__m128i pair) {
+  return _mm_add_epi16(pair, _mm_srli_si128(pair, 8));
+}
+
+__attribute__((target("sse2")))
+static void halve_sse2(uint8_t *dst, const uint8_t *a, const uint8_t *b, int width) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i two = _mm_set1_epi16(2);
+  int i = 0;
+  // 4 destination pixels from 8 pixels of each row
+  for (; i + 4 <= width; i += 4) {
+    __m128i out[2];
+    for (int half = 0; half < 2; half++) {
+      __m128i va = _mm_loadu_si128((const __m128i *)&a[(i * 2 + half * 4) * 4]);
+      __m128i vb = _mm_loadu_si128((const __m128i *)&b[(i * 2 + half * 4) * 4]);
+      __m128i lo = pair_sum_sse2(_mm_add_epi16(_mm_unpacklo_epi8(va, zero),
+                                               _mm_unpacklo_epi8(vb, zero)));
+      __m128i hi = pair_sum_sse2(_mm_add_epi16(_mm_unpackhi_epi8(va, zero),
+                                               _mm_unpackhi_epi8(vb, zero)));
+      out[half] = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+    }
+    _mm_storeu_si128((__m128i *)&dst[i * 4], _mm_packus_epi16(out[0], out[1]));
+  }
+  halve_scalar(&dst[i * 4], &a[i * 8], &b[i * 8], width - i);
+}
+
+#endif
+
+#ifdef __ARM_NEON
+
+static void accumulate_neon(uint16_t *sums, const uint8_t *row, int bytes,
+                            uint16_t weight) {
+  uint16x8_t w = vdupq_n_u16(weight);
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    uint8x16_t v = vld1q_u8(&row[i]);
+    uint16x8_t lo = vld1q_u16(&sums[i]);
+    uint16x8_t hi = vld1q_u16(&sums[i + 8]);
+    vst1q_u16(&sums[i], vmlaq_u16(lo, vmovl_u8(vget_low_u8(v)), w));
+    vst1q_u16(&sums[i + 8], vmlaq_u16(hi, vmovl_u8(vget_high_u8(v)), w));
+  }
+  accumulate_scalar(&sums[i], &row[i], bytes - i, weight);
+}
+
+static void halve_neon(uint8_t *dst, const uint8_t *a, const uint8_t *b, int width) {
+  int i = 0;
+  for (; i + 4 <= width; i += 4) {
+    // even pixels in val[0], odd in val[1]
+    uint32x4x2_t va = vld2q_u32((const uint32_t *)&a[i * 8]);
+    uint32x4x2_t vb = vld2q_u32((const uint32_t *)&b[i * 8]);
+    uint8x16_t ae = vreinterpretq_u8_u32(va.val[0]), ao = vreinterpretq_u8_u32(va.val[1]);
+    uint8x16_t be = vreinterpretq_u8_u32(vb.val[0]), bo = vreinterpretq_u8_u32(vb.val[1]);
+    uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(ae), vget_low_u8(ao)),
+                              vaddl_u8(vget_low_u8(be), vget_low_u8(bo)));
+    uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(ae), vget_high_u8(ao)),
+                              vaddl_u8(vget_high_u8(be), vget_high_u8(bo)));
+    vst1q_u8(&dst[i * 4], vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+  }
+  halve_scalar(&dst[i * 4], &a[i * 8], &b[i * 8], width - i);
+}
+
+#endif
+
+
+/// ---- Helper Definitions ----
+
+
+// box weights are how much of each source line a destination line covers,
+// bilinear ones how close the two nearest source lines are to its centre
+static int build_axis(scale_axis *axis, int src_length, int dst_length,
+                      enum scale_filter filter) {
+  axis->first = malloc(dst_length * sizeof(int));
+  axis->count = malloc(dst_length);
+  axis->weights = calloc((size_t)dst_length * SCALE_MAX_TAPS, sizeof(uint16_t));
+  if (axis->first == NULL || axis->count == NULL || axis->weights == NULL) {
+    fprintf(stderr, "Failed to allocate scaling tables\n");
+    return -1;
+  }
+  int m = src_length, n = dst_length;
+  for (int i = 0; i < n; i++) {
+    uint16_t *weights = &axis->weights[i * SCALE_MAX_TAPS];
+    if (filter == SCALE_FILTER_BILINEAR) {
+      // centre of the line in 1/2n source pixels, from the first one's centre
+      long centre = (2L * i + 1) * m - n;
+      if (centre < 0)
+        centre = 0;
+      int line = centre / (2 * n);
+      int next = ((centre - line * 2L * n) * WEIGHT_ONE + n) / (2 * n);
+      axis->first[i] = line;
+      if (line >= m - 1 || next == 0) {
+        axis->count[i] = 1;
+        weights[0] = WEIGHT_ONE;
+      } else {
+        axis->count[i] = 2;
+        weights[0] = WEIGHT_ONE - next;
+        weights[1] = next;
+      }
+      continue;
+    }
+    // the line covers [i * m, (i + 1) * m) in 1/n source pixels
+    long lo = (long)i * m, hi = (long)(i + 1) * m;
+    int first = lo / n;
+    int end = (hi + n - 1) / n;
+    if (end - first > SCALE_MAX_TAPS) {
+      fprintf(stderr, "scaling %d to %d needs too many taps\n", m, n);
+      return -1;
+    }
+    axis->first[i] = first;
+    axis->count[i] = end - first;
+    int total = 0, largest = 0;
+    for (int j = first; j < end; j++) {
+      long from = (long)j * n > lo ? (long)j * n : lo;
+      long to = (long)(j + 1) * n < hi ? (long)(j + 1) * n : hi;
+      int weight = ((to - from) * WEIGHT_ONE + m / 2) / m;
+      weights[j - first] = weight;
+      total += weight;
+      if (weight > weights[largest])
+        largest = j - first;
+    }
+    // rounding error goes on the largest weight, where it shows least
+    weights[largest] += WEIGHT_ONE - total;
+  }
+  return 0;
+}
+
+static void free_axis(scale_axis *axis) {
+  free(axis->first);
+  free(axis->count);
+  free(axis->weights);
+  axis->first = NULL;
+  axis->count = NULL;
+  axis->weights = NULL;
+}
+
+static int alloc_worker(scaler *scaler, scale_worker *worker) {
+  worker->expanded = malloc((size_t)scaler->src_width * WORK_PIXEL_BYTES * 2);
+  worker->sums = malloc((size_t)scaler->src_width * WORK_PIXEL_BYTES * sizeof(uint16_t));
+  worker->row = malloc((size_t)scaler->dst_width * WORK_PIXEL_BYTES);
+  if (worker->expanded == NULL || worker->sums == NULL || worker->row == NULL) {
+    free_worker(worker);
+    return -1;
+  }
+  return 0;
+}
+
+static void free_worker(scale_worker *worker) {
+  free(worker->expanded);
+  free(worker->sums);
+  free(worker->row);
+  worker->expanded = NULL;
+  worker->sums = NULL;
+  worker->row = NULL;
+}
+
+// scale one band of the current job's rows
+static void scale_band(void *scaler_ptr, int band, int worker) {
+  scaler *scaler = scaler_ptr;
+  damage_rect area = scaler->area;
+  int y0 = area.y + area.h * band / scaler->bands;
+  int y1 = area.y + area.h * (band + 1) / scaler->bands;
+  if (scaler->halving)
+    scale_band_halved(scaler, &scaler->workers[worker], y0, y1);
+  else
+    scale_band_filtered(scaler, &scaler->workers[worker], y0, y1);
+}
+
+// sum each row's source lines down into worker->sums, then across
+static void scale_band_filtered(scaler *scaler, scale_worker *worker, int y0, int y1) {
+  accumulate_fn accumulate = choose_accumulate();
+  damage_rect area = scaler->area;
+  int px0 = area.x - scaler->picture.x;
+  int px1 = px0 + area.w;
+  int sx0 = scaler->x.first[px0];
+  int sx1 = scaler->x.first[px1 - 1] + scaler->x.count[px1 - 1];
+  int span_bytes = (sx1 - sx0) * WORK_PIXEL_BYTES;
+  for (int dy = y0; dy < y1; dy++) {
+    int py = dy - scaler->picture.y;
+    const uint16_t *row_weights = &scaler->y.weights[py * SCALE_MAX_TAPS];
+    memset(worker->sums, 0, span_bytes * sizeof(uint16_t));
+    for (int t = 0; t < scaler->y.count[py]; t++) {
+      const uint8_t *line = source_row(scaler, scaler->y.first[py] + t, sx0, sx1 - sx0,
+                                       worker->expanded);
+      accumulate(worker->sums, line, span_bytes, row_weights[t]);
+    }
+    uint8_t *out = worker->row;
+    for (int px = px0; px < px1; px++, out += WORK_PIXEL_BYTES) {
+      const uint16_t *sums = &worker->sums[(scaler->x.first[px] - sx0) * WORK_PIXEL_BYTES];
+      const uint16_t *weights = &scaler->x.weights[px * SCALE_MAX_TAPS];
+      uint32_t b = 0, g = 0, r = 0;
+      for (int t = 0; t < scaler->x.count[px]; t++, sums += WORK_PIXEL_BYTES) {
+        b += sums[0] * weights[t];
+        g += sums[1] * weights[t];
+        r += sums[2] * weights[t];
+      }
+      // both passes' weights are out of 256
+      out[0] = (b + (1 << 15)) >> 16;
+      out[1] = (g + (1 << 15)) >> 16;
+      out[2] = (r + (1 << 15)) >> 16;
+      out[3] = 0;
+    }
+    pixel_convert_row(&scaler->dst[dy * scaler->dst_stride + area.x * 2],
+                      COLOUR_FORMAT_16_BIT, 1, worker->row, PIXEL_FORMAT_XRGB8888, area.w);
+  }
+}
+
+static void scale_band_halved(scaler *scaler, scale_worker *worker, int y0, int y1) {
+  halve_fn halve = choose_halve();
+  damage_rect area = scaler->area;
+  int px0 = area.x - scaler->picture.x;
+  uint8_t *second = &worker->expanded[scaler->src_width * WORK_PIXEL_BYTES];
+  for (int dy = y0; dy < y1; dy++) {
+    int sy = (dy - scaler->picture.y) * 2;
+    const uint8_t *a = source_row(scaler, sy, px0 * 2, area.w * 2, worker->expanded);
+    const uint8_t *b = source_row(scaler, sy + 1, px0 * 2, area.w * 2, second);
+    halve(worker->row, a, b, area.w);
+    pixel_convert_row(&scaler->dst[dy * scaler->dst_stride + area.x * 2],
+                      COLOUR_FORMAT_16_BIT, 1, worker->row, PIXEL_FORMAT_XRGB8888, area.w);
+  }
+}
+
+// width pixels of a source row from x0 as xrgb8888, widened into buffer
+// unless the source already is
+static const uint8_t *source_row(scaler *scaler, int y, int x0, int width,
+                                 uint8_t *buffer) {
+  const uint8_t *row = &scaler->src[(size_t)y * scaler->src_stride];
+  switch (scaler->src_format) {
+  case PIXEL_FORMAT_XRGB8888:
+    return &row[x0 * 4];
+  case PIXEL_FORMAT_RGB888:
+    row += x0 * 3;
+    for (int i = 0; i < width; i++) {
+      buffer[i * 4] = row[i * 3];
+      buffer[i * 4 + 1] = row[i * 3 + 1];
+      buffer[i * 4 + 2] = row[i * 3 + 2];
+      buffer[i * 4 + 3] = 0;
+    }
+    return buffer;
+  default: {
+    // 565, top bits repeated into the bottom
+    int swap = scaler->src_format == PIXEL_FORMAT_BGR565;
+    row += x0 * 2;
+    for (int i = 0; i < width; i++) {
+      unsigned int p = row[i * 2] | row[i * 2 + 1] << 8;
+      unsigned int high = p >> 11, low = p & 0x1F, green = (p >> 5) & 0x3F;
+      uint8_t r = (swap ? low : high) << 3 | (swap ? low : high) >> 2;
+      uint8_t b = (swap ? high : low) << 3 | (swap ? high : low) >> 2;
+      buffer[i * 4] = b;
+      buffer[i * 4 + 1] = green << 2 | green >> 4;
+      buffer[i * 4 + 2] = r;
+      buffer[i * 4 + 3] = 0;
+    }
+    return buffer;
+  }
+  }
+}
+
+static accumulate_fn choose_accumulate() {
+  switch (pixel_kernel_selected()) {
+#ifdef SCALE_X86
+  case PIXEL_KERNEL_AVX2:
+  case PIXEL_KERNEL_SSE2:
+    return accumulate_sse2;
+#endif
+#ifdef __ARM_NEON
+  case PIXEL_KERNEL_NEON:
+    return accumulate_neon;
+#endif
+  default:
+    return accumulate_scalar;
+  }
+}
+
+static halve_fn choose_halve() {
+  switch (pixel_kernel_selected()) {
+#ifdef SCALE_X86
+  case PIXEL_KERNEL_AVX2:
+  case PIXEL_KERNEL_SSE2:
+    return halve_sse2;
+#endif
+#ifdef __ARM_NEON
+  case PIXEL_KERNEL_NEON:
+    return halve_neon;
+#endif
+  default:
+    return halve_scalar;
+  }
+}
@@ -0,0 +1,109 @@
+#ifndef DISPLAY_SCALE_H
+#define DISPLAY_SCALE_H
+
+#include <stdint.h>
+
+#include "damage.h"
+#include "pixel_convert.h"
+#include "work_pool.h"
+
+/// Shrinks frames of any size to fit the panel, keeping their aspect ratio.
+/// The picture is centred and the rest of the frame (the letterbox) is
+/// black. Sources are never enlarged, smaller ones are only centred.
+/// Filtering is separable and fixed point: columns are summed down into
+/// 16 bit lanes, with NEON or SSE2 when the cpu has them, then across.
+/// An exact 2:1 box filter has its own kernel. Large areas are split into
+/// bands of rows scaled on a work pool's threads at the same time.
+/// Only areas of the destination are scaled, so a few changed source
+/// rects cost a few small scales rather than a whole frame.
+
+// most source lines a destination line is filtered from,
+// limiting how far a source can be shrunk
+#define SCALE_MAX_TAPS 16
+
+enum scale_filter {
+  // average of the source area each pixel covers, sharp and alias free
+  SCALE_FILTER_BOX,
+  // blend of the nearest 2x2 source pixels, cheaper but aliases past 2:1
+  SCALE_FILTER_BILINEAR,
+};
+
+// which source lines make up each destination line along one axis
+typedef struct scale_axis {
+  // first source line read, per destination line
+  int *first;
+  // lines read, per destination line
+  uint8_t *count;
+  // count weights per destination line, SCALE_MAX_TAPS apart, summing to 256
+  uint16_t *weights;
+} scale_axis;
+
+struct scaler;
+
+// scratch space for each of the pool's threads
+typedef struct scale_worker {
+  // a source row widened to xrgb8888, two for the 2:1 kernel
+  uint8_t *expanded;
+  // weighted sums of source rows, 16 bits a channel
+  uint16_t *sums;
+  // a destination row in xrgb8888
+  uint8_t *row;
+} scale_worker;
+
+typedef struct scaler {
+  int src_width;
+  int src_height;
+  enum pixel_format src_format;
+  int dst_width;
+  int dst_height;
+  // where the picture is in the destination
+  damage_rect picture;
+  enum scale_filter filter;
+  // box filtering exactly 2:1 both ways
+  int halving;
+  scale_axis x;
+  scale_axis y;
+
+  // NULL to scale on the caller alone
+  work_pool *pool;
+  scale_worker workers[WORK_POOL_MAX_THREADS];
+  int worker_count;
+  // the current job
+  uint8_t *dst;
+  int dst_stride;
+  const uint8_t *src;
+  int src_stride;
+  damage_rect area;
+  int bands;
+} scaler;
+
+const char *scale_filter_name(enum scale_filter filter);
+
+// whether a source this size can be shrunk to fit the destination
+int scaler_supported(int src_width, int src_height, int dst_width, int dst_height);
+
+// set up to scale src_width x src_height frames into little endian RGB565
+// frames of dst_width x dst_height, sharing large areas between pool's
+// threads unless it is NULL. returns -1 on error
+int scaler_init(scaler *scaler, int src_width, int src_height,
+                enum pixel_format src_format, int dst_width, int dst_height,
+                enum scale_filter filter, work_pool *pool);
+
+void scaler_free(scaler *scaler);
+
+// the destination area that changes when the source area does
+damage_rect scaler_dest_rect(scaler *scaler, damage_rect source);
+
+// move a source position to where it is shown in the destination
+void scaler_map_point(scaler *scaler, int *x, int *y);
+
+// scale the part of the picture inside area into dst. src is a whole
+// source frame, rows are dst_stride and src_stride bytes apart.
+// only the source pixels area is made from are read
+void scaler_scale(scaler *scaler, uint8_t *dst, int dst_stride, const uint8_t *src,
+                  int src_stride, damage_rect area);
+
+// fill the destination outside the picture with black
+void scaler_clear_borders(scaler *scaler, uint8_t *dst, int dst_stride);
+
+#endif
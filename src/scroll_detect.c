@@ -0,0 +1,85 @@
+#include "scroll_detect.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// fnv-1a, over whole pixels rather than bytes
+#define HASH_START 0xcbf29ce484222325ull
+#define HASH_PRIME 0x100000001b3ull
+
+static int compare_hashes(const void *a, const void *b);
+
+
+/// ---- Api Implementation ----
+
+
+void scroll_hash_lines(uint64_t *hashes, const uint8_t *pixels, int stride,
+                       int width, int height, int along_x) {
+  if (along_x) {
+    // columns are hashed a row at a time, to read the frame in order
+    for (int x = 0; x < width; x++)
+      hashes[x] = HASH_START;
+    for (int y = 0; y < height; y++) {
+      const uint16_t *row = (const uint16_t *)&pixels[(size_t)y * stride];
+      for (int x = 0; x < width; x++)
+        hashes[x] = (hashes[x] ^ row[x]) * HASH_PRIME;
+    }
+    return;
+  }
+  for (int y = 0; y < height; y++) {
+    const uint16_t *row = (const uint16_t *)&pixels[(size_t)y * stride];
+    uint64_t hash = HASH_START;
+    for (int x = 0; x < width; x++)
+      hash = (hash ^ row[x]) * HASH_PRIME;
+    hashes[y] = hash;
+  }
+}
+
+int scroll_detect(const uint64_t *previous, const uint64_t *current, int length,
+                  int step, int min_saving) {
+  if (length > SCROLL_MAX_LINES
+      || memcmp(previous, current, length * sizeof(uint64_t)) == 0)
+    return 0;
+  // only the first of a run of the same line counts, so blank space
+  // lining up with blank space doesn't pass for a scroll
+  int unmoved = 0;
+  for (int i = 0; i < length; i++)
+    unmoved += current[i] == previous[i] && (i == 0 || current[i] != current[i - 1]);
+  int best = 0;
+  int best_matches = unmoved + min_saving - 1;
+  // no shift can line up more lines than were in the previous frame at
+  // all, ie when the picture moved across the scroll axis rather than
+  // along it, so the search is skipped unless enough of them were
+  uint64_t sorted[SCROLL_MAX_LINES];
+  memcpy(sorted, previous, length * sizeof(uint64_t));
+  qsort(sorted, length, sizeof(uint64_t), compare_hashes);
+  int found = 0;
+  for (int i = 0; i < length; i++)
+    found += (i == 0 || current[i] != current[i - 1])
+      && bsearch(&current[i], sorted, length, sizeof(uint64_t), compare_hashes) != NULL;
+  if (found <= best_matches)
+    return 0;
+  for (int lines = step; lines < length; lines += step) {
+    int matches = 0;
+    for (int i = 0; i < length; i++) {
+      int from = i + lines < length ? i + lines : i + lines - length;
+      matches += current[i] == previous[from] && (i == 0 || current[i] != current[i - 1]);
+    }
+    // moving further than half way is the same as moving back the other way
+    if (matches > best_matches) {
+      best = lines > length / 2 ? lines - length : lines;
+      best_matches = matches;
+    }
+  }
+  return best;
+}
+
+
+/// ---- Helper Definitions ----
+
+
+static int compare_hashes(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
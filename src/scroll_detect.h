@@ -0,0 +1,28 @@
+#ifndef DISPLAY_SCROLL_DETECT_H
+#define DISPLAY_SCROLL_DETECT_H
+
+#include <stdint.h>
+
+/// Finds when a frame is the previous one scrolled, so the display can be
+/// scrolled to match instead of resending everything that moved.
+/// Frames are reduced to a hash per line across the scroll axis (a column
+/// when scrolling along x, a row along y) and the shift that lines the
+/// most hashes up is chosen.
+
+// longest scroll axis scroll_detect takes
+#define SCROLL_MAX_LINES 1024
+
+// hash each line of a frame of 16 bit pixels, rows stride bytes apart.
+// hashes holds width entries when along_x, height otherwise
+void scroll_hash_lines(uint64_t *hashes, const uint8_t *pixels, int stride,
+                       int width, int height, int along_x);
+
+// how many lines the picture moved towards 0, wrapping round, between the
+// previous and current line hashes. Only multiples of step are tried, and
+// the shift must leave at least min_saving more lines matching than not
+// scrolling would. 0 when there is no such shift, or length is over
+// SCROLL_MAX_LINES
+int scroll_detect(const uint64_t *previous, const uint64_t *current, int length,
+                  int step, int min_saving);
+
+#endif
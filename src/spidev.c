@@ -0,0 +1,126 @@
+#include "spidev.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#define BUFSIZ_PARAMETER "/sys/module/spidev/parameters/bufsiz"
+// the kernel rounds each transfer up to ARCH_DMA_MINALIGN before checking
+// the total against bufsiz. 128 is the largest on Pi kernels (arm64),
+// so the total stays under bufsiz wherever it is smaller
+#define TRANSFER_ALIGNMENT 128
+
+static unsigned int read_bufsiz();
+static unsigned int aligned(unsigned int size);
+
+
+/// ---- Api Implementation ----
+
+
+int spidev_open(spidev_t *spi, int channel, int chip_enable,
+                uint32_t speed, uint8_t mode) {
+  char path[32];
+  snprintf(path, sizeof(path), "/dev/spidev%d.%d", channel, chip_enable);
+  spi->fd = open(path, O_RDWR);
+  if (spi->fd < 0) {
+    fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  uint8_t bits = 8;
+  if (ioctl(spi->fd, SPI_IOC_WR_MODE, &mode) == -1
+      || ioctl(spi->fd, SPI_IOC_WR_BITS_PER_WORD, &bits) == -1
+      || ioctl(spi->fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) == -1) {
+    fprintf(stderr, "Failed to configure %s: %s\n", path, strerror(errno));
+    close(spi->fd);
+    spi->fd = -1;
+    return -1;
+  }
+  spi->speed = speed;
+  spi->bufsiz = read_bufsiz();
+  spi->transfer_count = 0;
+  spi->queued_bytes = 0;
+  spi->staged_bytes = 0;
+  return 0;
+}
+
+void spidev_close(spidev_t *spi) {
+  if (spi->fd < 0)
+    return;
+  spidev_flush(spi);
+  close(spi->fd);
+  spi->fd = -1;
+}
+
+void spidev_queue(spidev_t *spi, const uint8_t *buff, unsigned int size) {
+  if (size <= SPIDEV_SMALL_SEND && size > SPIDEV_STAGING_SIZE - spi->staged_bytes)
+    spidev_flush(spi);
+  while (size > 0) {
+    unsigned int space = (spi->bufsiz - spi->queued_bytes)
+      / TRANSFER_ALIGNMENT * TRANSFER_ALIGNMENT;
+    if (spi->transfer_count == SPIDEV_MAX_TRANSFERS || space == 0) {
+      spidev_flush(spi);
+      continue;
+    }
+    unsigned int chunk = size < space ? size : space;
+
+    const uint8_t *data = buff;
+    if (chunk <= SPIDEV_STAGING_SIZE - spi->staged_bytes) {
+      data = &spi->staging[spi->staged_bytes];
+      memcpy(&spi->staging[spi->staged_bytes], buff, chunk);
+      spi->staged_bytes += chunk;
+    }
+
+    // extend the last transfer when this carries straight on from it
+    struct spi_ioc_transfer *last = NULL;
+    if (spi->transfer_count > 0)
+      last = &spi->transfers[spi->transfer_count - 1];
+    if (last != NULL && last->tx_buf + last->len == (unsigned long)data) {
+      last->len += chunk;
+    } else {
+      struct spi_ioc_transfer *t = &spi->transfers[spi->transfer_count++];
+      memset(t, 0, sizeof(*t));
+      t->tx_buf = (unsigned long)data;
+      t->len = chunk;
+      t->speed_hz = spi->speed;
+      t->bits_per_word = 8;
+    }
+    spi->queued_bytes += aligned(chunk);
+    buff += chunk;
+    size -= chunk;
+  }
+}
+
+int spidev_flush(spidev_t *spi) {
+  int result = 0;
+  if (spi->transfer_count > 0
+      && ioctl(spi->fd, SPI_IOC_MESSAGE(spi->transfer_count), spi->transfers) < 0) {
+    fprintf(stderr, "Failed to send data over spi: %s\n", strerror(errno));
+    result = -1;
+  }
+  spi->transfer_count = 0;
+  spi->queued_bytes = 0;
+  spi->staged_bytes = 0;
+  return result;
+}
+
+
+/// ---- Helper Definitions ----
+
+
+static unsigned int read_bufsiz() {
+  unsigned int bufsiz = SPIDEV_DEFAULT_BUFSIZ;
+  FILE *f = fopen(BUFSIZ_PARAMETER, "r");
+  if (f == NULL)
+    return bufsiz;
+  if (fscanf(f, "%u", &bufsiz) != 1 || bufsiz < TRANSFER_ALIGNMENT)
+    bufsiz = SPIDEV_DEFAULT_BUFSIZ;
+  fclose(f);
+  return bufsiz;
+}
+
+static unsigned int aligned(unsigned int size) {
+  return (size + TRANSFER_ALIGNMENT - 1) / TRANSFER_ALIGNMENT * TRANSFER_ALIGNMENT;
+}
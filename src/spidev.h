@@ -0,0 +1,47 @@
+#ifndef DISPLAY_SPIDEV_H
+#define DISPLAY_SPIDEV_H
+
+#include <stdint.h>
+#include <linux/spi/spidev.h>
+
+/// Talks to the display through /dev/spidevX.Y directly.
+/// Sends are queued and go out together as an array of transfers in one
+/// SPI_IOC_MESSAGE ioctl, so the queue only needs flushing when the
+/// data/command pin changes or before the caller's buffers go away.
+/// Transfers are transmit only, nothing is read back into the buffers.
+
+// most transfers sent in one ioctl
+#define SPIDEV_MAX_TRANSFERS 32
+// small sends are copied here so the caller's buffer can be reused
+#define SPIDEV_STAGING_SIZE 256
+// sends this size or smaller are always copied
+#define SPIDEV_SMALL_SEND 16
+// used when the kernel's spidev buffer size can't be read
+#define SPIDEV_DEFAULT_BUFSIZ 4096
+
+typedef struct spidev_t {
+  int fd;
+  uint32_t speed;
+  // bytes the kernel accepts in one ioctl, shared between all its transfers
+  unsigned int bufsiz;
+  struct spi_ioc_transfer transfers[SPIDEV_MAX_TRANSFERS];
+  int transfer_count;
+  unsigned int queued_bytes;
+  uint8_t staging[SPIDEV_STAGING_SIZE];
+  unsigned int staged_bytes;
+} spidev_t;
+
+// returns -1 on error
+int spidev_open(spidev_t *spi, int channel, int chip_enable,
+                uint32_t speed, uint8_t mode);
+
+void spidev_close(spidev_t *spi);
+
+// queue bytes to send, buff must stay valid until the next flush
+// unless size is at most SPIDEV_SMALL_SEND
+void spidev_queue(spidev_t *spi, const uint8_t *buff, unsigned int size);
+
+// send all queued transfers, returns -1 on error
+int spidev_flush(spidev_t *spi);
+
+#endif
@@ -0,0 +1,257 @@
+#include "stats.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "time.h"
+
+static latency_histogram stage_histograms[STATS_STAGE_COUNT];
+static _Atomic uint64_t counters[STATS_COUNTER_COUNT];
+
+static const char *stage_names[STATS_STAGE_COUNT] = {
+  "capture", "diff", "convert", "lock_wait", "spi", "frame_latency", "pacing_lateness",
+};
+
+// prometheus metric names, counters end in _total
+static const char *counter_names[STATS_COUNTER_COUNT] = {
+  "frames_captured_total", "frames_sent_total", "frames_dropped_total", "bytes_sent_total",
+};
+
+static _Atomic uint64_t gauges[STATS_GAUGE_COUNT];
+
+static const char *gauge_names[STATS_GAUGE_COUNT] = {
+  "capture_rate_fps", "capture_level",
+};
+
+static const char *gauge_help[STATS_GAUGE_COUNT] = {
+  "frames per second captures are paced at",
+  "capture pacing level in use, 0 is the fastest",
+};
+
+// set once before the threads start, read when writing the stats file
+static unsigned int policy_rates[STATS_MAX_POLICY_LEVELS];
+static unsigned int policy_idle_ms[STATS_MAX_POLICY_LEVELS];
+static int policy_levels;
+
+static int bucket_index(uint64_t ns);
+static uint64_t bucket_upper(int index);
+
+
+/// ---- Api Implementation ----
+
+
+void histogram_record(latency_histogram *histogram, uint64_t ns) {
+  atomic_fetch_add_explicit(&histogram->buckets[bucket_index(ns)], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->total_ns, ns, memory_order_relaxed);
+  uint64_t max = atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+  while (ns > max && !atomic_compare_exchange_weak_explicit(&histogram->max_ns, &max, ns,
+                                                            memory_order_relaxed,
+                                                            memory_order_relaxed))
+    ;
+}
+
+uint64_t histogram_quantile(latency_histogram *histogram, double quantile) {
+  uint64_t count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+  if (count == 0)
+    return 0;
+  // the rank of the sample wanted, 1 based
+  uint64_t rank = (uint64_t)(quantile * count + 0.5);
+  if (rank < 1)
+    rank = 1;
+  uint64_t max = atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+  uint64_t seen = 0;
+  for (int i = 0; i < STATS_BUCKETS; i++) {
+    seen += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+    if (seen >= rank) {
+      uint64_t upper = bucket_upper(i);
+      return upper < max ? upper : max;
+    }
+  }
+  // samples recorded while reading
+  return max;
+}
+
+stats_summary histogram_summary(latency_histogram *histogram) {
+  stats_summary summary;
+  summary.count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+  summary.total_ns = atomic_load_explicit(&histogram->total_ns, memory_order_relaxed);
+  summary.max_ns = atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+  summary.p50_ns = histogram_quantile(histogram, 0.5);
+  summary.p99_ns = histogram_quantile(histogram, 0.99);
+  return summary;
+}
+
+const char *stats_stage_name(enum stats_stage stage) {
+  return stage_names[stage];
+}
+
+const char *stats_counter_name(enum stats_counter counter) {
+  return counter_names[counter];
+}
+
+void stats_record(enum stats_stage stage, uint64_t ns) {
+  histogram_record(&stage_histograms[stage], ns);
+}
+
+void stats_record_since(enum stats_stage stage, uint64_t start_ns) {
+  histogram_record(&stage_histograms[stage], time_monotonic_ns() - start_ns);
+}
+
+void stats_count(enum stats_counter counter, uint64_t amount) {
+  atomic_fetch_add_explicit(&counters[counter], amount, memory_order_relaxed);
+}
+
+stats_summary stats_stage_summary(enum stats_stage stage) {
+  return histogram_summary(&stage_histograms[stage]);
+}
+
+void stats_print_distribution(enum stats_stage stage, FILE *f) {
+  latency_histogram *h = &stage_histograms[stage];
+  stats_summary s = histogram_summary(h);
+  fprintf(f, "%s: %llu samples, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+          stage_names[stage], (unsigned long long)s.count, s.p50_ns * 1e-6,
+          s.p99_ns * 1e-6, s.max_ns * 1e-6);
+  if (s.count == 0)
+    return;
+  uint64_t lower = 0;
+  for (int i = 0; i < STATS_BUCKETS; i++) {
+    uint64_t count = atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+    uint64_t upper = bucket_upper(i);
+    if (count > 0) {
+      int bar = (count * 50 + s.count - 1) / s.count;
+      fprintf(f, "  %9.3f - %9.3f ms %8llu %5.1f%% %.*s\n", lower * 1e-6,
+              (upper < s.max_ns ? upper : s.max_ns) * 1e-6, (unsigned long long)count,
+              count * 100.0 / s.count, bar,
+              "##################################################");
+    }
+    lower = upper + 1;
+  }
+}
+
+uint64_t stats_counter_value(enum stats_counter counter) {
+  return atomic_load_explicit(&counters[counter], memory_order_relaxed);
+}
+
+void stats_set(enum stats_gauge gauge, uint64_t value) {
+  atomic_store_explicit(&gauges[gauge], value, memory_order_relaxed);
+}
+
+uint64_t stats_gauge_value(enum stats_gauge gauge) {
+  return atomic_load_explicit(&gauges[gauge], memory_order_relaxed);
+}
+
+void stats_set_capture_policy(const unsigned int *rates, const unsigned int *idle_ms,
+                              int level_count) {
+  if (level_count > STATS_MAX_POLICY_LEVELS)
+    level_count = STATS_MAX_POLICY_LEVELS;
+  for (int i = 0; i < level_count; i++) {
+    policy_rates[i] = rates[i];
+    policy_idle_ms[i] = idle_ms[i];
+  }
+  policy_levels = level_count;
+}
+
+void stats_reset() {
+  for (int i = 0; i < STATS_STAGE_COUNT; i++) {
+    latency_histogram *h = &stage_histograms[i];
+    for (int b = 0; b < STATS_BUCKETS; b++)
+      atomic_store_explicit(&h->buckets[b], 0, memory_order_relaxed);
+    atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->total_ns, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->max_ns, 0, memory_order_relaxed);
+  }
+  for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+    atomic_store_explicit(&counters[i], 0, memory_order_relaxed);
+}
+
+int stats_write_file(const char *path) {
+  char temporary[PATH_MAX];
+  if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >= (int)sizeof(temporary)) {
+    fprintf(stderr, "stats file path %s is too long\n", path);
+    return -1;
+  }
+  FILE *f = fopen(temporary, "w");
+  if (f == NULL) {
+    fprintf(stderr, "failed to open stats file %s: %s\n", temporary, strerror(errno));
+    return -1;
+  }
+  fprintf(f, "# HELP display_stage_latency_seconds time spent in each stage of a frame\n"
+          "# TYPE display_stage_latency_seconds summary\n");
+  for (int i = 0; i < STATS_STAGE_COUNT; i++) {
+    stats_summary s = stats_stage_summary(i);
+    const char *name = stage_names[i];
+    fprintf(f, "display_stage_latency_seconds{stage=\"%s\",quantile=\"0.5\"} %.9f\n",
+            name, s.p50_ns * 1e-9);
+    fprintf(f, "display_stage_latency_seconds{stage=\"%s\",quantile=\"0.99\"} %.9f\n",
+            name, s.p99_ns * 1e-9);
+    fprintf(f, "display_stage_latency_seconds_sum{stage=\"%s\"} %.9f\n",
+            name, s.total_ns * 1e-9);
+    fprintf(f, "display_stage_latency_seconds_count{stage=\"%s\"} %llu\n",
+            name, (unsigned long long)s.count);
+  }
+  fprintf(f, "# HELP display_stage_latency_max_seconds slowest time seen in each stage\n"
+          "# TYPE display_stage_latency_max_seconds gauge\n");
+  for (int i = 0; i < STATS_STAGE_COUNT; i++)
+    fprintf(f, "display_stage_latency_max_seconds{stage=\"%s\"} %.9f\n",
+            stage_names[i], stats_stage_summary(i).max_ns * 1e-9);
+  for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+    fprintf(f, "# TYPE display_%s counter\ndisplay_%s %llu\n", counter_names[i],
+            counter_names[i], (unsigned long long)stats_counter_value(i));
+  for (int i = 0; i < STATS_GAUGE_COUNT; i++)
+    fprintf(f, "# HELP display_%s %s\n# TYPE display_%s gauge\ndisplay_%s %llu\n",
+            gauge_names[i], gauge_help[i], gauge_names[i], gauge_names[i],
+            (unsigned long long)stats_gauge_value(i));
+  fprintf(f, "# HELP display_capture_policy_fps capture rate of each pacing level\n"
+          "# TYPE display_capture_policy_fps gauge\n");
+  for (int i = 0; i < policy_levels; i++)
+    fprintf(f, "display_capture_policy_fps{level=\"%d\"} %u\n", i, policy_rates[i]);
+  fprintf(f, "# HELP display_capture_policy_idle_seconds time without changes before "
+          "stepping down from each level\n"
+          "# TYPE display_capture_policy_idle_seconds gauge\n");
+  // the slowest level never steps down
+  for (int i = 0; i + 1 < policy_levels; i++)
+    fprintf(f, "display_capture_policy_idle_seconds{level=\"%d\"} %.3f\n", i,
+            policy_idle_ms[i] * 1e-3);
+  if (fclose(f) != 0) {
+    fprintf(stderr, "failed to write stats file %s: %s\n", temporary, strerror(errno));
+    remove(temporary);
+    return -1;
+  }
+  if (rename(temporary, path) == -1) {
+    fprintf(stderr, "failed to replace stats file %s: %s\n", path, strerror(errno));
+    remove(temporary);
+    return -1;
+  }
+  return 0;
+}
+
+
+/// ---- Helper Definitions ----
+
+
+// values below STATS_SUB_BUCKETS get a bucket each, above that each power
+// of two is split into STATS_SUB_BUCKETS by the bits after the top one
+static int bucket_index(uint64_t ns) {
+  if (ns < STATS_SUB_BUCKETS)
+    return ns;
+  int exponent = 63 - __builtin_clzll(ns);
+  if (exponent >= STATS_MAX_EXPONENT)
+    return STATS_BUCKETS - 1;
+  int shift = exponent - STATS_SUB_BUCKET_BITS;
+  int sub = (ns >> shift) - STATS_SUB_BUCKETS;
+  return (shift + 1) * STATS_SUB_BUCKETS + sub;
+}
+
+// largest value that lands in a bucket
+static uint64_t bucket_upper(int index) {
+  if (index < STATS_SUB_BUCKETS)
+    return index;
+  int shift = index / STATS_SUB_BUCKETS - 1;
+  uint64_t sub = index % STATS_SUB_BUCKETS;
+  if (index == STATS_BUCKETS - 1)
+    return UINT64_MAX;
+  return ((STATS_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
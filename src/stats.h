@@ -0,0 +1,123 @@
+#ifndef DISPLAY_STATS_H
+#define DISPLAY_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+
+/// Process wide latency histograms and counters, cheap enough to record
+/// from the hot paths of any thread.
+/// Histograms are log-linear: every power of two of nanoseconds is split
+/// into STATS_SUB_BUCKETS linear buckets, so quantiles are within 1/8 of
+/// the real value in a fixed few kilobytes.
+/// stats_write_file writes them in the prometheus text format, ie for
+/// node_exporter's textfile collector.
+
+// linear buckets per power of two, must be a power of two
+#define STATS_SUB_BUCKET_BITS 3
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BUCKET_BITS)
+// values at or above 2^STATS_MAX_EXPONENT ns (~18 minutes) go in the last bucket
+#define STATS_MAX_EXPONENT 40
+#define STATS_BUCKETS ((STATS_MAX_EXPONENT - STATS_SUB_BUCKET_BITS + 1) * STATS_SUB_BUCKETS)
+
+enum stats_stage {
+  // reading a frame out of X or the framebuffer
+  STATS_CAPTURE,
+  // finding what changed since the last frame
+  STATS_DIFF,
+  // converting captured pixels to the panel's format
+  STATS_CONVERT,
+  // waiting in display_lock
+  STATS_LOCK_WAIT,
+  // sending a display_draw over the transport
+  STATS_SPI,
+  // from a frame being read to its changes being sent
+  STATS_FRAME_LATENCY,
+  // how late the capture pacing woke for a frame it slept until, the jitter
+  STATS_PACING_LATENESS,
+  STATS_STAGE_COUNT,
+};
+
+enum stats_counter {
+  STATS_FRAMES_CAPTURED,
+  // frames that changed the display
+  STATS_FRAMES_SENT,
+  // captured frames replaced before the transmit thread took them
+  STATS_FRAMES_DROPPED,
+  // commands, parameters and pixels
+  STATS_BYTES_SENT,
+  STATS_COUNTER_COUNT,
+};
+
+enum stats_gauge {
+  // frames per second captures are currently paced at
+  STATS_CAPTURE_RATE,
+  // the pacing level in use, 0 is the fastest
+  STATS_CAPTURE_LEVEL,
+  STATS_GAUGE_COUNT,
+};
+
+// levels of capture pacing the stats file can describe
+#define STATS_MAX_POLICY_LEVELS 8
+
+typedef struct latency_histogram {
+  _Atomic uint64_t buckets[STATS_BUCKETS];
+  _Atomic uint64_t count;
+  _Atomic uint64_t total_ns;
+  _Atomic uint64_t max_ns;
+} latency_histogram;
+
+typedef struct stats_summary {
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t p50_ns;
+  uint64_t p99_ns;
+  uint64_t max_ns;
+} stats_summary;
+
+void histogram_record(latency_histogram *histogram, uint64_t ns);
+
+// quantile is 0 to 1, returns the upper edge of the bucket it falls in
+uint64_t histogram_quantile(latency_histogram *histogram, double quantile);
+
+stats_summary histogram_summary(latency_histogram *histogram);
+
+/// --- process wide stats ---
+
+const char *stats_stage_name(enum stats_stage stage);
+
+const char *stats_counter_name(enum stats_counter counter);
+
+void stats_record(enum stats_stage stage, uint64_t ns);
+
+// record the time from start_ns, from time_monotonic_ns, until now
+void stats_record_since(enum stats_stage stage, uint64_t start_ns);
+
+void stats_count(enum stats_counter counter, uint64_t amount);
+
+stats_summary stats_stage_summary(enum stats_stage stage);
+
+// print how a stage's times are spread, one line per non empty bucket
+void stats_print_distribution(enum stats_stage stage, FILE *f);
+
+uint64_t stats_counter_value(enum stats_counter counter);
+
+void stats_set(enum stats_gauge gauge, uint64_t value);
+
+uint64_t stats_gauge_value(enum stats_gauge gauge);
+
+// the rates captures step down through and how long each waits for a
+// change first, fastest first
+void stats_set_capture_policy(const unsigned int *rates, const unsigned int *idle_ms,
+                              int level_count);
+
+// zero every histogram and counter but not the gauges, samples recorded
+// at the same time from other threads may be half cleared
+void stats_reset();
+
+// replace the file at path with the current stats, written to a
+// temporary file first so readers never see it half written.
+// returns -1 on error
+int stats_write_file(const char *path);
+
+#endif
@@ -1,8 +1,9 @@
 #include "time.h"
 
-#include <time.h> // clock()
+#include <time.h> // clock(), clock_gettime()
 #include <sys/time.h> // gettimeofday()
 #include <stdio.h> // printf()
+#include <errno.h>
 
 time_point get_time() {
   time_point t;
@@ -28,7 +29,7 @@ double cpu_time_s(time_point t1, time_point t2) {
 
 double real_time_s(time_point t1, time_point t2) {
   double elapsed = (t2.real_s - t1.real_s);
-  elapsed += (t2.real_us - t1.real_us) * 1e-6;
+  elapsed += ((int)t2.real_us - (int)t1.real_us) * 1e-6;
   return elapsed;
 }
 
@@ -36,3 +37,17 @@ void print_elapsed(time_point t1) {
   time_point t2 = get_time();
   printf("cpu: %f real: %f\n", cpu_time_s(t1, t2), real_time_s(t1, t2));
 }
+
+uint64_t time_monotonic_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+void time_sleep_until_ns(uint64_t time_ns) {
+  struct timespec t;
+  t.tv_sec = time_ns / 1000000000;
+  t.tv_nsec = time_ns % 1000000000;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR)
+    ;
+}
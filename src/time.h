@@ -1,6 +1,8 @@
 #ifndef DISPLAY_TIME_H
 #define DISPLAY_TIME_H
 
+#include <stdint.h>
+
 typedef struct time_point {
   // unix time
   unsigned int real_s;
@@ -19,5 +21,11 @@ double real_time_s(time_point t1, time_point t2);
 
 void print_elapsed(time_point);
 
+// nanoseconds from the monotonic clock, for measuring intervals
+uint64_t time_monotonic_ns();
+
+// sleep until the monotonic clock reaches time_ns
+void time_sleep_until_ns(uint64_t time_ns);
+
 
 #endif
@@ -0,0 +1,13 @@
+#include "transport.h"
+
+#include <string.h>
+
+display_transport *transport_by_name(const char *name, int panel) {
+  if (strcmp(name, "wiringpi") == 0)
+    return transport_wiringpi_panel(panel);
+  if (strcmp(name, "spidev") == 0)
+    return transport_spidev_panel(panel);
+  if (strcmp(name, "memory") == 0)
+    return memory_transport_create(memory_transport_default_options());
+  return NULL;
+}
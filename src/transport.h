@@ -0,0 +1,122 @@
+#ifndef DISPLAY_TRANSPORT_H
+#define DISPLAY_TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/// How display.c reaches the hardware: spi bytes, the data/command pin,
+/// the reset pin and the backlight.
+/// Backends:
+///   wiringpi - gpio and spi through wiringPi
+///   spidev   - gpio through wiringPi, spi batched through /dev/spidevX.Y
+///   memory   - records everything sent, for profiling and testing off the pi
+/// The pi backends are only available when built with wiringPi.
+
+// sends this size or smaller are copied, so their buffers can be reused straight away
+#define TRANSPORT_SMALL_SEND 16
+
+enum transport_level {
+  TRANSPORT_COMMAND = 0,
+  TRANSPORT_DATA = 1,
+};
+
+typedef struct display_transport display_transport;
+
+struct display_transport {
+  const char *name;
+  // returns -1 on error
+  int (*open)(display_transport *t);
+  void (*close)(display_transport *t);
+  // queue bytes to send with the D/C pin at the given level, buff
+  // must stay valid until the next flush unless it is a small send
+  void (*send)(display_transport *t, const uint8_t *buff, unsigned int size,
+               enum transport_level level);
+  // send anything queued
+  void (*flush)(display_transport *t);
+  void (*reset_pin)(display_transport *t, int high);
+  // 0 to MAX_BRIGHTNESS
+  void (*backlight)(display_transport *t, unsigned int brightness);
+  // backend specific
+  void *state;
+};
+
+// NULL if not built with wiringPi
+display_transport *transport_wiringpi();
+
+// NULL if not built with wiringPi
+display_transport *transport_spidev();
+
+// the same for the panel wired as panel in 'pi_wiring_consts.h'
+display_transport *transport_wiringpi_panel(int panel);
+
+display_transport *transport_spidev_panel(int panel);
+
+// one of the backend names above for panel, memory uses the default options.
+// returns NULL if unknown or unavailable
+display_transport *transport_by_name(const char *name, int panel);
+
+
+/// --- Memory Backend ---
+
+// one run of bytes sent at the same D/C level
+typedef struct memory_event {
+  // when it was sent, from the monotonic clock
+  uint64_t time_ns;
+  // when the simulated bus would have finished sending it
+  uint64_t bus_done_ns;
+  // where the bytes start in the byte log
+  size_t offset;
+  unsigned int size;
+  enum transport_level level;
+} memory_event;
+
+typedef struct memory_transport_options {
+  // simulated spi clock
+  uint32_t line_rate_hz;
+  // fixed cost of each flush, ie one ioctl
+  uint32_t flush_overhead_ns;
+  // sleep so sends take as long as they would on the bus
+  int throttle;
+  // bytes and events to keep, once full only the counters are updated
+  size_t max_log_bytes;
+  size_t max_events;
+  // called with every send, ie to feed an emulator
+  void (*sink)(void *ctx, const uint8_t *buff, unsigned int size,
+               enum transport_level level);
+  void *sink_ctx;
+} memory_transport_options;
+
+typedef struct memory_transport_log {
+  uint8_t *bytes;
+  size_t byte_count;
+  memory_event *events;
+  size_t event_count;
+  // set when the log filled up and stopped recording
+  int truncated;
+
+  uint64_t command_bytes;
+  uint64_t data_bytes;
+  uint64_t dc_transitions;
+  uint64_t flushes;
+  uint64_t resets;
+  // time the simulated bus has spent sending
+  uint64_t bus_busy_ns;
+  unsigned int brightness;
+} memory_transport_log;
+
+memory_transport_options memory_transport_default_options();
+
+// returns NULL on error
+display_transport *memory_transport_create(memory_transport_options options);
+
+void memory_transport_destroy(display_transport *t);
+
+// NULL if t is not a memory transport
+memory_transport_log *memory_transport_get_log(display_transport *t);
+
+// forget everything recorded so far
+void memory_transport_clear(display_transport *t);
+
+void memory_transport_print_summary(display_transport *t);
+
+#endif
@@ -0,0 +1,211 @@
+#include "transport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "display.h"
+#include "display_consts.h"
+#include "time.h"
+
+typedef struct memory_state {
+  memory_transport_options options;
+  memory_transport_log log;
+  size_t byte_capacity;
+  size_t event_capacity;
+  // level of the last send, -1 before any
+  int level;
+  // when the simulated bus finishes everything sent so far
+  uint64_t bus_free_ns;
+} memory_state;
+
+static void record(memory_state *mem, const uint8_t *buff, unsigned int size,
+                   enum transport_level level, uint64_t now, uint64_t done);
+static int grow(void **array, size_t *capacity, size_t needed, size_t max,
+                size_t item_size);
+
+
+/// ---- Backend ----
+
+
+static int memory_open(display_transport *t) {
+  memory_transport_clear(t);
+  return 0;
+}
+
+static void memory_close(display_transport *t) {}
+
+static void memory_send(display_transport *t, const uint8_t *buff,
+                        unsigned int size, enum transport_level level) {
+  memory_state *mem = t->state;
+  if (mem->level != -1 && mem->level != (int)level)
+    mem->log.dc_transitions++;
+  mem->level = level;
+  if (level == TRANSPORT_DATA)
+    mem->log.data_bytes += size;
+  else
+    mem->log.command_bytes += size;
+
+  uint64_t now = time_monotonic_ns();
+  uint64_t start = now > mem->bus_free_ns ? now : mem->bus_free_ns;
+  uint64_t duration = (uint64_t)size * 8 * 1000000000 / mem->options.line_rate_hz;
+  mem->bus_free_ns = start + duration;
+  mem->log.bus_busy_ns += duration;
+  record(mem, buff, size, level, now, mem->bus_free_ns);
+
+  if (mem->options.sink != NULL)
+    mem->options.sink(mem->options.sink_ctx, buff, size, level);
+}
+
+static void memory_flush(display_transport *t) {
+  memory_state *mem = t->state;
+  mem->log.flushes++;
+  uint64_t now = time_monotonic_ns();
+  if (mem->bus_free_ns < now)
+    mem->bus_free_ns = now;
+  mem->bus_free_ns += mem->options.flush_overhead_ns;
+  mem->log.bus_busy_ns += mem->options.flush_overhead_ns;
+  if (mem->options.throttle)
+    time_sleep_until_ns(mem->bus_free_ns);
+}
+
+static void memory_reset_pin(display_transport *t, int high) {
+  memory_state *mem = t->state;
+  if (!high)
+    mem->log.resets++;
+}
+
+static void memory_backlight(display_transport *t, unsigned int brightness) {
+  memory_state *mem = t->state;
+  mem->log.brightness = brightness;
+}
+
+
+/// ---- Api Implementation ----
+
+
+memory_transport_options memory_transport_default_options() {
+  memory_transport_options options;
+  options.line_rate_hz = DISPLAY_SPI_FREQUENCY;
+  // roughly the cost of an ioctl on a pi zero 2 w
+  options.flush_overhead_ns = 20000;
+  options.throttle = 0;
+  options.max_log_bytes = 16 * 1024 * 1024;
+  options.max_events = 1024 * 1024;
+  options.sink = NULL;
+  options.sink_ctx = NULL;
+  return options;
+}
+
+display_transport *memory_transport_create(memory_transport_options options) {
+  display_transport *t = calloc(1, sizeof(display_transport));
+  memory_state *mem = calloc(1, sizeof(memory_state));
+  if (t == NULL || mem == NULL) {
+    fprintf(stderr, "Failed to allocate memory transport\n");
+    free(t);
+    free(mem);
+    return NULL;
+  }
+  if (options.line_rate_hz == 0)
+    options.line_rate_hz = DISPLAY_SPI_FREQUENCY;
+  mem->options = options;
+  mem->level = -1;
+  t->name = "memory";
+  t->open = memory_open;
+  t->close = memory_close;
+  t->send = memory_send;
+  t->flush = memory_flush;
+  t->reset_pin = memory_reset_pin;
+  t->backlight = memory_backlight;
+  t->state = mem;
+  return t;
+}
+
+void memory_transport_destroy(display_transport *t) {
+  if (t == NULL)
+    return;
+  memory_state *mem = t->state;
+  free(mem->log.bytes);
+  free(mem->log.events);
+  free(mem);
+  free(t);
+}
+
+memory_transport_log *memory_transport_get_log(display_transport *t) {
+  if (t == NULL || t->send != memory_send)
+    return NULL;
+  memory_state *mem = t->state;
+  return &mem->log;
+}
+
+void memory_transport_clear(display_transport *t) {
+  memory_state *mem = t->state;
+  uint8_t *bytes = mem->log.bytes;
+  memory_event *events = mem->log.events;
+  memset(&mem->log, 0, sizeof(mem->log));
+  mem->log.bytes = bytes;
+  mem->log.events = events;
+  mem->level = -1;
+  mem->bus_free_ns = 0;
+}
+
+void memory_transport_print_summary(display_transport *t) {
+  memory_transport_log *log = memory_transport_get_log(t);
+  if (log == NULL)
+    return;
+  printf("memory transport: %llu command bytes, %llu data bytes, "
+         "%llu D/C transitions, %llu flushes, %llu resets\n",
+         (unsigned long long)log->command_bytes,
+         (unsigned long long)log->data_bytes,
+         (unsigned long long)log->dc_transitions,
+         (unsigned long long)log->flushes,
+         (unsigned long long)log->resets);
+  printf("simulated bus busy for %.3fs%s\n", log->bus_busy_ns * 1e-9,
+         log->truncated ? ", log truncated" : "");
+}
+
+
+/// ---- Helper Definitions ----
+
+
+static void record(memory_state *mem, const uint8_t *buff, unsigned int size,
+                   enum transport_level level, uint64_t now, uint64_t done) {
+  memory_transport_log *log = &mem->log;
+  if (log->truncated)
+    return;
+  if (grow((void **)&log->bytes, &mem->byte_capacity, log->byte_count + size,
+           mem->options.max_log_bytes, 1) == -1
+      || grow((void **)&log->events, &mem->event_capacity, log->event_count + 1,
+              mem->options.max_events, sizeof(memory_event)) == -1) {
+    log->truncated = 1;
+    return;
+  }
+  memory_event *e = &log->events[log->event_count++];
+  e->time_ns = now;
+  e->bus_done_ns = done;
+  e->offset = log->byte_count;
+  e->size = size;
+  e->level = level;
+  memcpy(&log->bytes[log->byte_count], buff, size);
+  log->byte_count += size;
+}
+
+// double capacity until needed items fit, returns -1 past max or on failure
+static int grow(void **array, size_t *capacity, size_t needed, size_t max,
+                size_t item_size) {
+  if (needed <= *capacity)
+    return 0;
+  if (needed > max)
+    return -1;
+  size_t size = *capacity == 0 ? 4096 : *capacity;
+  while (size < needed)
+    size *= 2;
+  if (size > max)
+    size = max;
+  void *grown = realloc(*array, size * item_size);
+  if (grown == NULL)
+    return -1;
+  *array = grown;
+  *capacity = size;
+  return 0;
+}
@@ -0,0 +1,207 @@
+#include "transport.h"
+
+#ifndef DISPLAY_NO_WIRINGPI
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+
+#include "display.h"
+#include "display_consts.h"
+#include "pi_wiring_consts.h"
+#include "spidev.h"
+
+#define BRIGHTNESS_CLOCK_DIVISOR 100
+
+typedef struct pi_state {
+  const panel_wiring *wiring;
+  spidev_t spidev;
+  // current level of the D/C pin, -1 when unknown
+  int data_command_level;
+  // wiringPi writes what it reads back over the buffer, so sends go
+  // through a copy to leave the caller's data intact
+  uint8_t bounce[SPI_BUFFER_SIZE];
+} pi_state;
+
+#define PANELS_WIRED (int)(sizeof(PANEL_WIRING) / sizeof(PANEL_WIRING[0]))
+
+static pi_state wiringpi_states[PANELS_WIRED];
+static pi_state spidev_states[PANELS_WIRED];
+static display_transport wiringpi_transports[PANELS_WIRED];
+static display_transport spidev_transports[PANELS_WIRED];
+
+static int open_gpio(pi_state *pi);
+static void pi_reset_pin(display_transport *t, int high);
+static void pi_backlight(display_transport *t, unsigned int brightness);
+
+
+/// ---- wiringPi spi ----
+
+
+static int wiringpi_open(display_transport *t) {
+  pi_state *pi = t->state;
+  if (open_gpio(pi) == -1)
+    return -1;
+  int spi_handle = wiringPiSPIxSetupMode(pi->wiring->spi_channel, pi->wiring->spi_chip_enable,
+                                         DISPLAY_SPI_FREQUENCY, DISPLAY_SPI_MODE);
+  if (spi_handle < 0) {
+    fprintf(stderr, "Failed to init spi: %s\n", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+static void wiringpi_close(display_transport *t) {
+  pi_state *pi = t->state;
+  wiringPiSPIxClose(pi->wiring->spi_channel, pi->wiring->spi_chip_enable);
+}
+
+static void wiringpi_send(display_transport *t, const uint8_t *buff,
+                          unsigned int size, enum transport_level level) {
+  pi_state *pi = t->state;
+  if (pi->data_command_level != (int)level) {
+    digitalWrite(pi->wiring->data_command_pin, level == TRANSPORT_DATA ? HIGH : LOW);
+    pi->data_command_level = level;
+  }
+  while (size > 0) {
+    unsigned int chunk = size < SPI_BUFFER_SIZE ? size : SPI_BUFFER_SIZE;
+    memcpy(pi->bounce, buff, chunk);
+    if (wiringPiSPIxDataRW(pi->wiring->spi_channel, pi->wiring->spi_chip_enable,
+                           pi->bounce, chunk) == -1)
+      fprintf(stderr, "Failed to send data over spi: %s\n", strerror(errno));
+    buff += chunk;
+    size -= chunk;
+  }
+}
+
+// every send goes out immediately
+static void wiringpi_flush(display_transport *t) {}
+
+display_transport *transport_wiringpi() {
+  return transport_wiringpi_panel(0);
+}
+
+display_transport *transport_wiringpi_panel(int panel) {
+  if (panel < 0 || panel >= PANELS_WIRED)
+    return NULL;
+  wiringpi_states[panel].wiring = &PANEL_WIRING[panel];
+  wiringpi_transports[panel] = (display_transport){
+    .name = "wiringpi",
+    .open = wiringpi_open,
+    .close = wiringpi_close,
+    .send = wiringpi_send,
+    .flush = wiringpi_flush,
+    .reset_pin = pi_reset_pin,
+    .backlight = pi_backlight,
+    .state = &wiringpi_states[panel],
+  };
+  return &wiringpi_transports[panel];
+}
+
+
+/// ---- spidev spi ----
+
+
+static int spidev_transport_open(display_transport *t) {
+  pi_state *pi = t->state;
+  if (open_gpio(pi) == -1)
+    return -1;
+  return spidev_open(&pi->spidev, pi->wiring->spi_channel, pi->wiring->spi_chip_enable,
+                     DISPLAY_SPI_FREQUENCY, DISPLAY_SPI_MODE);
+}
+
+static void spidev_transport_close(display_transport *t) {
+  pi_state *pi = t->state;
+  spidev_close(&pi->spidev);
+}
+
+static void spidev_transport_send(display_transport *t, const uint8_t *buff,
+                                  unsigned int size, enum transport_level level) {
+  pi_state *pi = t->state;
+  // queued data has to go out before the pin changes
+  if (pi->data_command_level != (int)level) {
+    spidev_flush(&pi->spidev);
+    digitalWrite(pi->wiring->data_command_pin, level == TRANSPORT_DATA ? HIGH : LOW);
+    pi->data_command_level = level;
+  }
+  spidev_queue(&pi->spidev, buff, size);
+}
+
+static void spidev_transport_flush(display_transport *t) {
+  pi_state *pi = t->state;
+  spidev_flush(&pi->spidev);
+}
+
+display_transport *transport_spidev() {
+  return transport_spidev_panel(0);
+}
+
+display_transport *transport_spidev_panel(int panel) {
+  if (panel < 0 || panel >= PANELS_WIRED)
+    return NULL;
+  spidev_states[panel].wiring = &PANEL_WIRING[panel];
+  spidev_transports[panel] = (display_transport){
+    .name = "spidev",
+    .open = spidev_transport_open,
+    .close = spidev_transport_close,
+    .send = spidev_transport_send,
+    .flush = spidev_transport_flush,
+    .reset_pin = pi_reset_pin,
+    .backlight = pi_backlight,
+    .state = &spidev_states[panel],
+  };
+  return &spidev_transports[panel];
+}
+
+
+/// ---- Helper Definitions ----
+
+
+static int open_gpio(pi_state *pi) {
+  int result = wiringPiSetupGpio();
+  if (result) {
+    fprintf(stderr, "Failed to init pi gpio pins: %s\n", strerror(errno));
+    return -1;
+  }
+  pinMode(pi->wiring->data_command_pin, OUTPUT);
+  pinMode(pi->wiring->reset_pin, OUTPUT);
+  pi->data_command_level = -1;
+  pi->spidev.fd = -1;
+  return 0;
+}
+
+static void pi_reset_pin(display_transport *t, int high) {
+  pi_state *pi = t->state;
+  digitalWrite(pi->wiring->reset_pin, high ? HIGH : LOW);
+}
+
+static void pi_backlight(display_transport *t, unsigned int brightness) {
+  if(brightness == 0) {
+    pinMode(BACKLIGHT_PIN, OUTPUT);
+    digitalWrite(BACKLIGHT_PIN, 0);
+  } else if(brightness == MAX_BRIGHTNESS) {
+    pinMode(BACKLIGHT_PIN, OUTPUT);
+    digitalWrite(BACKLIGHT_PIN, 1);
+  } else {
+      pinMode(BACKLIGHT_PIN, PWM_OUTPUT);
+      pwmSetMode(PWM_MODE_MS);
+      pwmSetClock(BRIGHTNESS_CLOCK_DIVISOR);
+      pwmSetRange(MAX_BRIGHTNESS);
+      pwmWrite(BACKLIGHT_PIN, brightness);
+  }
+}
+
+#else
+
+display_transport *transport_wiringpi() { return NULL; }
+
+display_transport *transport_spidev() { return NULL; }
+
+display_transport *transport_wiringpi_panel(int panel) { return NULL; }
+
+display_transport *transport_spidev_panel(int panel) { return NULL; }
+
+#endif
@@ -0,0 +1,169 @@
+#include "work_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// bands per thread, so threads that finish early have some to take
+#define BANDS_PER_THREAD 4
+
+static void *worker_main(void *pool_ptr);
+static void run_bands(work_pool *pool, int worker);
+static int take_own(work_queue *queue, int *band);
+static int take_other(work_queue *queue, int *band);
+static uint64_t pack(uint32_t low, uint32_t high);
+
+
+/// ---- Api Implementation ----
+
+
+int work_pool_init(work_pool *pool, int threads) {
+  memset(pool, 0, sizeof(*pool));
+  if (threads < 1)
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads < 1)
+    threads = 1;
+  if (threads > WORK_POOL_MAX_THREADS)
+    threads = WORK_POOL_MAX_THREADS;
+  for (int i = 0; i < WORK_POOL_MAX_THREADS; i++)
+    atomic_init(&pool->queues[i].range, 0);
+  atomic_init(&pool->remaining, 0);
+  atomic_init(&pool->busy, 0);
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  // the caller is worker 0, the rest get threads
+  pool->thread_count = 1;
+  for (int i = 1; i < threads; i++) {
+    int failed = pthread_create(&pool->threads[i], NULL, worker_main, pool);
+    if (failed) {
+      fprintf(stderr, "failed to start worker thread, %s\n", strerror(failed));
+      work_pool_free(pool);
+      return -1;
+    }
+    pool->thread_count = i + 1;
+  }
+  return 0;
+}
+
+void work_pool_free(work_pool *pool) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->mutex);
+  for (int i = 1; i < pool->thread_count; i++)
+    pthread_join(pool->threads[i], NULL);
+  pool->thread_count = 0;
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+  pthread_mutex_destroy(&pool->mutex);
+}
+
+int work_pool_bands(const work_pool *pool, int items, int min_items) {
+  if (pool == NULL || pool->thread_count == 1 || min_items < 1)
+    return 1;
+  int bands = items / min_items;
+  if (bands > pool->thread_count * BANDS_PER_THREAD)
+    bands = pool->thread_count * BANDS_PER_THREAD;
+  return bands < 1 ? 1 : bands;
+}
+
+void work_pool_run(work_pool *pool, work_fn fn, void *ctx, int bands) {
+  int expected = 0;
+  if (pool == NULL || pool->thread_count == 1 || bands <= 1
+      || !atomic_compare_exchange_strong(&pool->busy, &expected, 1)) {
+    for (int i = 0; i < bands; i++)
+      fn(ctx, i, 0);
+    return;
+  }
+  pool->fn = fn;
+  pool->ctx = ctx;
+  atomic_store(&pool->remaining, bands);
+  // deal the bands out in runs, set last so a thread still looking at
+  // the previous job's queues sees the new job whole if it takes a band
+  for (int i = 0; i < pool->thread_count; i++)
+    atomic_store(&pool->queues[i].range,
+                 pack((long)bands * i / pool->thread_count,
+                      (long)bands * (i + 1) / pool->thread_count));
+  pthread_mutex_lock(&pool->mutex);
+  pool->job++;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->mutex);
+  run_bands(pool, 0);
+  pthread_mutex_lock(&pool->mutex);
+  while (atomic_load(&pool->remaining) > 0)
+    pthread_cond_wait(&pool->done, &pool->mutex);
+  pthread_mutex_unlock(&pool->mutex);
+  atomic_store(&pool->busy, 0);
+}
+
+
+/// ---- Helper Definitions ----
+
+
+static void *worker_main(void *pool_ptr) {
+  work_pool *pool = pool_ptr;
+  pthread_mutex_lock(&pool->mutex);
+  int worker = ++pool->started;
+  unsigned int seen = pool->job;
+  while (1) {
+    while (!pool->stop && pool->job == seen)
+      pthread_cond_wait(&pool->start, &pool->mutex);
+    if (pool->stop)
+      break;
+    seen = pool->job;
+    pthread_mutex_unlock(&pool->mutex);
+    run_bands(pool, worker);
+    pthread_mutex_lock(&pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+// run this worker's bands, then any left on the others
+static void run_bands(work_pool *pool, int worker) {
+  int band;
+  for (int i = 0; i < pool->thread_count; i++) {
+    int victim = (worker + i) % pool->thread_count;
+    work_queue *queue = &pool->queues[victim];
+    while (i == 0 ? take_own(queue, &band) : take_other(queue, &band)) {
+      pool->fn(pool->ctx, band, worker);
+      if (atomic_fetch_sub(&pool->remaining, 1) == 1) {
+        pthread_mutex_lock(&pool->mutex);
+        pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->mutex);
+      }
+    }
+  }
+}
+
+// returns 0 when none are left
+static int take_own(work_queue *queue, int *band) {
+  uint64_t range = atomic_load(&queue->range);
+  while (1) {
+    uint32_t low = range, high = range >> 32;
+    if (low >= high)
+      return 0;
+    if (atomic_compare_exchange_weak(&queue->range, &range, pack(low + 1, high))) {
+      *band = low;
+      return 1;
+    }
+  }
+}
+
+static int take_other(work_queue *queue, int *band) {
+  uint64_t range = atomic_load(&queue->range);
+  while (1) {
+    uint32_t low = range, high = range >> 32;
+    if (low >= high)
+      return 0;
+    if (atomic_compare_exchange_weak(&queue->range, &range, pack(low, high - 1))) {
+      *band = high - 1;
+      return 1;
+    }
+  }
+}
+
+static uint64_t pack(uint32_t low, uint32_t high) {
+  return (uint64_t)high << 32 | low;
+}
@@ -0,0 +1,64 @@
+#ifndef DISPLAY_WORK_POOL_H
+#define DISPLAY_WORK_POOL_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/// Threads that share out a frame's pixel work, started once and reused
+/// for every job. A job is split into bands (ie runs of rows), dealt out
+/// evenly, and a thread that runs out of its own bands takes the last of
+/// another's, so a few slow bands don't hold up the frame.
+/// The caller works too, as worker 0. With one thread, or while another
+/// caller's job is running, jobs run on the caller alone.
+/// Nothing is allocated per job.
+
+// most threads, including the caller
+#define WORK_POOL_MAX_THREADS 8
+
+// run band of a job on worker, 0 to the pool's thread count - 1, which is
+// only running one band at a time so can index per thread scratch space
+typedef void (*work_fn)(void *ctx, int band, int worker);
+
+typedef struct work_queue {
+  // bands [low 32 bits, high 32 bits) left. the owner takes from the
+  // front, others from the back
+  _Alignas(64) _Atomic uint64_t range;
+} work_queue;
+
+typedef struct work_pool {
+  int thread_count;
+  pthread_t threads[WORK_POOL_MAX_THREADS];
+  work_queue queues[WORK_POOL_MAX_THREADS];
+  // the current job
+  work_fn fn;
+  void *ctx;
+  // bands not yet finished
+  atomic_int remaining;
+  // set while a caller's job runs
+  atomic_int busy;
+  // bumped for each job, threads run when it changes
+  unsigned int job;
+  // threads that have picked their worker number
+  int started;
+  int stop;
+  pthread_mutex_t mutex;
+  pthread_cond_t start;
+  pthread_cond_t done;
+} work_pool;
+
+// start threads - 1 threads, or one per core online when threads is 0.
+// returns -1 on error
+int work_pool_init(work_pool *pool, int threads);
+
+void work_pool_free(work_pool *pool);
+
+// how many bands to split items into, so each gets at least min_items and
+// there are a few per thread to even out. 1 when it isn't worth splitting
+int work_pool_bands(const work_pool *pool, int items, int min_items);
+
+// run fn on bands 0 to bands - 1, returning once every one has finished.
+// pool can be NULL to run them on the caller
+void work_pool_run(work_pool *pool, work_fn fn, void *ctx, int bands);
+
+#endif
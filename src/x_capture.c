@@ -0,0 +1,303 @@
+#include "x_capture.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "stats.h"
+#include "time.h"
+
+// damage covering this fraction of the window or more is fetched whole
+// through shm, smaller areas are cheaper to read over the socket
+#define SHM_FETCH_FRACTION 8
+
+static int create_shm_image(x_capture *capture);
+static void destroy_shm_image(x_capture *capture, int detach);
+static int shm_error_handler(Display *display, XErrorEvent *error);
+static int fetch_window(x_capture *capture, damage_rect *rects);
+static int image_format(XImage *image, enum pixel_format *format);
+#ifdef DISPLAY_HAVE_XDAMAGE
+static int wait_for_damage(x_capture *capture, int timeout_ms);
+static int read_damage_events(x_capture *capture);
+static int fetch_damage(x_capture *capture, damage_rect *rects, int max_rects);
+#endif
+
+
+/// ---- Api Implementation ----
+
+
+int x_capture_open(x_capture *capture, Display *display, Window window,
+                   int width, int height) {
+  capture->display = display;
+  capture->window = window;
+  capture->width = width;
+  capture->height = height;
+  capture->fresh = 1;
+  capture->have_damage = 0;
+#ifdef DISPLAY_HAVE_XDAMAGE
+  // start tracking before the first fetch so nothing drawn between is missed
+  int error_base;
+  if (XDamageQueryExtension(display, &capture->damage_event_base, &error_base)) {
+    // one event each time the damage goes from empty to not,
+    // the rects are read from the server when we are ready for them
+    capture->damage = XDamageCreate(display, window, XDamageReportNonEmpty);
+    capture->region = XFixesCreateRegion(display, NULL, 0);
+    capture->have_damage = 1;
+  } else {
+    printf("X server has no damage extension, capturing whole frames\n");
+  }
+#endif
+  capture->have_shm = 0;
+  if (create_shm_image(capture) == 0) {
+    if (XShmGetImage(display, window, capture->image, 0, 0, AllPlanes))
+      return image_format(capture->image, &capture->format);
+    fprintf(stderr, "Failed to get X window image through shm, using the socket\n");
+    destroy_shm_image(capture, 1);
+  }
+  capture->image = XGetImage(display, window, 0, 0, width, height,
+                             AllPlanes, ZPixmap);
+  if (capture->image == NULL) {
+    fprintf(stderr, "Failed to get X window image\n");
+    return -1;
+  }
+  return image_format(capture->image, &capture->format);
+}
+
+void x_capture_close(x_capture *capture) {
+  if (capture->have_shm)
+    destroy_shm_image(capture, 1);
+  else if (capture->image != NULL)
+    XDestroyImage(capture->image);
+  capture->image = NULL;
+  capture->display = NULL;
+}
+
+void x_capture_abandon(x_capture *capture) {
+  if (capture->have_shm)
+    destroy_shm_image(capture, 0);
+  else if (capture->image != NULL)
+    XDestroyImage(capture->image);
+  capture->image = NULL;
+  capture->display = NULL;
+}
+
+int x_capture_update(x_capture *capture, int timeout_ms,
+                     damage_rect *rects, int max_rects) {
+  if (capture->fresh) {
+    capture->fresh = 0;
+    rects[0] = (damage_rect){0, 0, capture->width, capture->height};
+    return 1;
+  }
+  uint64_t start = time_monotonic_ns();
+  if (!capture->have_damage) {
+    int count = fetch_window(capture, rects);
+    stats_record_since(STATS_CAPTURE, start);
+    return count;
+  }
+#ifdef DISPLAY_HAVE_XDAMAGE
+  if (!wait_for_damage(capture, timeout_ms))
+    return 0;
+  // waiting for damage isn't part of capturing
+  start = time_monotonic_ns();
+  int count = fetch_damage(capture, rects, max_rects);
+  stats_record_since(STATS_CAPTURE, start);
+  return count;
+#else
+  return 0;
+#endif
+}
+
+
+/// ---- Helper Definitions ----
+
+
+static int shm_failed;
+
+// returns -1 if shm is unavailable, ie the server is on another machine
+static int create_shm_image(x_capture *capture) {
+  Display *display = capture->display;
+  if (!XShmQueryExtension(display))
+    return -1;
+  XWindowAttributes attributes;
+  if (!XGetWindowAttributes(display, capture->window, &attributes))
+    return -1;
+  capture->image = XShmCreateImage(display, attributes.visual, attributes.depth,
+                                   ZPixmap, NULL, &capture->shm,
+                                   capture->width, capture->height);
+  if (capture->image == NULL)
+    return -1;
+  capture->shm.shmid = shmget(IPC_PRIVATE,
+                              capture->image->bytes_per_line * capture->height,
+                              IPC_CREAT | 0600);
+  if (capture->shm.shmid == -1) {
+    XDestroyImage(capture->image);
+    capture->image = NULL;
+    return -1;
+  }
+  capture->shm.shmaddr = shmat(capture->shm.shmid, NULL, 0);
+  // removed now, it is freed once we and the server have both detached
+  shmctl(capture->shm.shmid, IPC_RMID, NULL);
+  if (capture->shm.shmaddr == (char *)-1) {
+    XDestroyImage(capture->image);
+    capture->image = NULL;
+    return -1;
+  }
+  capture->image->data = capture->shm.shmaddr;
+  capture->shm.readOnly = False;
+
+  // attaching fails with an error rather than a return value, which
+  // would otherwise exit the program. the handler is process wide, so the
+  // display is locked to keep other threads' errors from reaching it
+  shm_failed = 0;
+  XLockDisplay(display);
+  XSync(display, False);
+  XErrorHandler previous = XSetErrorHandler(shm_error_handler);
+  XShmAttach(display, &capture->shm);
+  XSync(display, False);
+  XSetErrorHandler(previous);
+  XUnlockDisplay(display);
+  if (shm_failed) {
+    shmdt(capture->shm.shmaddr);
+    capture->image->data = NULL;
+    XDestroyImage(capture->image);
+    capture->image = NULL;
+    return -1;
+  }
+  capture->have_shm = 1;
+  return 0;
+}
+
+// detach is 0 once the connection is lost, the server has already let go
+// of the segment then and nothing more can be sent
+static void destroy_shm_image(x_capture *capture, int detach) {
+  if (detach) {
+    XShmDetach(capture->display, &capture->shm);
+    // the segment is only freed once the server has detached too
+    XSync(capture->display, False);
+  }
+  shmdt(capture->shm.shmaddr);
+  // the data isn't malloced, stop XDestroyImage freeing it
+  capture->image->data = NULL;
+  XDestroyImage(capture->image);
+  capture->image = NULL;
+  capture->have_shm = 0;
+}
+
+static int shm_error_handler(Display *display, XErrorEvent *error) {
+  shm_failed = 1;
+  return 0;
+}
+
+static int image_format(XImage *image, enum pixel_format *format) {
+  if (image->byte_order == LSBFirst) {
+    if (image->bits_per_pixel == 16 && image->red_mask == 0xF800) {
+      *format = PIXEL_FORMAT_RGB565;
+      return 0;
+    }
+    if (image->bits_per_pixel == 16 && image->blue_mask == 0xF800) {
+      *format = PIXEL_FORMAT_BGR565;
+      return 0;
+    }
+    if (image->bits_per_pixel == 24 && image->red_mask == 0xFF0000) {
+      *format = PIXEL_FORMAT_RGB888;
+      return 0;
+    }
+    if (image->bits_per_pixel == 32 && image->red_mask == 0xFF0000) {
+      *format = PIXEL_FORMAT_XRGB8888;
+      return 0;
+    }
+  }
+  fprintf(stderr, "X image has unsupported format, %d bits per pixel red mask %lx\n",
+          image->bits_per_pixel, image->red_mask);
+  return -1;
+}
+
+static int fetch_window(x_capture *capture, damage_rect *rects) {
+  if (capture->have_shm) {
+    if (!XShmGetImage(capture->display, capture->window, capture->image,
+                      0, 0, AllPlanes))
+      return -1;
+  } else if (XGetSubImage(capture->display, capture->window, 0, 0,
+                          capture->width, capture->height, AllPlanes, ZPixmap,
+                          capture->image, 0, 0) == NULL)
+    return -1;
+  rects[0] = (damage_rect){0, 0, capture->width, capture->height};
+  return 1;
+}
+
+#ifdef DISPLAY_HAVE_XDAMAGE
+
+// returns 1 if damage was reported
+static int wait_for_damage(x_capture *capture, int timeout_ms) {
+  // other threads' requests can read our events off the connection,
+  // so check the queue first. an event read in the gap before
+  // the poll only delays us until the timeout
+  if (read_damage_events(capture))
+    return 1;
+  struct pollfd fd = {ConnectionNumber(capture->display), POLLIN, 0};
+  if (poll(&fd, 1, timeout_ms) <= 0)
+    return 0;
+  return read_damage_events(capture);
+}
+
+// take the damage events off the queue, leaving any others (ie
+// cursor changes) for whoever reads them. returns 1 if there were any
+static int read_damage_events(x_capture *capture) {
+  int damaged = 0;
+  XEvent event;
+  while (XCheckTypedEvent(capture->display, capture->damage_event_base + XDamageNotify,
+                          &event))
+    damaged = 1;
+  return damaged;
+}
+
+static int fetch_damage(x_capture *capture, damage_rect *rects, int max_rects) {
+  XDamageSubtract(capture->display, capture->damage, None, capture->region);
+  int count;
+  XRectangle *area = XFixesFetchRegion(capture->display, capture->region, &count);
+  if (area == NULL)
+    return -1;
+  int rect_count = 0;
+  for (int i = 0; i < count; i++) {
+    // clip to the window, the region can cover child windows past its edge
+    int x0 = area[i].x < 0 ? 0 : area[i].x;
+    int y0 = area[i].y < 0 ? 0 : area[i].y;
+    int x1 = area[i].x + area[i].width;
+    int y1 = area[i].y + area[i].height;
+    if (x1 > capture->width)
+      x1 = capture->width;
+    if (y1 > capture->height)
+      y1 = capture->height;
+    if (x1 <= x0 || y1 <= y0)
+      continue;
+    if (rect_count == max_rects) {
+      rect_count = -1;
+      break;
+    }
+    rects[rect_count++] = (damage_rect){x0, y0, x1 - x0, y1 - y0};
+  }
+  XFree(area);
+
+  if (rect_count == -1)
+    return fetch_window(capture, rects);
+  long area_total = 0;
+  for (int i = 0; i < rect_count; i++)
+    area_total += (long)rects[i].w * rects[i].h;
+  if (capture->have_shm
+      && area_total * SHM_FETCH_FRACTION >= (long)capture->width * capture->height) {
+    if (!XShmGetImage(capture->display, capture->window, capture->image,
+                      0, 0, AllPlanes))
+      return -1;
+    return rect_count;
+  }
+  for (int i = 0; i < rect_count; i++)
+    if (XGetSubImage(capture->display, capture->window, rects[i].x, rects[i].y,
+                     rects[i].w, rects[i].h, AllPlanes, ZPixmap,
+                     capture->image, rects[i].x, rects[i].y) == NULL)
+      return -1;
+  return rect_count;
+}
+
+#endif
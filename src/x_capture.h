@@ -0,0 +1,67 @@
+#ifndef DISPLAY_X_CAPTURE_H
+#define DISPLAY_X_CAPTURE_H
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+#ifdef DISPLAY_HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#endif
+
+#include "damage.h"
+#include "pixel_convert.h"
+
+/// Keeps a copy of an X window's contents up to date.
+/// With the XDamage extension only the areas the server reports as drawn
+/// are fetched, and waiting for a change blocks on damage events instead
+/// of polling. Without it (not built in or not on the server) every
+/// update fetches the whole window.
+/// Images are read through a MIT-SHM segment when the server shares
+/// memory with us, so large fetches skip the socket and per frame allocation.
+
+typedef struct x_capture {
+  Display *display;
+  Window window;
+  int width;
+  int height;
+  // window contents as of the last update, reused between updates
+  XImage *image;
+  enum pixel_format format;
+  // image was just fetched whole, the next update reports it all
+  int fresh;
+
+  // image data is in shm, shared with the server
+  int have_shm;
+  XShmSegmentInfo shm;
+
+  int have_damage;
+#ifdef DISPLAY_HAVE_XDAMAGE
+  int damage_event_base;
+  Damage damage;
+  XserverRegion region;
+#endif
+} x_capture;
+
+// start capturing the window, returns -1 on error or if its pixel format
+// isn't one pixel_convert.h takes.
+// display must be opened after XInitThreads if other threads use it
+int x_capture_open(x_capture *capture, Display *display, Window window,
+                   int width, int height);
+
+// frees the copy and has the server detach from its shm, the rest of the
+// server resources go with the connection
+void x_capture_close(x_capture *capture);
+
+// x_capture_close for once the connection is lost, only frees our side
+void x_capture_abandon(x_capture *capture);
+
+// wait up to timeout_ms for the window to change (returns straight away
+// without damage support) and fetch the changed areas into capture->image.
+// returns the number of rects written to rects, collapsing them into the
+// whole window if there are more than max_rects. 0 if nothing changed,
+// which can be before the timeout when other events arrive
+int x_capture_update(x_capture *capture, int timeout_ms,
+                     damage_rect *rects, int max_rects);
+
+#endif
@@ -0,0 +1,88 @@
+#include "x_cursor.h"
+
+#include <stdio.h>
+
+#ifdef DISPLAY_HAVE_XFIXES
+static int read_cursor_events(x_cursor *cursor);
+static void fetch_image(x_cursor *cursor, cursor_image *image);
+#endif
+
+
+/// ---- Api Implementation ----
+
+
+void x_cursor_open(x_cursor *cursor, Display *display, Window window) {
+  cursor->display = display;
+  cursor->window = window;
+  cursor->fresh = 1;
+  cursor->have_xfixes = 0;
+#ifdef DISPLAY_HAVE_XFIXES
+  int error_base;
+  if (XFixesQueryExtension(display, &cursor->xfixes_event_base, &error_base)) {
+    XFixesSelectCursorInput(display, window, XFixesDisplayCursorNotifyMask);
+    cursor->have_xfixes = 1;
+  } else {
+    printf("X server has no xfixes extension, drawing a plain cursor\n");
+  }
+#endif
+}
+
+int x_cursor_update(x_cursor *cursor, int *x, int *y, cursor_image *image) {
+  int root_x, root_y;
+  unsigned int mask;
+  Window root, child;
+  XQueryPointer(cursor->display, cursor->window, &root, &child, &root_x, &root_y,
+                x, y, &mask);
+  int fresh = cursor->fresh;
+  cursor->fresh = 0;
+  if (!cursor->have_xfixes) {
+    if (fresh)
+      cursor_arrow_image(image);
+    return fresh;
+  }
+#ifdef DISPLAY_HAVE_XFIXES
+  // always drained, so the events don't pile up
+  if (read_cursor_events(cursor) || fresh) {
+    fetch_image(cursor, image);
+    return 1;
+  }
+#endif
+  return 0;
+}
+
+
+/// ---- Helper Definitions ----
+
+
+#ifdef DISPLAY_HAVE_XFIXES
+
+// take the cursor events off the queue, leaving any others
+// for whoever reads them. returns 1 if there were any
+static int read_cursor_events(x_cursor *cursor) {
+  int changed = 0;
+  XEvent event;
+  while (XCheckTypedEvent(cursor->display,
+                          cursor->xfixes_event_base + XFixesCursorNotify, &event))
+    changed = 1;
+  return changed;
+}
+
+static void fetch_image(x_cursor *cursor, cursor_image *image) {
+  XFixesCursorImage *current = XFixesGetCursorImage(cursor->display);
+  if (current == NULL) {
+    cursor_arrow_image(image);
+    return;
+  }
+  // oversized cursors lose their right and bottom edges
+  image->width = current->width < CURSOR_MAX_SIZE ? current->width : CURSOR_MAX_SIZE;
+  image->height = current->height < CURSOR_MAX_SIZE ? current->height : CURSOR_MAX_SIZE;
+  image->hot_x = current->xhot;
+  image->hot_y = current->yhot;
+  // pixels are in longs, 64 bits wide on some machines
+  for (int y = 0; y < image->height; y++)
+    for (int x = 0; x < image->width; x++)
+      image->pixels[y * CURSOR_MAX_SIZE + x] = current->pixels[y * current->width + x];
+  XFree(current);
+}
+
+#endif
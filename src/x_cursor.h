@@ -0,0 +1,36 @@
+#ifndef DISPLAY_X_CURSOR_H
+#define DISPLAY_X_CURSOR_H
+
+#include <X11/Xlib.h>
+
+#ifdef DISPLAY_HAVE_XFIXES
+#include <X11/extensions/Xfixes.h>
+#endif
+
+#include "cursor.h"
+
+/// Follows an X server's pointer and the image it is drawn with.
+/// The position is read with XQueryPointer each update. With the XFixes
+/// extension the image is the server's own, fetched again only when a
+/// cursor change event says it was replaced. Without it the arrow from
+/// cursor.h is used.
+
+typedef struct x_cursor {
+  Display *display;
+  Window window;
+  // the image hasn't been returned since opening
+  int fresh;
+  int have_xfixes;
+#ifdef DISPLAY_HAVE_XFIXES
+  int xfixes_event_base;
+#endif
+} x_cursor;
+
+// start following the pointer over window
+void x_cursor_open(x_cursor *cursor, Display *display, Window window);
+
+// read the pointer position into x and y, and the cursor image into
+// image if it changed since the last update. returns 1 if image was written
+int x_cursor_update(x_cursor *cursor, int *x, int *y, cursor_image *image);
+
+#endif